@@ -1,5 +1,7 @@
 ﻿#include "intervalcounter.h"
 #include <optional>
+#include <unordered_set>
+#include <algorithm>
 
 #include <data/train/trainfiltercore.h>
 #include <data/train/traincollection.h>
@@ -7,6 +9,8 @@
 #include <data/diagram/trainadapter.h>
 #include <data/diagram/trainline.h>
 #include <data/rail/railstation.h>
+#include <data/rail/railway.h>
+#include <util/qeparallel.h>
 
 IntervalCounter::IntervalCounter(const TrainCollection &coll):
     coll(coll)
@@ -20,7 +24,14 @@ IntervalTrainList IntervalCounter::getIntervalTrains(
         std::shared_ptr<const RailStation> to)
 {
     IntervalTrainList res{};
-    foreach(auto train, coll.trains()){
+    // 只有在发站、到站都有绑定的车次才可能有结果；从第一个经过发站的运行线开始
+    std::unordered_set<const Train*> to_trains;
+    for (const auto& p : boundTrains(rail, to.get(), false)) {
+        to_trains.insert(p.first.get());
+    }
+    for (const auto& [train, first_line] : boundTrains(rail, from.get(), false)) {
+        if (!to_trains.count(train.get()))
+            continue;
         if (! _filter->check(train)){
             continue;
         }
@@ -28,7 +39,8 @@ IntervalTrainList IntervalCounter::getIntervalTrains(
         if (!adp) continue;
         std::optional<std::deque<AdapterStation>::iterator> start_itr=std::nullopt;
         bool start_is_starting=false;
-        foreach(auto line, adp->lines()){
+        for (int li = first_line; li < adp->lines().size(); li++) {
+            auto line = adp->lines().at(li);
             decltype(line->stations().begin()) last;
             int add_days = 0;
             for (auto itr = line->stations().begin();
@@ -64,49 +76,71 @@ IntervalTrainList IntervalCounter::getIntervalTrains(
 {
     auto search_start = transSearchStation(from, _multiStart), search_end = transSearchStation(to, _multiEnd);
     IntervalTrainList res{};
-    foreach(auto train,coll.trains()){
-        if (!_filter->check(train))
-            continue;
-        const TrainStation* start_station=nullptr;
-        bool start_is_starting=false;
-        int add_days = 0;
-        Train::StationPtr last;
-        for(auto itr=train->timetable().begin();
-            itr!=train->timetable().end();++itr){
-            if (start_station) {  // count days. `last` must be valid, obviously.
-                if (itr->arrive < last->depart) {
-                    add_days++;
+    // 由倒排表取得发站、到站的候选，只处理两边都出现的车次。
+    // 处理逻辑与逐站扫描的版本一致：车次内从第一个发站开始，到最后一个到站为止。
+    _odIndex.refresh(coll);
+    const auto starts = _odIndex.match(search_start, _regexStart);
+    const auto ends = _odIndex.match(search_end, _regexEnd);
+    auto ps = starts.begin(), pe = ends.begin();
+    while (ps != starts.end() && pe != ends.end()) {
+        if (ps->train < pe->train) { ++ps; continue; }
+        if (pe->train < ps->train) { ++pe; continue; }
+        const int t = ps->train;
+        auto ps_end = ps, pe_end = pe;
+        while (ps_end != starts.end() && ps_end->train == t) ++ps_end;
+        while (pe_end != ends.end() && pe_end->train == t) ++pe_end;
+
+        const auto& rec = _odIndex.trains().at(t);
+        const auto& train = rec.train;
+        if (_filter->check(train)) {
+            const TrainStation* start_station = nullptr;
+            bool start_is_starting = false;
+            int add_days = 0;
+            const TrainStation* last = nullptr;
+            auto cs = ps, ce = pe;
+            const int pos_end = std::prev(pe_end)->pos;
+            for (int pos = ps->pos; pos <= pos_end; pos++) {
+                const TrainStation* itr = rec.stations.at(pos);
+                while (cs != ps_end && cs->pos < pos) ++cs;
+                while (ce != pe_end && ce->pos < pos) ++ce;
+                const bool is_start = (cs != ps_end && cs->pos == pos);
+                const bool is_end = (ce != pe_end && ce->pos == pos);
+                if (start_station) {  // count days. `last` must be valid, obviously.
+                    if (itr->arrive < last->depart) {
+                        add_days++;
+                    }
                 }
-            }
-            if (checkStationName(itr->name, search_start, _regexStart)){
-                // 2022.04.24：允许多车站后，替代需要条件
-                // 如果上一站满足停车和营业条件但本站不满足，不替换；否则替换
-                auto* this_station = &*itr;
-                bool this_is_starting = train->isStartingStation(itr->name);
-                if (!start_station || !checkStationStopBusiness(*start_station, start_is_starting) ||
-                    checkStationStopBusiness(*this_station, this_is_starting)) {
-                    start_station = this_station;
-                    start_is_starting = this_is_starting;
-                    add_days = 0;
+                if (is_start) {
+                    // 2022.04.24：允许多车站后，替代需要条件
+                    // 如果上一站满足停车和营业条件但本站不满足，不替换；否则替换
+                    bool this_is_starting = train->isStartingStation(itr->name);
+                    if (!start_station || !checkStationStopBusiness(*start_station, start_is_starting) ||
+                        checkStationStopBusiness(*itr, this_is_starting)) {
+                        start_station = itr;
+                        start_is_starting = this_is_starting;
+                        add_days = 0;
+                    }
                 }
-            }else if(start_station &&
-                    checkStationName(itr->name, search_end, _regexEnd)){    
-                IntervalTrainInfo info(
-                            train, start_station, &*itr, start_is_starting,
-                            train->isTerminalStation(itr->name), add_days);
-                if (checkStopBusiness(info)){
-                    res.emplace_back(std::move(info));
-                    start_station=nullptr;
+                else if (start_station && is_end) {
+                    IntervalTrainInfo info(
+                        train, start_station, itr, start_is_starting,
+                        train->isTerminalStation(itr->name), add_days);
+                    if (checkStopBusiness(info)) {
+                        res.emplace_back(std::move(info));
+                        start_station = nullptr;
+                    }
                 }
-            }
-            // 2023.06.04: add days count for in-station-pass of a day. Only needed for station that is NOT the end one.
-            if (start_station && start_station != &*itr) {
-                if (itr->depart < itr->arrive) {
-                    add_days++;
+                // 2023.06.04: add days count for in-station-pass of a day. Only needed for station that is NOT the end one.
+                if (start_station && start_station != itr) {
+                    if (itr->depart < itr->arrive) {
+                        add_days++;
+                    }
                 }
+                last = itr;
             }
-            last = itr;
         }
+        ps = ps_end;
+        pe = pe_end;
     }
     return res;
 }
@@ -116,12 +150,14 @@ RailIntervalCount IntervalCounter::getIntervalCountSource(
         std::shared_ptr<const RailStation> center) const
 {
     RailIntervalCount res{};
-    foreach(auto train,coll.trains()){
+    // 只处理在中心站有绑定的车次，从第一个经过中心站的运行线开始
+    for (const auto& [train, first_line] : boundTrains(rail, center.get(), false)) {
         auto adp=train->adapterFor(*rail);
         if (!adp) continue;
         const TrainStation* center_station=nullptr;
         bool center_is_start_or_end=false;
-        foreach(auto line,adp->lines()){
+        for (int li = first_line; li < adp->lines().size(); li++) {
+            auto line = adp->lines().at(li);
             if (!_filter->check(train))
                 continue;
 
@@ -163,17 +199,17 @@ RailIntervalCount IntervalCounter::getIntervalCountSource(
 RailIntervalCount IntervalCounter::getIntervalCountDrain(std::shared_ptr<const Railway> rail, std::shared_ptr<const RailStation> drain) const
 {
     RailIntervalCount res{};
-    foreach(auto train,coll.trains()){
+    // 只处理在中心站有绑定的车次，从最后一个经过中心站的运行线开始反向遍历
+    for (const auto& [train, last_line] : boundTrains(rail, drain.get(), true)) {
         auto adp=train->adapterFor(*rail);
         if (!adp) continue;
         const TrainStation* center_station=nullptr;
         bool center_is_start_or_end=false;
 
-        for (auto lineit=adp->lines().rbegin();
-             lineit!=adp->lines().rend();++lineit){
+        for (int li = last_line; li >= 0; li--) {
             if (!_filter->check(train))
                 continue;
-            auto line=*lineit;
+            auto line = adp->lines().at(li);
 
             int add_days = 0;
             auto last = line->stations().rbegin();
@@ -209,14 +245,99 @@ RailIntervalCount IntervalCounter::getIntervalCountDrain(std::shared_ptr<const R
     return res;
 }
 
+IntervalCountMatrix IntervalCounter::getIntervalCountMatrix(std::shared_ptr<const Railway> rail) const
+{
+    // 参与统计的站及其在矩阵中的序号；不参与的为-1
+    std::vector<std::shared_ptr<const RailStation>> stations;
+    std::unordered_map<const RailStation*, int> mat_index;
+    foreach(const auto & st, rail->stations()) {
+        if (checkStation(st)) {
+            mat_index.emplace(st.get(), static_cast<int>(stations.size()));
+            stations.push_back(st);
+        }
+    }
+    const int n = static_cast<int>(stations.size());
+
+    // 筛选器在调用线程上判定，工作线程只读取列车数据
+    std::vector<std::pair<std::shared_ptr<Train>, bool>> trains;
+    foreach(const auto & train, coll.trains()) {
+        if (_filter->check(train) && train->adapterFor(*rail)) {
+            trains.emplace_back(train, train->getIsPassenger());
+        }
+    }
+
+    // 分块并行，每块累加到各自的矩阵，最后合并
+    const int nchunks = std::min(static_cast<int>(trains.size()), 2 * qeutil::workerThreadCount());
+    std::vector<IntervalCountMatrix> partials(std::max(nchunks, 1), IntervalCountMatrix(stations));
+
+    struct Pos {
+        int index;     // 矩阵序号
+        const TrainStation* station;
+        bool isStarting, isTerminal;
+    };
+
+    qeutil::parallelFor(nchunks, [&](int c) {
+        auto& mat = partials[c];
+        std::vector<Pos> seq;
+        std::vector<int> latest(n, -1);   // 各站最后一次出现在seq中的位置
+        std::vector<int> seen;            // 已出现过的站（矩阵序号）
+        for (size_t t = c; t < trains.size(); t += nchunks) {
+            const auto& [train, passenger] = trains.at(t);
+            auto adp = train->adapterFor(*rail);
+            seq.clear();
+            foreach(const auto & line, adp->lines()) {
+                for (const auto& ast : line->stations()) {
+                    auto rst = ast.railStation.lock();
+                    auto itr = mat_index.find(rst.get());
+                    if (itr == mat_index.end()) continue;
+                    seq.push_back(Pos{ itr->second, &*ast.trainStation,
+                        line->isStartingStation(&ast), line->isTerminalStation(&ast) });
+                }
+            }
+            // 与getIntervalCountSource()一致：每个此前出现过的站，取其最后一次出现作为发站
+            for (int j = 0; j < static_cast<int>(seq.size()); j++) {
+                const auto& to = seq.at(j);
+                for (int s : seen) {
+                    if (s == to.index) continue;
+                    const auto& from = seq.at(latest[s]);
+                    if (!checkStopBusiness(*from.station, *to.station, from.isStarting, to.isTerminal))
+                        continue;
+                    auto& cell = mat.at(s, to.index);
+                    cell.total++;
+                    if (passenger) cell.passenger++;
+                    if (from.isStarting) cell.start++;
+                    if (to.isTerminal) cell.end++;
+                    if (from.isStarting && to.isTerminal) cell.startEnd++;
+                }
+                if (latest[to.index] < 0)
+                    seen.push_back(to.index);
+                latest[to.index] = j;
+            }
+            for (int s : seen) latest[s] = -1;
+            seen.clear();
+        }
+        });
+
+    for (int c = 1; c < nchunks; c++) {
+        partials.front() += partials.at(c);
+    }
+    return std::move(partials.front());
+}
+
 bool IntervalCounter::checkStopBusiness(const IntervalTrainInfo &info) const
+{
+    return checkStopBusiness(*info.from, *info.to, info.isStarting, info.isTerminal);
+}
+
+bool IntervalCounter::checkStopBusiness(const TrainStation& from, const TrainStation& to,
+    bool isStarting, bool isTerminal) const
 {
     return
        (!_stopOnly || (
-            (info.from->isStopped() || info.isStarting) &&
-            (info.to->isStopped() || info.isTerminal))) &&
+            (from.isStopped() || isStarting) &&
+            (to.isStopped() || isTerminal))) &&
        (!_businessOnly ||
-        (info.from->business && info.to->business));
+        (from.business && to.business));
 }
 
 bool IntervalCounter::checkStationStopBusiness(const TrainStation& st, bool isStartEnd)
@@ -243,6 +364,39 @@ bool IntervalCounter::checkStationName(const StationName& name,
     return false;
 }
 
+std::vector<std::pair<std::shared_ptr<Train>, int>> IntervalCounter::boundTrains(
+    std::shared_ptr<const Railway> rail, const RailStation* st, bool last) const
+{
+    for (auto itr = _railIndexes.begin(); itr != _railIndexes.end();) {
+        if (itr->first != rail.get() && itr->second.expired())
+            itr = _railIndexes.erase(itr);
+        else ++itr;
+    }
+    auto& index = _railIndexes[rail.get()];
+    index.refresh(rail, coll);
+
+    std::unordered_map<const Train*, int> line_index;
+    for (const auto& e : index.entries(st)) {
+        if (!e.station) continue;   // 推算通过，不是本站的时刻
+        int li = static_cast<int>(e.line->adapter().lines().indexOf(e.line));
+        auto [itr, inserted] = line_index.emplace(e.train, li);
+        if (!inserted) {
+            itr->second = last ? std::max(itr->second, li) : std::min(itr->second, li);
+        }
+    }
+
+    std::vector<std::pair<std::shared_ptr<Train>, int>> res;
+    if (line_index.empty())
+        return res;
+    res.reserve(line_index.size());
+    for (const auto& train : coll.trains()) {
+        if (auto itr = line_index.find(train.get()); itr != line_index.end()) {
+            res.emplace_back(train, itr->second);
+        }
+    }
+    return res;
+}
+
 std::vector<QRegularExpression> IntervalCounter::transSearchStation(const QString& input, bool useMulti) const
 {
     std::vector<QRegularExpression> res{};
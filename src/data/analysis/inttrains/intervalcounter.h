@@ -1,10 +1,15 @@
 ﻿#pragma once
 
 #include "intervaltraininfo.h"
+#include "intervalodindex.h"
+#include "intervalmatrix.h"
 #include <vector>
+#include <unordered_map>
 #include <QString>
 #include <QRegularExpression>
 
+#include <data/diagram/stationtrainindex.h>
+
 class StationName;
 class Railway;
 class TrainCollection;
@@ -18,6 +23,10 @@ class RailStation;
  *
  * 各方法原则上按照函数设计；类里面仅包含一些配置数据。
  * 整个功能逻辑暂时参照pyETRC设计。
+ * 查询改为基于倒排索引：按站名的查询使用IntervalODIndex，
+ * 按线路车站的查询使用StationTrainIndex（各线路一个），
+ * 只处理在所给车站有记录的车次，不再遍历所有车次的时刻表。
+ * 索引在本对象内保存，每次查询前按车次的变化增量同步，因此同一对话框中的反复查询代价很小。
  */
 
 class TrainFilterCore;
@@ -31,6 +40,9 @@ class IntervalCounter
     // 区间车次表多选车站
     bool _multiStart=false, _multiEnd=false;
     bool _regexStart = false, _regexEnd = false;
+
+    mutable IntervalODIndex _odIndex;
+    mutable std::unordered_map<const Railway*, StationTrainIndex> _railIndexes;
 public:
     IntervalCounter(const TrainCollection& coll);
     const auto* filter()const{return _filter;}
@@ -100,6 +112,14 @@ public:
             std::shared_ptr<const RailStation> drain
             )const;
 
+    /**
+     * 全线区间对数矩阵（OD矩阵）。与getIntervalCountSource()逐站调用的结果一致：
+     * 元素(i, j)的车次即以第i站为中心站时，到第j站的车次；
+     * 停车、营业、车次筛选条件同上，办客/办货站限制同时作用于发站和到站（不符合的站不进入矩阵）。
+     * 各车次只沿其在本线的运行线遍历一次（每车次至多 O(站数^2)），车次间并行计算。
+     */
+    IntervalCountMatrix getIntervalCountMatrix(std::shared_ptr<const Railway> rail)const;
+
     /**
      * 确定指定站是否要符合办客站/办货站限制
      * （是否要显示出来）
@@ -113,10 +133,20 @@ private:
      */
     bool checkStopBusiness(const IntervalTrainInfo& info)const;
 
+    bool checkStopBusiness(const TrainStation& from, const TrainStation& to,
+        bool isStarting, bool isTerminal)const;
+
     bool checkStationStopBusiness(const TrainStation& st, bool isStartEnd);
 
     bool checkStationName(const StationName& name, const std::vector<QRegularExpression>& std_names, bool useReg)const;
 
+    /**
+     * 在线路rail的车站st有绑定的车次（按车次表顺序），以及其中最前（last为true时最后）
+     * 一个经过该站的运行线在Adapter中的序号。在此运行线之前（之后）的部分与该站无关。
+     */
+    std::vector<std::pair<std::shared_ptr<Train>, int>> boundTrains(
+        std::shared_ptr<const Railway> rail, const RailStation* st, bool last)const;
+
     /**
      * 2022.05.06：改为正则表达式的列表。
      * 如果不启用正则，就直接按pattern()解释为站名。
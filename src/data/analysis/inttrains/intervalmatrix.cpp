@@ -0,0 +1,83 @@
+﻿#include "intervalmatrix.h"
+
+#include <QFile>
+#include <QTextStream>
+#include <QObject>
+
+#include <data/rail/railstation.h>
+
+IntervalCountMatrix::Cell& IntervalCountMatrix::Cell::operator+=(const Cell& other)
+{
+    total += other.total;
+    passenger += other.passenger;
+    start += other.start;
+    end += other.end;
+    startEnd += other.startEnd;
+    return *this;
+}
+
+IntervalCountMatrix::IntervalCountMatrix(std::vector<std::shared_ptr<const RailStation>> stations):
+    _stations(std::move(stations)), _cells(_stations.size() * _stations.size())
+{
+}
+
+int IntervalCountMatrix::cellValue(const Cell& cell, Value value)
+{
+    switch (value) {
+    case Value::Total: return cell.total;
+    case Value::Passenger: return cell.passenger;
+    case Value::Freight: return cell.total - cell.passenger;
+    case Value::Start: return cell.start;
+    case Value::End: return cell.end;
+    case Value::StartEnd: return cell.startEnd;
+    default: return 0;
+    }
+}
+
+IntervalCountMatrix& IntervalCountMatrix::operator+=(const IntervalCountMatrix& other)
+{
+    for (size_t i = 0; i < _cells.size(); i++) {
+        _cells[i] += other._cells[i];
+    }
+    return *this;
+}
+
+void IntervalCountMatrix::toCsv(QTextStream& s, Value value) const
+{
+    s << QObject::tr("%1 (发站/到站)").arg(valueName(value));
+    for (const auto& st : _stations) {
+        s << "," << st->name.toSingleLiteral();
+    }
+    s << Qt::endl;
+    for (int i = 0; i < size(); i++) {
+        s << _stations.at(i)->name.toSingleLiteral();
+        for (int j = 0; j < size(); j++) {
+            s << "," << cellValue(at(i, j), value);
+        }
+        s << Qt::endl;
+    }
+}
+
+bool IntervalCountMatrix::toCsv(const QString& filename, Value value) const
+{
+    QFile file(filename);
+    if (!file.open(QFile::WriteOnly))
+        return false;
+    QTextStream s(&file);
+    toCsv(s, value);
+    file.close();
+    return true;
+}
+
+QString IntervalCountMatrix::valueName(Value value)
+{
+    switch (value) {
+    case Value::Total: return QObject::tr("总对数");
+    case Value::Passenger: return QObject::tr("客车对数");
+    case Value::Freight: return QObject::tr("货车对数");
+    case Value::Start: return QObject::tr("始发对数");
+    case Value::End: return QObject::tr("终到对数");
+    case Value::StartEnd: return QObject::tr("始发终到对数");
+    default: return {};
+    }
+}
@@ -0,0 +1,69 @@
+﻿#pragma once
+
+#include <memory>
+#include <vector>
+#include <QString>
+
+class RailStation;
+class QTextStream;
+
+/**
+ * @brief The IntervalCountMatrix class
+ * 线路各站之间的区间对数矩阵（OD矩阵），稠密存储。
+ * 行为发站，列为到站，顺序与stations()一致（即线路车站顺序中参与统计的站）。
+ * 每个元素的统计口径与IntervalCountInfo相同（总数、始发、终到、始发终到），另记客车数。
+ * 由IntervalCounter::getIntervalCountMatrix()生成。
+ */
+class IntervalCountMatrix
+{
+public:
+    struct Cell {
+        int total = 0;
+        int passenger = 0;      // 其中客车；货车数即total-passenger
+        int start = 0, end = 0, startEnd = 0;
+
+        Cell& operator+=(const Cell& other);
+    };
+
+    /**
+     * 导出CSV时选取的数值
+     */
+    enum class Value {
+        Total = 0,
+        Passenger,
+        Freight,
+        Start,
+        End,
+        StartEnd
+    };
+
+private:
+    std::vector<std::shared_ptr<const RailStation>> _stations;
+    std::vector<Cell> _cells;
+
+public:
+    IntervalCountMatrix() = default;
+    explicit IntervalCountMatrix(std::vector<std::shared_ptr<const RailStation>> stations);
+
+    int size()const { return static_cast<int>(_stations.size()); }
+    const auto& stations()const { return _stations; }
+
+    const Cell& at(int from, int to)const { return _cells[from * _stations.size() + to]; }
+    Cell& at(int from, int to) { return _cells[from * _stations.size() + to]; }
+
+    static int cellValue(const Cell& cell, Value value);
+
+    /**
+     * 逐元素累加；要求两矩阵车站相同
+     */
+    IntervalCountMatrix& operator+=(const IntervalCountMatrix& other);
+
+    /**
+     * 以CSV格式输出所选数值：首行为到站，首列为发站
+     */
+    void toCsv(QTextStream& s, Value value)const;
+
+    bool toCsv(const QString& filename, Value value)const;
+
+    static QString valueName(Value value);
+};
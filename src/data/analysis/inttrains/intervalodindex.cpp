@@ -0,0 +1,98 @@
+﻿#include "intervalodindex.h"
+
+#include <algorithm>
+
+#include <data/train/train.h>
+#include <data/train/traincollection.h>
+
+void IntervalODIndex::refresh(const TrainCollection& coll)
+{
+    if (upToDate(coll))
+        return;
+    clear();
+    _trains.reserve(coll.trains().size());
+    for (const auto& train : coll.trains()) {
+        int t = static_cast<int>(_trains.size());
+        auto& rec = _trains.emplace_back();
+        rec.train = train;
+        rec.stations.reserve(train->timetable().size());
+        rec.names.reserve(train->timetable().size());
+        int pos = 0;
+        for (const auto& st : train->timetable()) {
+            rec.stations.push_back(&st);
+            rec.names.push_back(st.name);
+            // 按车次、站序依次插入，各倒排表自然有序
+            _byName[st.name].push_back(Posting{ t, pos });
+            _byStation[st.name.station()].push_back(Posting{ t, pos });
+            pos++;
+        }
+    }
+}
+
+std::vector<IntervalODIndex::Posting> IntervalODIndex::match(
+    const std::vector<QRegularExpression>& patterns, bool useReg) const
+{
+    std::vector<Posting> res;
+    int groups = 0;
+    auto add = [&res, &groups](const std::vector<Posting>& lst) {
+        res.insert(res.end(), lst.begin(), lst.end());
+        groups++;
+    };
+    if (useReg) {
+        for (auto p = _byName.begin(); p != _byName.end(); ++p) {
+            const auto& literal = p.key().toSingleLiteral();
+            for (const auto& n : patterns) {
+                if (n.match(literal).hasMatch()) {
+                    add(p.value());
+                    break;
+                }
+            }
+        }
+    }
+    else {
+        for (const auto& n : patterns) {
+            StationName name(n.pattern());
+            if (name.isBare()) {
+                if (auto itr = _byStation.find(name.station()); itr != _byStation.end())
+                    add(itr.value());
+            }
+            else {
+                if (auto itr = _byName.find(name); itr != _byName.end())
+                    add(itr.value());
+            }
+        }
+    }
+    // 多个倒排表合并时才需要排序、去重（多车站查询可能有重叠）
+    if (groups > 1) {
+        std::sort(res.begin(), res.end());
+        res.erase(std::unique(res.begin(), res.end()), res.end());
+    }
+    return res;
+}
+
+void IntervalODIndex::clear()
+{
+    _trains.clear();
+    _byName.clear();
+    _byStation.clear();
+}
+
+bool IntervalODIndex::upToDate(const TrainCollection& coll) const
+{
+    const auto& trains = coll.trains();
+    if (static_cast<size_t>(trains.size()) != _trains.size())
+        return false;
+    for (int t = 0; t < trains.size(); t++) {
+        const auto& rec = _trains.at(t);
+        const auto& train = trains.at(t);
+        if (rec.train != train || rec.stations.size() != train->timetable().size())
+            return false;
+        size_t pos = 0;
+        for (const auto& st : train->timetable()) {
+            if (rec.stations.at(pos) != &st || rec.names.at(pos) != st.name)
+                return false;
+            pos++;
+        }
+    }
+    return true;
+}
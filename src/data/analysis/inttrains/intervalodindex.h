@@ -0,0 +1,79 @@
+﻿#pragma once
+
+#include <memory>
+#include <vector>
+#include <QHash>
+#include <QString>
+#include <QRegularExpression>
+
+#include <data/common/stationname.h>
+
+class Train;
+class TrainStation;
+class TrainCollection;
+
+/**
+ * @brief The IntervalODIndex class
+ * 区间车次表（按站名查询）使用的倒排索引。
+ * 对每个车次记录时刻表各站（按顺序）；另外建立 站名 -> (车次序号, 站序号) 的倒排表，
+ * 查询发站、到站（包括多车站、正则表达式）时只需查倒排表，再对同时出现在两边的车次做归并，
+ * 而不必对所有车次的时刻表逐站做站名判定。
+ * 停车、营业等属性随时刻修改而变化，不在索引中保存，查询时由TrainStation直接读取。
+ * refresh()逐站比对时刻表结点及站名，发现车次或时刻表有变化时整体重建。
+ */
+class IntervalODIndex
+{
+public:
+    /**
+     * 倒排表的一项。train为车次在trains()中的序号，pos为该站在车次时刻表中的序号。
+     */
+    struct Posting {
+        int train;
+        int pos;
+        bool operator<(const Posting& other)const {
+            return train < other.train || (train == other.train && pos < other.pos);
+        }
+        bool operator==(const Posting& other)const {
+            return train == other.train && pos == other.pos;
+        }
+    };
+
+    struct TrainRecord {
+        std::shared_ptr<Train> train;
+        std::vector<const TrainStation*> stations;
+        std::vector<StationName> names;
+    };
+
+private:
+    std::vector<TrainRecord> _trains;
+
+    /**
+     * 按完整站名（含场名）的倒排表；各表按(train, pos)升序
+     */
+    QHash<StationName, std::vector<Posting>> _byName;
+
+    /**
+     * 按站名（不含场名）的倒排表，用于不带场名的查询
+     */
+    QHash<QString, std::vector<Posting>> _byStation;
+
+public:
+    /**
+     * 与车次表同步。无变化时不做任何事，否则重建。
+     */
+    void refresh(const TrainCollection& coll);
+
+    const auto& trains()const { return _trains; }
+
+    /**
+     * 时刻表中站名符合任一条件的所有站，按(train, pos)升序，无重复。
+     * 不使用正则时，与StationName::equalOrBelongsTo()的判定一致；
+     * 使用正则时，对每个不同的站名（toSingleLiteral()）匹配一次。
+     */
+    std::vector<Posting> match(const std::vector<QRegularExpression>& patterns, bool useReg)const;
+
+    void clear();
+
+private:
+    bool upToDate(const TrainCollection& coll)const;
+};
@@ -3,6 +3,8 @@
 #include <data/diagram/diagram.h>
 #include <data/train/trainfiltercore.h>
 #include <data/rail/railstation.h>
+#include <data/rail/railway.h>
+#include <util/qeparallel.h>
 
 namespace _gapdetail {
 
@@ -133,29 +135,127 @@ TrainGapAna::TrainGapAna(Diagram& diagram):
 }
 
 std::map<TrainGap::GapTypesV2, int> TrainGapAna::globalMinimal(
-        std::shared_ptr<Railway> rail) const
+        std::shared_ptr<Railway> rail, RailwayGapCache* cache) const
 {
-    std::map<TrainGap::GapTypesV2,int> res{};
-    auto events=diagram.stationEventsForRail(rail);
-    for(auto _p=events.begin();_p!=events.end();++_p){
-        const RailStationEventList& lst=_p->second;
-        auto gaps=calTrainGaps(lst, *filter,_p->first);
-        TrainGapStatistics stat=countTrainGaps(gaps, _cutSecs);
-
-        for (auto q = stat.begin(); q != stat.end(); ++q) {
+    return minimalOf(railwayGaps(rail, cache));
+}
+
+RailwayGapResult TrainGapAna::railwayGaps(
+    const std::map<std::shared_ptr<RailStation>, RailStationEventList>& events) const
+{
+    std::vector<decltype(events.begin())> itrs;
+    itrs.reserve(events.size());
+    for (auto p = events.begin(); p != events.end(); ++p) {
+        itrs.push_back(p);
+    }
+    RailwayGapResult res(itrs.size());
+    // 各站互不相关，结果写入各自的槽位
+    qeutil::parallelFor(static_cast<int>(itrs.size()), [&](int i) {
+        auto& r = res[i];
+        r.station = itrs[i]->first;
+        r.gaps = calTrainGaps(itrs[i]->second, *filter, r.station);
+        r.stat = countTrainGaps(r.gaps, _cutSecs);
+        });
+    return res;
+}
+
+RailwayGapResult TrainGapAna::railwayGaps(std::shared_ptr<Railway> rail, RailwayGapCache* cache) const
+{
+    if (!cache) {
+        auto events = diagram.stationEventsForRail(rail);
+        return railwayGaps(events);
+    }
+
+    if (cache->_railway.lock() != rail) {
+        cache->clear();
+        cache->_railway = rail;
+    }
+    const auto& stations = rail->stations();
+    auto fps = diagram.stationEventFingerprints(rail, filter);
+
+    // 需要重算间隔表的站（下标），以及只需重新统计的站
+    std::vector<int> todo, recount;
+    std::unordered_map<const RailStation*, RailwayGapCache::Item> items;
+    int valid = 0;
+    for (int i = 0; i < stations.size(); i++) {
+        const auto& st = stations.at(i);
+        if (st->direction == PassedDirection::NoVia) continue;
+        valid++;
+        auto itr = cache->_items.find(st.get());
+        if (itr != cache->_items.end() && itr->second.fingerprint == fps[i] &&
+            itr->second.preSingle == st->isPreSingle() &&
+            itr->second.postSingle == st->isPostSingle()) {
+            if (itr->second.cutSecs != _cutSecs)
+                recount.push_back(i);
+            items.emplace(st.get(), std::move(itr->second));
+        }
+        else {
+            todo.push_back(i);
+            auto& it = items[st.get()];
+            it.fingerprint = fps[i];
+            it.preSingle = st->isPreSingle();
+            it.postSingle = st->isPostSingle();
+            it.result.station = st;
+        }
+    }
+    // 已删除的车站随旧表一起丢弃
+    cache->_items = std::move(items);
+
+    if (!todo.empty()) {
+        // 大部分站都要重算时，单遍扫描生成全线事件表更快；否则逐站从索引查询
+        std::vector<RailStationEventList> events(todo.size());
+        if (todo.size() * 2 > static_cast<size_t>(valid)) {
+            auto all = diagram.stationEventsForRail(rail);
+            for (size_t k = 0; k < todo.size(); k++) {
+                events[k] = std::move(all[stations.at(todo[k])]);
+            }
+        }
+        else {
+            for (size_t k = 0; k < todo.size(); k++) {
+                events[k] = diagram.stationEvents(rail, stations.at(todo[k]));
+            }
+        }
+        qeutil::parallelFor(static_cast<int>(todo.size()), [&](int k) {
+            auto& it = cache->_items.at(stations.at(todo[k]).get());
+            it.result.gaps = calTrainGaps(events[k], *filter, it.result.station);
+            it.result.stat = countTrainGaps(it.result.gaps, _cutSecs);
+            it.cutSecs = _cutSecs;
+            });
+    }
+    for (int i : recount) {
+        auto& it = cache->_items.at(stations.at(i).get());
+        it.result.stat = countTrainGaps(it.result.gaps, _cutSecs);
+        it.cutSecs = _cutSecs;
+    }
+
+    RailwayGapResult res;
+    res.reserve(valid);
+    for (const auto& st : stations) {
+        if (auto itr = cache->_items.find(st.get()); itr != cache->_items.end()) {
+            res.push_back(itr->second.result);
+        }
+    }
+    return res;
+}
+
+std::map<TrainGap::GapTypesV2, int> TrainGapAna::minimalOf(const RailwayGapResult& res)
+{
+    std::map<TrainGap::GapTypesV2, int> mins{};
+    for (const auto& r : res) {
+        for (auto q = r.stat.begin(); q != r.stat.end(); ++q) {
             const auto& tp = q->first;
             std::shared_ptr<TrainGap> gap = q->second.begin().operator*();
 
             // 统计全局最小
-            if (auto curmin = res.find(tp); curmin != res.end()) {
+            if (auto curmin = mins.find(tp); curmin != mins.end()) {
                 curmin->second = std::min(curmin->second, gap->secs());
             }
             else {
-                res.emplace(tp, gap->secs());
+                mins.emplace(tp, gap->secs());
             }
         }
     }
-    return res;
+    return mins;
 }
 
 TrainGapList TrainGapAna::calTrainGaps(const RailStationEventList &events, const TrainFilterCore &filter, std::shared_ptr<const RailStation> st) const
@@ -1,5 +1,7 @@
 ﻿#pragma once
 
+#include <unordered_map>
+#include <optional>
 #include <data/diagram/traingap.h>
 #include <data/calculation/stationeventaxis.h>
 class Railway;
@@ -7,6 +9,18 @@ class Railway;
 
 class TrainFilterCore;
 class Diagram;
+class RailwayGapCache;
+
+/**
+ * 一个车站的间隔分析结果：间隔表及其分类统计。
+ */
+struct StationGapResult {
+    std::shared_ptr<RailStation> station;
+    TrainGapList gaps;
+    TrainGapStatistics stat;
+};
+
+using RailwayGapResult = std::vector<StationGapResult>;
 
 /**
  * @brief The TrainGapAna class
@@ -23,7 +37,7 @@ class TrainGapAna
     Diagram& diagram;
     const TrainFilterCore* filter=nullptr;
 //    bool _singleLine=false;
-    int _cutSecs;
+    int _cutSecs = 0;
 public:
     TrainGapAna(Diagram& diagram);
     TrainGapAna(Diagram& diagram, const TrainFilterCore* filter);
@@ -33,8 +47,32 @@ public:
 //    void setSingleLine(bool on){_singleLine=on;}
     void setCutSecs(int secs){_cutSecs=secs;}
 
+    /**
+     * 改为基于railwayGaps()，各站并行计算。
+     * 给出cache时，只重算上次调用以来事件表有变化的车站。
+     */
     std::map<TrainGap::GapTypesV2,int>
-        globalMinimal(std::shared_ptr<Railway> rail)const;
+        globalMinimal(std::shared_ptr<Railway> rail, RailwayGapCache* cache = nullptr)const;
+
+    /**
+     * 全线各站的间隔分析：由已生成的各站事件表（stationEventsForRail()或RailwayStationEventAxis），
+     * 并行地对各站执行calTrainGaps()和countTrainGaps()。结果按events的顺序给出。
+     */
+    RailwayGapResult railwayGaps(
+        const std::map<std::shared_ptr<RailStation>, RailStationEventList>& events)const;
+
+    /**
+     * 全线各站的间隔分析，结果按线路车站顺序给出（不含不经过的站）。
+     * 给出cache时，按各站事件表指纹（Diagram::stationEventFingerprints()）增量计算：
+     * 指纹与车站单双线设置都不变的站直接取缓存，仅切割时长变化的站只重新统计。
+     * 单个车次修改后，只有其运行线经过的车站需要重算。
+     */
+    RailwayGapResult railwayGaps(std::shared_ptr<Railway> rail, RailwayGapCache* cache = nullptr)const;
+
+    /**
+     * 由各站的统计结果求全线各类间隔的最小值
+     */
+    static std::map<TrainGap::GapTypesV2, int> minimalOf(const RailwayGapResult& res);
 
     /**
      * @brief calTrainGaps  由所给的列车事件表计算列车间隔。
@@ -69,3 +107,26 @@ private:
             RailStationEvent::Positions pos)const;
 };
 
+/**
+ * @brief The RailwayGapCache class
+ * TrainGapAna::railwayGaps()的增量缓存，由调用者（例如贪心排图向导）持有，
+ * 在多次分析之间保留。只对应一条线路；换用其他线路时自动清空。
+ * 本身不记录筛选器：筛选结果的变化体现在事件表指纹中。
+ */
+class RailwayGapCache
+{
+    friend class TrainGapAna;
+
+    struct Item {
+        quint64 fingerprint = 0;
+        std::optional<bool> preSingle, postSingle;
+        int cutSecs = 0;
+        StationGapResult result;
+    };
+
+    std::weak_ptr<const Railway> _railway;
+    std::unordered_map<const RailStation*, Item> _items;
+
+public:
+    void clear() { _railway.reset(); _items.clear(); }
+};
@@ -1,6 +1,67 @@
 ﻿#include "gapconstraints.h"
+#include <stdexcept>
+
+GapConstraints::GapConstraints() = default;
+
+GapConstraints::GapConstraints(const GapConstraints& other) :
+    MyBase(other)
+{
+}
+
+GapConstraints::GapConstraints(GapConstraints&& other) noexcept :
+    MyBase(std::move(other))
+{
+    other._table.reset();
+}
+
+GapConstraints& GapConstraints::operator=(const GapConstraints& other)
+{
+    if (this != &other) {
+        MyBase::operator=(other);
+        _table.reset();
+    }
+    return *this;
+}
+
+GapConstraints& GapConstraints::operator=(GapConstraints&& other) noexcept
+{
+    if (this != &other) {
+        MyBase::operator=(std::move(other));
+        _table.reset();
+        other._table.reset();
+    }
+    return *this;
+}
+
+GapConstraints::~GapConstraints() noexcept = default;
+
+int& GapConstraints::operator[](const TrainGap::GapTypesV2& type)
+{
+    _table.reset();
+    return MyBase::operator[](type);
+}
+
+void GapConstraints::clear() noexcept
+{
+    _table.reset();
+    MyBase::clear();
+}
+
+void GapConstraints::compile()
+{
+    // 先清除旧表，保证新表由原始数据生成
+    _table.reset();
+    _table = std::make_unique<GapConstraintTable>(*this);
+}
 
 int GapConstraints::correlationRange() const
+{
+    if (_table)
+        return _table->correlationRange();
+    return correlationRangeMap();
+}
+
+int GapConstraints::correlationRangeMap() const
 {
     int res=GLOBAL_DEFAULT;
     for(const auto& t:*this){
@@ -23,6 +84,16 @@ QString GapConstraints::toString() const
 }
 
 bool GapConstraints::checkConflict(TrainGap::GapTypesV2 type, int secs) const
+{
+    if (_table && GapConstraintTable::indexable(type)) {
+        int t = _table->threshold(GapConstraintTable::indexOf(type));
+        if (t != GapConstraintTable::INVALID)
+            return secs < t;
+    }
+    return checkConflictMap(type, secs);
+}
+
+bool GapConstraints::checkConflictMap(TrainGap::GapTypesV2 type, int secs) const
 {
     auto posLeft = TrainGap::gapTypeToPosLeft(type);
     auto posRight = TrainGap::gapTypeToPosRight(type);
@@ -54,6 +125,16 @@ bool GapConstraints::checkConflict(TrainGap::GapTypesV2 type, int secs) const
 }
 
 int GapConstraints::maxConstraint(TrainGap::GapTypesV2 type) const
+{
+    if (_table && GapConstraintTable::indexable(type)) {
+        int t = _table->threshold(GapConstraintTable::indexOf(type));
+        if (t != GapConstraintTable::INVALID)
+            return t;
+    }
+    return maxConstraintMap(type);
+}
+
+int GapConstraints::maxConstraintMap(TrainGap::GapTypesV2 type) const
 {
     auto posLeft = TrainGap::gapTypeToPosLeft(type);
     auto posRight = TrainGap::gapTypeToPosRight(type);
@@ -83,3 +164,21 @@ int GapConstraints::maxConstraint(TrainGap::GapTypesV2 type) const
         return at(type);
     }
 }
+
+GapConstraintTable::GapConstraintTable()
+{
+    _thresholds.fill(0);
+}
+
+GapConstraintTable::GapConstraintTable(const GapConstraints& constraints) :
+    _source(&constraints), _range(constraints.correlationRangeMap())
+{
+    for (int i = 0; i < SIZE; i++) {
+        try {
+            _thresholds[i] = constraints.maxConstraintMap(typeOf(i));
+        }
+        catch (const std::out_of_range&) {
+            _thresholds[i] = INVALID;
+        }
+    }
+}
@@ -1,5 +1,10 @@
 ﻿#pragma once
+#include <array>
+#include <memory>
 #include "data/diagram/traingap.h"
+
+class GapConstraintTable;
+
 /**
  * @brief The GapConstraints class
  * 对列车间隔约束的描述，规定每一种间隔类型的最小值。
@@ -21,6 +26,20 @@ public:
 
     using std::map<TrainGap::GapTypesV2,int>::map;
 
+    GapConstraints();
+    GapConstraints(const GapConstraints& other);
+    GapConstraints(GapConstraints&& other)noexcept;
+    GapConstraints& operator=(const GapConstraints& other);
+    GapConstraints& operator=(GapConstraints&& other)noexcept;
+    ~GapConstraints()noexcept;
+
+    /**
+     * 以下修改操作会使已编译的查找表失效（见compile()）。
+     * 其他的修改接口（insert, erase等）不做处理，使用后须重新compile()。
+     */
+    int& operator[](const TrainGap::GapTypesV2& type);
+    void clear()noexcept;
+
     /**
      * @brief correlationRange
      * @return 最大作用范围/关联长度。即所有的约束里面，最长的那个。
@@ -46,9 +65,94 @@ public:
      * 2023.06.16  类似于 at()，但是提前正则化处理。
      */
     int maxConstraint(TrainGap::GapTypesV2 type)const;
+
+    /**
+     * 按当前约束条件生成稠密查找表（GapConstraintTable）并缓存。
+     * 此后checkConflict(), maxConstraint(), correlationRange()直接查表。
+     * 复制、移动不携带查找表；修改约束后须重新调用。
+     * 非线程安全：应在并行读取之前调用（例如每次推线开始时）。
+     */
+    void compile();
+
+    /**
+     * 已编译的查找表；未编译或已失效时为空
+     */
+    const GapConstraintTable* compiled()const { return _table.get(); }
+
 private:
+    std::unique_ptr<GapConstraintTable> _table;
+
+    bool checkConflictMap(TrainGap::GapTypesV2 type, int secs)const;
+    int maxConstraintMap(TrainGap::GapTypesV2 type)const;
+    int correlationRangeMap()const;
+
     // 2023.06.16:  API V2.
     // calling at() directly is NOT SAFE; use the wrapped APIs instead.
     using MyBase::at;
 };
 
+
+/**
+ * @brief The GapConstraintTable class
+ * GapConstraints的稠密查找表，用于推线内层循环。
+ * 以间隔类型的位模式（见indexOf()）为下标，直接给出该类型的最小间隔，
+ * 即 checkConflict(type, secs) 等价于 secs < threshold(indexOf(type))。
+ * 原约束条件中没有定义的类型（原实现中at()会抛出异常）标记为无效，查表时转交原约束条件处理。
+ * 一次生成（例如每次推线开始时），之后原约束条件的修改不会反映到本表；
+ * 同时持有原约束条件的指针，须保证其生存期。
+ */
+class GapConstraintTable
+{
+    friend class GapConstraints;
+public:
+    static constexpr int SIZE = 256;
+    static constexpr int INVALID = -1;
+
+private:
+    const GapConstraints* _source = nullptr;
+    std::array<int, SIZE> _thresholds;
+    int _range = GapConstraints::GLOBAL_DEFAULT;
+
+public:
+    GapConstraintTable();
+    explicit GapConstraintTable(const GapConstraints& constraints);
+
+    /**
+     * 规范化下标：低4位为附加、行别标志，高4位为左右事件的位置标志（即GapTypesV2的第2字节低4位）。
+     * Avoid等其他位不计入。
+     */
+    static int indexOf(TrainGap::GapTypesV2 type) {
+        const int v = type;
+        return (v & 0x0F) | ((v >> 4) & 0xF0);
+    }
+
+    static TrainGap::GapTypesV2 typeOf(int index) {
+        return TrainGap::GapTypesV2((index & 0x0F) | ((index & 0xF0) << 4));
+    }
+
+    /**
+     * 最小间隔；无效时为INVALID
+     */
+    int threshold(int index)const { return _thresholds[index]; }
+    const int* thresholds()const { return _thresholds.data(); }
+
+    /**
+     * 与GapConstraints::checkConflict()相同
+     */
+    bool checkConflict(int index, int secs)const {
+        int t = _thresholds[index];
+        return t != INVALID ? secs < t : _source->checkConflictMap(typeOf(index), secs);
+    }
+
+    /**
+     * type的位模式是否可由下标完整表示（不含Avoid等未计入的位）
+     */
+    static bool indexable(TrainGap::GapTypesV2 type) {
+        return typeOf(indexOf(type)) == type;
+    }
+
+    /**
+     * 与GapConstraints::correlationRange()相同
+     */
+    int correlationRange()const { return _range; }
+};
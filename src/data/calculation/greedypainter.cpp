@@ -7,6 +7,14 @@
 #include <data/rail/forbid.h>
 #include <data/train/trainfilterselectorcore.h>
 #include <exception>
+#include <algorithm>
+#include <numeric>
+#include <QElapsedTimer>
+#include <atomic>
+#include "util/qeparallel.h"
+#include <unordered_set>
+#include <data/diagram/trainadapter.h>
+#include <data/diagram/raileventpool.h>
 
 
 class BackoffExeed : public std::exception
@@ -23,7 +31,185 @@ GreedyPainter::GreedyPainter(Diagram& diagram, const TrainFilterSelectorCore& co
 
 bool GreedyPainter::paint(const TrainName& trainName)
 {
-	_railAxis = diagram.stationEventAxisForRail(_railway, *filter.filter());
+	updateRailAxis();
+	return paintOnAxis(trainName);
+}
+
+std::vector<GreedyPaintResult> GreedyPainter::paintBatch(const std::vector<GreedyPaintRequest>& requests)
+{
+	std::vector<GreedyPaintResult> results(requests.size());
+	std::vector<int> order(requests.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&requests](int a, int b) {
+		return requests.at(a).priority > requests.at(b).priority;
+		});
+
+	updateRailAxis();
+
+	const auto& stations = _railway->stations();
+	std::vector<StationEventAxis*> axes(stations.size(), nullptr);
+	std::unordered_map<const RailStation*, int> rail_index;
+	for (int i = 0; i < stations.size(); i++) {
+		rail_index.emplace(stations.at(i).get(), i);
+		if (auto itr = _railAxis.find(stations.at(i)); itr != _railAxis.end())
+			axes[i] = &itr->second;
+	}
+
+	// 已铺画车次的运行线数据。事件中的TrainLine引用Adapter，须保持其存活至移除事件之后
+	std::vector<std::shared_ptr<TrainAdapter>> painted;
+	std::unordered_set<const TrainLine*> painted_lines;
+	std::vector<RailStationEventList> buckets(stations.size());
+	if (!_railAxis.pool())
+		_railAxis.setPool(RailEventPool::create());
+	const auto& pool = _railAxis.pool();
+
+	for (int idx : order) {
+		const auto& req = requests.at(idx);
+		auto& res = results.at(idx);
+		_anchor = req.anchor;
+		_start = req.start;
+		_end = req.end;
+		_anchorTime = req.anchorTime;
+		_ruler = req.ruler;
+		_settledStops = req.settledStops;
+		_dir = req.dir;
+		_localStarting = req.localStarting;
+		_localTerminal = req.localTerminal;
+		_anchorAsArrive = req.anchorAsArrive;
+
+		QElapsedTimer timer;
+		timer.start();
+		res.success = paintOnAxis(req.trainName);
+		res.elapsedMs = timer.elapsed();
+		res.backoffCount = backoffCount;
+		res.train = _train;
+
+		if (res.success) {
+			auto adp = std::make_shared<TrainAdapter>(_train, _railway, diagram.config());
+			for (const auto& line : adp->lines()) {
+				line->collectStationEvents(stations, rail_index, buckets, pool);
+				painted_lines.insert(line.get());
+			}
+			for (int i = 0; i < stations.size(); i++) {
+				if (axes[i]) {
+					for (const auto& ev : buckets[i])
+						axes[i]->insertEvent(ev);
+				}
+				buckets[i].clear();
+			}
+			painted.emplace_back(std::move(adp));
+		}
+	}
+
+	// 恢复事件表与运行图一致
+	if (!painted_lines.empty()) {
+		for (auto* ax : axes) {
+			if (ax) ax->removeLineEvents(painted_lines);
+		}
+	}
+	return results;
+}
+
+bool GreedyPainter::paintOnAxis(const TrainName& trainName)
+{
+	_constraints.compile();
+	if (_speculativeCandidates > 1 && !_sharedAxis)
+		return paintSpeculative(trainName);
+	else
+		return paintFromAnchor(trainName);
+}
+
+GreedyPainter::GreedyPainter(const GreedyPainter& other, const RailwayStationEventAxis& axis) :
+	diagram(other.diagram), filter(other.filter)
+{
+	_railway = other._railway;
+	_ruler = other._ruler;
+	_anchor = other._anchor;
+	_start = other._start;
+	_end = other._end;
+	_localStarting = other._localStarting;
+	_localTerminal = other._localTerminal;
+	_anchorAsArrive = other._anchorAsArrive;
+	_dir = other._dir;
+	_anchorTime = other._anchorTime;
+	_settledStops = other._settledStops;
+	_fixedStations = other._fixedStations;
+	_constraints = other._constraints;
+	_constraints.compile();
+	_usedForbids = other._usedForbids;
+	_maxBackoffTimes = other._maxBackoffTimes;
+	_sharedAxis = &axis;
+}
+
+bool GreedyPainter::paintSpeculative(const TrainName& trainName)
+{
+	const int n = _speculativeCandidates;
+	std::vector<std::unique_ptr<GreedyPainter>> painters;
+	painters.reserve(n);
+	for (int k = 0; k < n; k++) {
+		std::unique_ptr<GreedyPainter> p(new GreedyPainter(*this, _railAxis));
+		p->_anchorTime = _anchorTime.addSecs(k * _speculativeStepSecs);
+		painters.emplace_back(std::move(p));
+	}
+
+	std::vector<char> success(n, 0);
+	// FirstFeasible: 已有更早的候选成功时，不再开始后面的候选
+	std::atomic_int first_ok{ n };
+	qeutil::parallelFor(n, [&](int k) {
+		if (_speculativePolicy == SpeculativePolicy::FirstFeasible && first_ok.load() < k)
+			return;
+		success[k] = painters[k]->paintFromAnchor(trainName);
+		if (success[k]) {
+			int cur = first_ok.load();
+			while (k < cur && !first_ok.compare_exchange_weak(cur, k)) {}
+		}
+		});
+
+	auto stop_secs = [](const Train& train) {
+		int secs = 0;
+		for (const auto& st : train.timetable()) {
+			secs += qeutil::secsTo(st.arrive, st.depart);
+		}
+		return secs;
+	};
+
+	int win = -1;
+	if (_speculativePolicy == SpeculativePolicy::FirstFeasible) {
+		if (first_ok.load() < n)
+			win = first_ok.load();
+	}
+	else {
+		int best = 0;
+		for (int k = 0; k < n; k++) {
+			if (!success[k]) continue;
+			int secs = stop_secs(*painters[k]->_train);
+			if (win < 0 || secs < best) {
+				win = k;
+				best = secs;
+			}
+		}
+	}
+
+	// 候选在工作线程上不输出调试信息，由此在调用线程上补上所采用的一个
+	auto& chosen = *painters[win < 0 ? 0 : win];
+	_train = std::move(chosen._train);
+	_logs = std::move(chosen._logs);
+	backoffCount = chosen.backoffCount;
+	for (const auto& log : _logs) {
+		qDebug() << log->toString() << Qt::endl;
+	}
+	if (win >= 0)
+		_anchorTime = chosen._anchorTime;
+	if (win > 0) {
+		addLog(std::make_unique<CalculationLogDescription>(
+			QObject::tr("[推测搜索] 共%1个候选锚点时刻，采用第%2个：%3").arg(n).arg(win + 1)
+			.arg(chosen._anchorTime.toString("hh:mm:ss"))));
+	}
+	return win >= 0;
+}
+
+bool GreedyPainter::paintFromAnchor(const TrainName& trainName)
+{
 	_train = std::make_shared<Train>(trainName);
 	_train->setOnPainting(true);
 	_logs.clear();
@@ -112,9 +298,161 @@ bool GreedyPainter::paint(const TrainName& trainName)
 	else return false;
 }
 
+void GreedyPainter::invalidateRailAxis()
+{
+	_axisRailway.reset();
+	_axisStations.clear();
+	_axisTrains.clear();
+	_railAxis.clear();
+	_railAxis.setPool(nullptr);
+}
+
+std::size_t GreedyPainter::axisFingerprint(const Train& train) const
+{
+	std::size_t seed = 0;
+	auto combine = [&seed](std::size_t v) {
+		seed ^= v + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+	};
+	for (const auto& adp : train.adapters()) {
+		if (adp->isInSameRailway(_railway))
+			combine(adp->serial());
+	}
+	for (const auto& st : train.timetable()) {
+		combine(st.arrive.msecsSinceStartOfDay());
+		combine(st.depart.msecsSinceStartOfDay());
+	}
+	combine(qHash(train.starting()));
+	combine(qHash(train.terminal()));
+	return seed;
+}
+
+void GreedyPainter::updateRailAxis()
+{
+	const auto* flt = filter.filter();
+	const auto& stations = _railway->stations();
+	auto has_lines = [this](const Train& t) {
+		return std::any_of(t.adapters().cbegin(), t.adapters().cend(), [this](const auto& adp) {
+			return adp->isInSameRailway(_railway) && !adp->isNull(); });
+	};
+	auto make_record = [this](const Train& t, std::size_t fp) {
+		AxisTrainRecord rec{ fp, {}, _axisRound };
+		for (const auto& adp : t.adapters()) {
+			if (adp->isInSameRailway(_railway)) {
+				for (const auto& line : adp->lines())
+					rec.lines.emplace_back(line);
+			}
+		}
+		return rec;
+	};
+
+	++_axisRound;
+	bool same_rail = _axisRailway.lock() == _railway &&
+		static_cast<std::size_t>(stations.size()) == _axisStations.size() &&
+		std::equal(_axisStations.begin(), _axisStations.end(), stations.begin(),
+			[](const RailStation* a, const std::shared_ptr<RailStation>& b) {return a == b.get(); });
+
+	// 增量删除的事件不归还内存池；已分配的事件数超过现有事件数的两倍时，整体重建以回收
+	bool compact = same_rail && _railAxis.pool() &&
+		static_cast<std::size_t>(_railAxis.pool()->stats().allocations) >
+		2 * std::max<std::size_t>(_railAxis.eventCount(), MIN_POOL_EVENTS);
+
+	if (!same_rail || compact) {
+		// 整体重建
+		_railAxis = diagram.stationEventAxisForRail(_railway, *flt);
+		_axisRailway = _railway;
+		_axisStations.clear();
+		for (const auto& st : stations)
+			_axisStations.push_back(st.get());
+		_axisTrains.clear();
+		foreach(const auto & t, diagram.trainCollection().trains()) {
+			if (flt->check(t) && has_lines(*t)) {
+				_axisTrains.emplace(t.get(), make_record(*t, axisFingerprint(*t)));
+			}
+		}
+		return;
+	}
+
+	// 增量更新：找出需要删除的旧运行线，以及需要重新插入的车次
+	std::unordered_set<const TrainLine*> stale;
+	std::vector<std::shared_ptr<Train>> changed;
+	auto drop_record = [&stale](const AxisTrainRecord& rec) {
+		for (const auto& line : rec.lines)
+			stale.insert(line.get());
+	};
+	foreach(const auto & t, diagram.trainCollection().trains()) {
+		bool included = flt->check(t) && has_lines(*t);
+		auto itr = _axisTrains.find(t.get());
+		if (!included) {
+			if (itr != _axisTrains.end()) {
+				drop_record(itr->second);
+				_axisTrains.erase(itr);
+			}
+			continue;
+		}
+		auto fp = axisFingerprint(*t);
+		if (itr != _axisTrains.end()) {
+			if (itr->second.fingerprint == fp) {
+				itr->second.round = _axisRound;
+				continue;
+			}
+			drop_record(itr->second);
+			_axisTrains.erase(itr);
+		}
+		_axisTrains.emplace(t.get(), make_record(*t, fp));
+		changed.push_back(t);
+	}
+	// 已经删除的车次
+	for (auto itr = _axisTrains.begin(); itr != _axisTrains.end();) {
+		if (itr->second.round != _axisRound) {
+			drop_record(itr->second);
+			itr = _axisTrains.erase(itr);
+		}
+		else ++itr;
+	}
+
+	if (stale.empty() && changed.empty())
+		return;
+
+	// 与车站表对应的事件轴指针；NoVia站没有事件轴
+	std::vector<StationEventAxis*> axes(stations.size(), nullptr);
+	std::unordered_map<const RailStation*, int> rail_index;
+	for (int i = 0; i < stations.size(); i++) {
+		rail_index.emplace(stations.at(i).get(), i);
+		if (auto itr = _railAxis.find(stations.at(i)); itr != _railAxis.end())
+			axes[i] = &itr->second;
+	}
+
+	if (!stale.empty()) {
+		for (auto* ax : axes) {
+			if (ax) ax->removeLineEvents(stale);
+		}
+	}
+
+	std::vector<RailStationEventList> buckets(stations.size());
+	if (!_railAxis.pool())
+		_railAxis.setPool(RailEventPool::create());
+	const auto& pool = _railAxis.pool();
+	for (const auto& t : changed) {
+		for (const auto& adp : t->adapters()) {
+			if (!adp->isInSameRailway(_railway)) continue;
+			for (const auto& line : adp->lines()) {
+				line->collectStationEvents(stations, rail_index, buckets, pool);
+			}
+		}
+		for (int i = 0; i < stations.size(); i++) {
+			if (axes[i]) {
+				for (const auto& ev : buckets[i])
+					axes[i]->insertEvent(ev);
+			}
+			buckets[i].clear();
+		}
+	}
+}
+
 void GreedyPainter::addLog(std::unique_ptr<CalculationLogAbstract> log)
 {
-	qDebug() << log->toString() << Qt::endl;
+	if (!_sharedAxis)
+		qDebug() << log->toString() << Qt::endl;
 	//if (log->toString() == "[史家乡->内江区间运行冲突 右冲突] 将[史家乡]站[出发]时刻设置为[20:39:20] (对象: K9406)") {
 	//	qDebug() << "史家乡!";
 	//}
@@ -174,8 +512,8 @@ typename GreedyPainter::RecurseReport
 
 	auto st_from = node->railInterval().fromStation();
 	auto st_to = node->railInterval().toStation();
-	const auto& ax_from = _railAxis.at(st_from);
-	const auto& ax_to = _railAxis.at(st_to);
+	const auto& ax_from = railAxis().at(st_from);
+	const auto& ax_to = railAxis().at(st_to);
 
 	auto itr = _settledStops.find(st_to);
 	bool next_stop = ((itr != _settledStops.end()) || (st_to == _end && _localTerminal));
@@ -208,7 +546,8 @@ typename GreedyPainter::RecurseReport
 	bool to_try_stop = false;
 
 	while (true) {
-		qDebug() << railint->toString() << "  delay: " << tot_delay << ", " << tot_delay / 3600. << Qt::endl;
+		if (!_sharedAxis)
+			qDebug() << railint->toString() << "  delay: " << tot_delay << ", " << tot_delay / 3600. << Qt::endl;
 		if (tot_delay >= 24 * 3600) {
 			// 没有可排的线位
 			if (st_from != _anchor)
@@ -224,13 +563,14 @@ typename GreedyPainter::RecurseReport
 		}
 
 		// 出发时刻检测
-		auto ev_conf = ax_from.conflictEvent(ev_start, _constraints, railint->isSingleRail());
+		auto ev_conf = ax_from.conflictEvent(ev_start, constraintTable(), railint->isSingleRail());
 		if (ev_conf) {
 			// 出发时刻冲突
 			// 2023.10.17: 对于起始站停车时间被固定的，也只能回溯; 2024.02.09: 改到下面的分支里面。
 			if (!stop && st_from != _anchor) {
 				_train->timetable().pop_back();
-				qDebug() << "回溯 " << st_from->name.toSingleLiteral() << Qt::endl;
+				if (!_sharedAxis)
+					qDebug() << "回溯 " << st_from->name.toSingleLiteral() << Qt::endl;
 				return { RecurseStatus::RequireStop };
 			}
 			else {
@@ -254,7 +594,8 @@ typename GreedyPainter::RecurseReport
 				else {
 					// 左冲突事件，将时刻弄到与当前不冲突的地方
 					auto type = TrainGap::gapTypeBetween(*ev_conf, ev_start, railint->isSingleRail());
-					qDebug() << "左冲突：" << ev_conf->toString() << Qt::endl;
+					if (!_sharedAxis)
+						qDebug() << "左冲突：" << ev_conf->toString() << Qt::endl;
 					int gap_min = _constraints.maxConstraint(*type);
 					auto trial_tm = ev_conf->time.addSecs(gap_min);
 
@@ -325,7 +666,7 @@ typename GreedyPainter::RecurseReport
 
 		// 区间运行冲突
 
-		auto rep = _railAxis.intervalConflicted(st_from, st_to, _dir, ev_start.time, 
+		auto rep = railAxis().intervalConflicted(st_from, st_to, _dir, ev_start.time, 
 			int_secs, railint->isSingleRail(), false);
 		if (rep.type != IntervalConflictReport::NoConflict) {
 			// 存在冲突
@@ -383,7 +724,7 @@ typename GreedyPainter::RecurseReport
 
 		tm_to = ev_start.time.addSecs(int_secs);
 		RailStationEventBase ev_stop(TrainEventType::SettledPass, tm_to, qeutil::dirFormerPos(_dir), _dir);
-		auto to_conf = ax_to.conflictEvent(ev_stop, _constraints, railint->isSingleRail());
+		auto to_conf = ax_to.conflictEvent(ev_stop, constraintTable(), railint->isSingleRail());
 		if (!to_try_stop && !next_stop && !to_conf) {
 			addLog(std::make_unique<CalculationLogBasic>(
 				CalculationLogAbstract::Predicted, st_to, tm_to,
@@ -407,7 +748,7 @@ typename GreedyPainter::RecurseReport
 		tm_to = ev_start.time.addSecs(int_secs);
 		ev_stop.time = tm_to;
 		ev_stop.type = TrainEventType::Arrive;
-		to_conf = ax_to.conflictEvent(ev_stop, _constraints, railint->isSingleRail());
+		to_conf = ax_to.conflictEvent(ev_stop, constraintTable(), railint->isSingleRail());
 
 		// 只要尝试过一次原时刻停车了，不论结果如何，下一轮都优先考虑通过
 		to_try_stop = false;
@@ -530,8 +871,8 @@ typename GreedyPainter::RecurseReport
 
 	auto st_from = node->railInterval().toStation();
 	auto st_to = node->railInterval().fromStation();
-	const auto& ax_from = _railAxis.at(st_from);
-	const auto& ax_to = _railAxis.at(st_to);
+	const auto& ax_from = railAxis().at(st_from);
+	const auto& ax_to = railAxis().at(st_to);
 	auto fixed_from = (_fixedStations.find(st_from.get()) != _fixedStations.end());
 	auto fixed_to = (_fixedStations.find(st_from.get()) != _fixedStations.end());
 
@@ -565,7 +906,8 @@ typename GreedyPainter::RecurseReport
 	bool to_try_stop = false;
 
 	while (true) {
-		qDebug() << railint->toString() << "  delay: " << tot_delay << ", " << tot_delay / 3600. << Qt::endl;
+		if (!_sharedAxis)
+			qDebug() << railint->toString() << "  delay: " << tot_delay << ", " << tot_delay / 3600. << Qt::endl;
 		if (tot_delay >= 24 * 3600) {
 			// 没有可排的线位
 			if (st_from != _anchor)
@@ -581,14 +923,15 @@ typename GreedyPainter::RecurseReport
 		}
 
 		// 到达时刻（反向出发）检测
-		auto ev_conf = ax_from.conflictEvent(ev_arrive, _constraints, railint->isSingleRail());
+		auto ev_conf = ax_from.conflictEvent(ev_arrive, constraintTable(), railint->isSingleRail());
 		if (ev_conf) {
 			// 反向出发时刻冲突
 			// 注意：anchor站也回溯
 			if (!stop) {
 				if (st_from!=_anchor)
 					_train->timetable().pop_front();
-				qDebug() << "回溯 " << st_from->name.toSingleLiteral() << Qt::endl;
+				if (!_sharedAxis)
+					qDebug() << "回溯 " << st_from->name.toSingleLiteral() << Qt::endl;
 				return { RecurseStatus::RequireStop };
 			}
 			else {
@@ -684,7 +1027,7 @@ typename GreedyPainter::RecurseReport
 
 		// 区间运行冲突  注意区间的判定按照正向运行的逻辑传参
 
-		auto rep = _railAxis.intervalConflicted(st_to, st_from, _dir, tm_dep, int_secs, 
+		auto rep = railAxis().intervalConflicted(st_to, st_from, _dir, tm_dep, int_secs, 
 			railint->isSingleRail(), true);
 		if (rep.type != IntervalConflictReport::NoConflict) {
 			// 存在冲突
@@ -744,7 +1087,7 @@ typename GreedyPainter::RecurseReport
 
 		tm_dep = ev_arrive.time.addSecs(-int_secs);
 		RailStationEventBase ev_depart(TrainEventType::SettledPass, tm_dep, qeutil::dirLatterPos(_dir), _dir);
-		auto to_conf = ax_to.conflictEvent(ev_depart, _constraints, railint->isSingleRail());
+		auto to_conf = ax_to.conflictEvent(ev_depart, constraintTable(), railint->isSingleRail());
 		if (!to_try_stop && !next_stop && !to_conf) {
 			addLog(std::make_unique<CalculationLogBasic>(
 				CalculationLogAbstract::Predicted, st_to, tm_dep,
@@ -768,7 +1111,7 @@ typename GreedyPainter::RecurseReport
 		tm_dep = ev_arrive.time.addSecs(-int_secs);
 		ev_depart.time = tm_dep;
 		ev_depart.type = TrainEventType::Depart;
-		to_conf = ax_to.conflictEvent(ev_depart, _constraints, railint->isSingleRail());
+		to_conf = ax_to.conflictEvent(ev_depart, constraintTable(), railint->isSingleRail());
 
 		// 只要尝试过一次原时刻停车了，不论结果如何，下一轮都优先考虑通过
 		to_try_stop = false;
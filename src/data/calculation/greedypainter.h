@@ -1,21 +1,51 @@
 ﻿#pragma once
 #include <memory>
+#include <algorithm>
+#include <vector>
+#include <unordered_map>
 #include "gapconstraints.h"
 #include "railwaystationeventaxis.h"
 #include "calculationlog.h"
+#include "data/train/trainname.h"
 
 namespace _greedypaint_detail {
 	class _RecurseLogger;
 }
 
 class Diagram;
-class TrainName;
 class Railway;
 class Ruler;
 class RulerNode;
 class Forbid;
 class TrainFilterSelectorCore;
 
+/**
+ * 批量铺画（GreedyPainter::paintBatch）的单个请求。
+ * 间隔约束、天窗、固定站、最大回退次数、推测搜索等沿用GreedyPainter的当前设置。
+ * priority大的先铺画；相同的保持给出顺序。
+ */
+struct GreedyPaintRequest {
+	TrainName trainName;
+	std::shared_ptr<const RailStation> anchor, start, end;
+	QTime anchorTime;
+	std::shared_ptr<Ruler> ruler;
+	std::map<std::shared_ptr<const RailStation>, int> settledStops;
+	Direction dir = Direction::Down;
+	bool localStarting = true, localTerminal = true, anchorAsArrive = false;
+	int priority = 0;
+};
+
+/**
+ * 批量铺画中单个请求的结果。
+ * train为铺画所得列车（失败时为不完整的时刻表），尚未加入运行图。
+ */
+struct GreedyPaintResult {
+	bool success = false;
+	int backoffCount = 0;
+	qint64 elapsedMs = 0;
+	std::shared_ptr<Train> train;
+};
+
 /**
  * @brief The GreedyPainter class
  * 贪心算法全自动铺画运行线。
@@ -42,15 +72,62 @@ class GreedyPainter
 	 * 这是铺画数据的目标；这里新建。
 	 */
 	std::shared_ptr<Train> _train;
+	/**
+	 * 每次铺画开始时compile()，内层循环经由其稠密查找表查询
+	 */
 	GapConstraints _constraints;
 	RailwayStationEventAxis _railAxis;
 
+	/**
+	 * _railAxis的增量维护。
+	 * 记录构建_railAxis时各车次的状态指纹（运行线版本、时刻、始发终到）以及所含运行线；
+	 * 再次铺画时，仅对有变化（含筛选结果变化、增删）的车次删除旧事件、插入新事件。
+	 * 线路或其车站表变化时整体重建。
+	 * 仅记录通过筛选且在本线有运行线的车次。
+	 * 增量插入的事件与整体重建时的事件共用_railAxis的内存池；
+	 * 池中已删除事件累积过多时（见MIN_POOL_EVENTS），也整体重建。
+	 */
+	struct AxisTrainRecord {
+		std::size_t fingerprint;
+		std::vector<std::shared_ptr<const TrainLine>> lines;
+		int round;
+	};
+	std::weak_ptr<const Railway> _axisRailway;
+	std::vector<const RailStation*> _axisStations;
+	std::unordered_map<const Train*, AxisTrainRecord> _axisTrains;
+	int _axisRound = 0;
+
+	/**
+	 * 判断内存池是否需要整体重建时，现有事件数按不少于此值计
+	 */
+	static constexpr std::size_t MIN_POOL_EVENTS = 4096;
+
 	std::vector<std::unique_ptr<CalculationLogAbstract>> _logs;
 	std::vector<std::shared_ptr<Forbid>> _usedForbids;
 
 	int _maxBackoffTimes;
 	int backoffCount = 0;
 
+	/**
+	 * 并行推测搜索的设置，见setSpeculative()
+	 */
+	int _speculativeCandidates = 1;
+	int _speculativeStepSecs = 60;
+
+public:
+	enum class SpeculativePolicy {
+		FirstFeasible,   // 可行解中锚点时刻最早（偏移最小）者
+		LeastStopTime,   // 可行解中总停站时间最少者
+	};
+
+private:
+	SpeculativePolicy _speculativePolicy = SpeculativePolicy::FirstFeasible;
+
+	/**
+	 * 推测搜索中的候选对象使用外部（只读共享）的事件表；否则为空，使用_railAxis
+	 */
+	const RailwayStationEventAxis* _sharedAxis = nullptr;
+
 public:
 	GreedyPainter(Diagram& diagram, const TrainFilterSelectorCore& filter);
 	auto railway() { return _railway; }
@@ -71,8 +148,24 @@ public:
 	void setLocalTerminal(bool on) { _localTerminal = on; }
 	void setDir(Direction d) { _dir = d; }
 	void setAnchorTime(const QTime& t) { _anchorTime = t; }
+	const QTime& anchorTime()const { return _anchorTime; }
 	void setMaxBackoffTimes(int t) { _maxBackoffTimes = t; }
 	void setAnchorAsArrive(bool on) { _anchorAsArrive = on; }
+
+	/**
+	 * 并行推测搜索模式。
+	 * candidates>1时，以锚点时刻anchorTime + k*stepSecs (k=0..candidates-1)为候选，
+	 * 并行地各自独立铺画（包括各自的回退过程），共享只读的事件表；按policy从可行解中选取结果。
+	 * 均不可行时，保留原锚点时刻（k=0）的最后尝试状态，与普通模式一致。
+	 * 有可行解时，anchorTime()更新为所采用的候选锚点时刻。
+	 * candidates=1即普通的顺序模式。
+	 */
+	void setSpeculative(int candidates, int stepSecs, SpeculativePolicy policy) {
+		_speculativeCandidates = std::max(candidates, 1);
+		_speculativeStepSecs = stepSecs;
+		_speculativePolicy = policy;
+	}
+	int speculativeCandidates()const { return _speculativeCandidates; }
 	auto& constraints() { return _constraints; }
 	const auto& constraints()const { return _constraints; }
 	auto& settledStops() { return _settledStops; }
@@ -92,9 +185,61 @@ public:
 	 */
 	bool paint(const TrainName& trainName);
 
+	/**
+	 * 丢弃缓存的事件表，下次铺画时重新构建。
+	 */
+	void invalidateRailAxis();
+
+	/**
+	 * 批量铺画，不涉及界面。
+	 * 按优先级依次铺画各请求；每铺画成功一列，即将其事件插入事件表，后续请求需避让之。
+	 * 返回结果与requests一一对应（按原顺序）。
+	 * 注意：会覆盖本对象的线路外其他铺画设置（锚点、标尺、方向等），结束后train()为最后铺画的车次。
+	 * 铺画所得车次的事件仅在本次调用中有效，返回前从事件表中移除；由调用者决定是否加入运行图。
+	 */
+	std::vector<GreedyPaintResult> paintBatch(const std::vector<GreedyPaintRequest>& requests);
+
 private:
 	void addLog(std::unique_ptr<CalculationLogAbstract> log);
 
+	/**
+	 * 将_railAxis与当前运行图同步：必要时整体重建，否则按车次增量更新。
+	 */
+	void updateRailAxis();
+
+	/**
+	 * 推测搜索的候选对象：复制other的全部铺画设置，使用只读的axis作为事件表
+	 */
+	GreedyPainter(const GreedyPainter& other, const RailwayStationEventAxis& axis);
+
+	const RailwayStationEventAxis& railAxis()const { return _sharedAxis ? *_sharedAxis : _railAxis; }
+
+	/**
+	 * _constraints的查找表；仅在paintOnAxis()流程内有效
+	 */
+	const GapConstraintTable& constraintTable()const { return *_constraints.compiled(); }
+
+	/**
+	 * paint()的核心部分：在当前_railAxis上铺画，不同步事件表。
+	 * 根据设置转发到paintFromAnchor()或paintSpeculative()
+	 */
+	bool paintOnAxis(const TrainName& trainName);
+
+	/**
+	 * 以当前锚点时刻铺画
+	 */
+	bool paintFromAnchor(const TrainName& trainName);
+
+	/**
+	 * 并行推测搜索，见setSpeculative()
+	 */
+	bool paintSpeculative(const TrainName& trainName);
+
+	/**
+	 * 车次在当前线路上与事件表相关的状态指纹
+	 */
+	std::size_t axisFingerprint(const Train& train)const;
+
 	// 2024.02.09: internal report enum and class, for hint 
 	enum class RecurseStatus {
 		Ok = 0,
@@ -2,6 +2,15 @@
 #include <util/utilfunc.h>
 #include <QDebug>
 
+std::size_t RailwayStationEventAxis::eventCount() const
+{
+    std::size_t res = 0;
+    for (const auto& p : *this) {
+        res += static_cast<std::size_t>(p.second.size());
+    }
+    return res;
+}
+
 IntervalConflictReport RailwayStationEventAxis::intervalConflicted(std::shared_ptr<RailStation> from, 
     std::shared_ptr<RailStation> to, Direction dir, const QTime& tm_start, 
     int secs, bool singleLine, bool backward) const
@@ -4,6 +4,8 @@
 #include "intervalconflictreport.h"
 #include "intervalconflictreport.h"
 
+class RailEventPool;
+
 /**
  * 指定线路所有车站的事件顺序表。
  * 目前主要是StationEventAxis的集合，但需要支持站间查找的功能。
@@ -12,9 +14,23 @@ class RailwayStationEventAxis :
     public std::map<std::shared_ptr<RailStation>, StationEventAxis>
 {
     using Base = std::map<std::shared_ptr<RailStation>, StationEventAxis>;
+
+    /**
+     * 本事件表的事件所用的内存池（见RailEventPool），增量插入的事件也从中分配。
+     * 已删除事件的内存不归还，由持有者按pool()->stats()判断是否整体重建。
+     */
+    std::shared_ptr<RailEventPool> _pool;
 public:
     using Base::map;
 
+    const std::shared_ptr<RailEventPool>& pool()const { return _pool; }
+    void setPool(std::shared_ptr<RailEventPool> pool) { _pool = std::move(pool); }
+
+    /**
+     * 全部车站的事件数
+     */
+    std::size_t eventCount()const;
+
     /**
      * 搜索区间冲突情况时，在出发时刻左右多大范围内查找可能冲突的运行线
      * 单位为区间运行标尺的倍数
@@ -42,12 +42,60 @@ void StationEventAxis::buildAxis()
 {
 	sortEvents();
 	constructLineMap();
+	rebuildPacked();
+}
+
+void StationEventAxis::rebuildPacked()
+{
+	_secs.resize(size());
+	_attrs.resize(size());
+	for (int i = 0; i < size(); i++) {
+		const auto& ev = at(i);
+		_secs[i] = ev->time.msecsSinceStartOfDay() / 1000;
+		_attrs[i] = packAttrs(*ev);
+	}
+}
+
+quint8 StationEventAxis::packAttrs(const RailStationEventBase& ev)
+{
+	quint8 res = static_cast<quint8>(ev.pos) & AttrPosMask;
+	if (ev.hasAppend())
+		res |= AttrAppend;
+	res |= static_cast<quint8>(ev.dir) << AttrDirShift;
+	return res;
+}
+
+bool StationEventAxis::packedGapType(quint8 left, quint8 right, bool singleLine,
+	TrainGap::GapTypesV2& type)
+{
+	quint8 left_dir = left >> AttrDirShift, right_dir = right >> AttrDirShift;
+	if (!singleLine && left_dir != right_dir) {
+		// 双线反向两车次不构成间隔
+		return false;
+	}
+	type = TrainGap::NoAppend;
+	if (left & AttrAppend)
+		type |= TrainGap::LeftAppend;
+	if (right & AttrAppend)
+		type |= TrainGap::RightAppend;
+	if (left_dir == static_cast<quint8>(Direction::Down))
+		type |= TrainGap::LeftDown;
+	if (right_dir == static_cast<quint8>(Direction::Down))
+		type |= TrainGap::RightDown;
+	type |= TrainGap::posToGapPosLeft(RailStationEventBase::Positions(left & AttrPosMask));
+	type |= TrainGap::posToGapPosRight(RailStationEventBase::Positions(right & AttrPosMask));
+	return true;
 }
 
 void StationEventAxis::insertEvent(std::shared_ptr<RailStationEvent> ev)
 {
 	//如果有时刻一样的，新的在后面
 	auto itr = std::upper_bound(begin(), end(), ev, RailStationEvent::PtrTimeComparator());
+	if (packedValid()) {
+		auto idx = itr - begin();
+		_secs.insert(_secs.begin() + idx, ev->time.msecsSinceStartOfDay() / 1000);
+		_attrs.insert(_attrs.begin() + idx, packAttrs(*ev));
+	}
 	insert(itr, ev);
 	if (ev->pos & RailStationEventBase::Pre) {
 		_preEvents.emplace(ev->line, ev);
@@ -57,10 +105,33 @@ void StationEventAxis::insertEvent(std::shared_ptr<RailStationEvent> ev)
 	}
 }
 
+void StationEventAxis::removeLineEvents(const std::unordered_set<const TrainLine*>& lines)
+{
+	auto pred = [&lines](const std::shared_ptr<RailStationEvent>& ev) {
+		return lines.count(ev->line.get()) > 0;
+	};
+	auto itr = std::remove_if(begin(), end(), pred);
+	if (itr == end())
+		return;
+	erase(itr, end());
+	rebuildPacked();
+	for (auto* mp : { &_preEvents, &_postEvents }) {
+		for (auto p = mp->begin(); p != mp->end();) {
+			if (lines.count(p->first.get()))
+				p = mp->erase(p);
+			else ++p;
+		}
+	}
+}
+
 std::shared_ptr<RailStationEvent> StationEventAxis::conflictEvent(
 	const RailStationEventBase& ev,
 	const GapConstraints& constraint, bool singleLine) const
 {
+	if (auto* table = constraint.compiled())
+		return conflictEvent(ev, *table, singleLine);
+	if (packedValid())
+		return conflictEventPacked(ev, constraint, singleLine);
 	int bound = constraint.correlationRange();
 	QTime leftBound = ev.time.addSecs(-bound), rightBound = ev.time.addSecs(bound);
 	// upper_bound 正好与reverse_iterator配合使用
@@ -132,3 +203,168 @@ bool StationEventAxis::isConflict(const RailStationEventBase& left,
 	}
 	return false;
 }
+
+std::shared_ptr<RailStationEvent> StationEventAxis::conflictEventPacked(
+	const RailStationEventBase& ev, const GapConstraints& constraint, bool singleLine) const
+{
+	constexpr int day_secs = 24 * 3600;
+	const int bound = constraint.correlationRange();
+	const int tm = ev.time.msecsSinceStartOfDay() / 1000;
+	const quint8 attr = packAttrs(ev);
+	const int n = static_cast<int>(_secs.size());
+
+	// 与isConflict()一致：left在前，right在后
+	auto conflict_left = [&](int i) {
+		TrainGap::GapTypesV2 type;
+		if (!packedGapType(_attrs[i], attr, singleLine, type))
+			return false;
+		int secs = tm - _secs[i];
+		if (secs < 0) secs += day_secs;
+		return constraint.checkConflict(type, secs);
+	};
+	auto conflict_right = [&](int i) {
+		TrainGap::GapTypesV2 type;
+		if (!packedGapType(attr, _attrs[i], singleLine, type))
+			return false;
+		int secs = _secs[i] - tm;
+		if (secs < 0) secs += day_secs;
+		return constraint.checkConflict(type, secs);
+	};
+
+	const int citr = static_cast<int>(std::upper_bound(_secs.begin(), _secs.end(), tm) - _secs.begin());
+
+	// 左侧
+	int left_bound = tm - bound;
+	if (left_bound < 0) {
+		// 发生左跨日情况
+		left_bound += day_secs;
+		for (int i = citr - 1; i >= 0; i--) {
+			if (conflict_left(i))
+				return at(i);
+		}
+		for (int i = n - 1; i >= 0 && _secs[i] >= left_bound; i--) {
+			if (conflict_left(i))
+				return at(i);
+		}
+	}
+	else {
+		for (int i = citr - 1; i >= 0 && _secs[i] >= left_bound; i--) {
+			if (conflict_left(i))
+				return at(i);
+		}
+	}
+
+	// 右侧
+	int right_bound = tm + bound;
+	if (right_bound >= day_secs) {
+		// 右跨日
+		right_bound -= day_secs;
+		for (int i = citr; i < n; i++) {
+			if (conflict_right(i))
+				return at(i);
+		}
+		for (int i = 0; i < n && _secs[i] <= right_bound; i++) {
+			if (conflict_right(i))
+				return at(i);
+		}
+	}
+	else {
+		for (int i = citr; i < n && _secs[i] <= right_bound; i++) {
+			if (conflict_right(i))
+				return at(i);
+		}
+	}
+	return nullptr;
+}
+
+std::shared_ptr<RailStationEvent> StationEventAxis::conflictEvent(
+	const RailStationEventBase& ev, const GapConstraintTable& table, bool singleLine) const
+{
+	if (isEmpty())
+		return nullptr;
+	const int* secs = _secs.data();
+	const quint8* attrs = _attrs.data();
+	std::vector<int> tmp_secs;
+	std::vector<quint8> tmp_attrs;
+	if (!packedValid()) {
+		// 事件表被直接修改过，临时生成紧凑数据
+		for (const auto& p : *this) {
+			tmp_secs.push_back(p->time.msecsSinceStartOfDay() / 1000);
+			tmp_attrs.push_back(packAttrs(*p));
+		}
+		secs = tmp_secs.data();
+		attrs = tmp_attrs.data();
+	}
+	const int n = size();
+	const int tm = ev.time.msecsSinceStartOfDay() / 1000;
+	const quint8 attr = packAttrs(ev);
+	const int citr = static_cast<int>(std::upper_bound(secs, secs + n, tm) - secs);
+
+	// 先左后右
+	int i = scanConflict(secs, attrs, n, citr - 1, true, tm, attr, singleLine, table);
+	if (i < 0)
+		i = scanConflict(secs, attrs, n, citr, false, tm, attr, singleLine, table);
+	return i < 0 ? nullptr : at(i);
+}
+
+int StationEventAxis::scanConflict(const int* secs, const quint8* attrs, int n, int start,
+	bool leftSide, int tm, quint8 attr, bool singleLine, const GapConstraintTable& table)
+{
+	constexpr int day_secs = 24 * 3600;
+	constexpr int BLOCK = 8;
+	constexpr int down = static_cast<int>(Direction::Down);
+	const int bound = table.correlationRange();
+	const int* thr = table.thresholds();
+
+	int idx[BLOCK], delta[BLOCK], type[BLOCK];
+	bool related[BLOCK];
+
+	for (int done = 0; done < n; done += BLOCK) {
+		const int m = std::min(BLOCK, n - done);
+
+		// 环形下标：越过序列端点即为跨日
+		for (int k = 0; k < m; k++) {
+			int j = leftSide ? start - done - k : start + done + k;
+			j += (j < 0) * n;
+			j -= (j >= n) * n;
+			idx[k] = j;
+		}
+		// 时间差，考虑PBC。右侧自citr起，未跨日的事件时刻严格大于tm；
+		// 绕回的与tm同时刻的事件属于左侧，在右侧应视为跨日（与conflictEventPacked()一致）
+		const int wrap = leftSide ? 0 : 1;
+		for (int k = 0; k < m; k++) {
+			int d = leftSide ? tm - secs[idx[k]] : secs[idx[k]] - tm;
+			delta[k] = d + (d < wrap) * day_secs;
+		}
+		// 间隔类型下标，见GapConstraintTable::indexOf()
+		for (int k = 0; k < m; k++) {
+			int l = leftSide ? attrs[idx[k]] : attr;
+			int r = leftSide ? attr : attrs[idx[k]];
+			int ldir = l >> AttrDirShift, rdir = r >> AttrDirShift;
+			related[k] = singleLine || ldir == rdir;
+			type[k] = ((l & AttrAppend) >> 2) | ((r & AttrAppend) >> 1)
+				| ((ldir == down) << 2) | ((rdir == down) << 3)
+				| ((l & AttrPosMask) << 4) | ((r & AttrPosMask) << 6);
+		}
+
+		// 时间差沿扫描方向单调不减，超出相关范围即可截断
+		int stop = m;
+		for (int k = 0; k < m; k++) {
+			if (delta[k] > bound) {
+				stop = k;
+				break;
+			}
+		}
+		for (int k = 0; k < stop; k++) {
+			if (!related[k]) continue;
+			int t = thr[type[k]];
+			bool hit = (t == GapConstraintTable::INVALID) ?
+				table.checkConflict(type[k], delta[k]) : delta[k] < t;
+			if (hit)
+				return idx[k];
+		}
+		if (stop < m)
+			return -1;
+	}
+	return -1;
+}
@@ -1,9 +1,13 @@
 ﻿#pragma once
 #include <map>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include "data/diagram/trainevents.h"
+#include "data/diagram/traingap.h"
 
 class GapConstraints;
+class GapConstraintTable;
 
 /**
  * @brief The StationEventAxis class
@@ -22,6 +26,25 @@ class StationEventAxis:
      * 显然，同一运行线在站前或站后分别最多只出现一次。通过事件同时算站前和站后。
      */
      line_map_t _preEvents, _postEvents;
+
+    /**
+     * 与事件表平行的紧凑数据（struct-of-arrays），供conflictEvent()的查找和扫描使用，
+     * 避免逐个访问事件对象。由buildAxis(), insertEvent(), removeLineEvents()维护；
+     * 如果外部直接修改了事件表而未重新buildAxis()，则长度不一致，此时conflictEvent()退回逐个事件的实现。
+     * _secs: 时刻（距0点秒数）；_attrs: 见packAttrs()。
+     */
+    std::vector<int> _secs;
+    std::vector<quint8> _attrs;
+
+    /**
+     * 紧凑属性的位定义：低2位为Positions；AttrAppend为hasAppend()；
+     * 再往上2位为Direction的值（下行、上行、未定义）。
+     */
+    enum AttrBits : quint8 {
+        AttrPosMask = 0b0011,
+        AttrAppend = 0b0100,
+        AttrDirShift = 3,
+    };
 public:
     using QVector<std::shared_ptr<RailStationEvent>>::QVector;
 
@@ -45,6 +68,12 @@ public:
      */
     void insertEvent(std::shared_ptr<RailStationEvent> ev);
 
+    /**
+     * 删除属于所给运行线的全部事件，保持其他事件的顺序，并同步更新映射表。
+     * 用于事件轴的增量更新（车次删除或时刻变化）。
+     */
+    void removeLineEvents(const std::unordered_set<const TrainLine*>& lines);
+
     /**
      * @brief conflictEvent 找出与指定事件冲突的事件。
      * 如果没有冲突事件，即当前排图是许可的，则返回空。
@@ -56,12 +85,31 @@ public:
      * (1) 如果有左冲突事件（即时刻在ev之前的事件），优先返回左冲突事件。
      * (2) 暂定优先返回时刻离ev较近的事件。
      * 即从ev时刻开始，先左后右向两边遍历。
+     * 如果constraint已经compile()，转交下面的查表版本。
      */
     std::shared_ptr<RailStationEvent>
         conflictEvent(const RailStationEventBase& ev,
                       const GapConstraints& constraint,
                       bool singleLine) const;
 
+    /**
+     * conflictEvent()的查表版本，结果与上一版本相同。
+     * 在紧凑数据上分块计算时间差和间隔类型，与稠密约束表比较；
+     * 跨日情况作为环形序列统一处理，不再单独循环。推线内层循环使用。
+     */
+    std::shared_ptr<RailStationEvent>
+        conflictEvent(const RailStationEventBase& ev,
+                      const GapConstraintTable& table,
+                      bool singleLine) const;
+
+    static quint8 packAttrs(const RailStationEventBase& ev);
+
+    /**
+     * 由紧凑属性计算间隔类型，与TrainGap::gapTypeBetween()一致。
+     * 不构成间隔（双线反向）时返回false。
+     */
+    static bool packedGapType(quint8 left, quint8 right, bool singleLine, TrainGap::GapTypesV2& type);
+
 private:
 
     /**
@@ -80,6 +128,29 @@ private:
                     const GapConstraints& constraint,
                     bool singleLine) const;
 
+    /**
+     * 由事件表重新生成紧凑数据
+     */
+    void rebuildPacked();
+
+    bool packedValid()const { return _secs.size() == static_cast<std::size_t>(size()); }
+
+    /**
+     * 查表版本的扫描核心。在长度为n的环形序列上，自start起向左（leftSide）或向右扫描，
+     * 直到时间差超出相关范围，返回第一个冲突事件的下标；没有则返回-1。
+     * ev的紧凑属性为attr，时刻为tm。
+     */
+    static int scanConflict(const int* secs, const quint8* attrs, int n, int start, bool leftSide,
+        int tm, quint8 attr, bool singleLine, const GapConstraintTable& table);
+
+    /**
+     * 基于紧凑数据的conflictEvent()实现
+     */
+    std::shared_ptr<RailStationEvent>
+        conflictEventPacked(const RailStationEventBase& ev,
+                      const GapConstraints& constraint,
+                      bool singleLine) const;
+
 
 };
 
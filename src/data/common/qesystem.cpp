@@ -69,6 +69,10 @@ void SystemJson::fromJson(const QJsonObject& obj)
     show_start_page = obj.value("show_start_page").toBool(true);
     transparent_config = obj.value("transparent_config").toBool(true);
     inform_dragging = obj.value("inform_dragging").toBool(true);
+    worker_threads = obj.value("worker_threads").toInt(0);
+    progressive_paint = obj.value("progressive_paint").toBool(true);
+    lod_scale = obj.value("lod_scale").toDouble(0.5);
+    bulk_paint = obj.value("bulk_paint").toBool(false);
 
     const QJsonArray& arhis = obj.value("history").toArray();
     for (const auto& p : arhis) {
@@ -98,6 +102,10 @@ QJsonObject SystemJson::toJson() const
         {"show_start_page",show_start_page},
         {"transparent_config", transparent_config},
         {"inform_dragging", inform_dragging},
+        {"worker_threads", worker_threads},
+        {"progressive_paint", progressive_paint},
+        {"lod_scale", lod_scale},
+        {"bulk_paint", bulk_paint},
     };
 }
 
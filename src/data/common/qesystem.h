@@ -44,6 +44,29 @@ public:
      */
     bool transparent_config = true;
 
+    /**
+     * 后台计算（绑定线路等）的工作线程数。0表示按硬件并发数自动确定；
+     * 1表示不启用并行，全部在主线程顺序计算。
+     */
+    int worker_threads = 0;
+
+    /**
+     * 渐进式铺画：先铺画与当前视口相交的运行线，其余的在事件循环中分批铺画。
+     */
+    bool progressive_paint = true;
+
+    /**
+     * 运行图缩放比例低于此值时，采用低细节层次（LOD）显示运行线：
+     * 简化折线、不显示标签，同一画笔的运行线合并绘制。0表示不启用。
+     */
+    double lod_scale = 0.5;
+
+    /**
+     * 合并绘制：任意缩放比例下，未选中的运行线主体都按画笔合并为少数图元绘制，
+     * 车次标签等仍逐车次显示。适用于运行线很多的运行图。
+     */
+    bool bulk_paint = false;
+
     //todo: dock show..
 
     /**
@@ -1,5 +1,10 @@
 ﻿#include "diadiff.h"
 #include <data/train/train.h>
+#include <util/utilfunc.h>
+
+#include <algorithm>
+#include <cmath>
+#include <QHash>
 
 
 StationDiff::DiffType StationDiff::stationCompareType(
@@ -44,16 +49,53 @@ TrainDifference::TrainDifference(DiffType type, std::shared_ptr<const Train> tra
         train1=train;
 }
 
+TrainDifference::TrainDifference(std::shared_ptr<const Train> train1,
+                                 std::shared_ptr<const Train> train2, IdenticalTag):
+    type(Unchanged), train1(train1), train2(train2), similarity(0), difference(0)
+{
+    if (train1->empty() || train2->empty()) {
+        // 与compute()中的特殊情况一致
+        type = Changed;
+        similarity = difference = -1;
+        return;
+    }
+    // 相同时刻表的最优路径即为对角线，逐站均为Unchanged
+    stations.reserve(train1->stationCount());
+    auto p2 = train2->timetable().cbegin();
+    for (auto p1 = train1->timetable().cbegin(); p1 != train1->timetable().cend(); ++p1, ++p2) {
+        stations.emplace_back(StationDiff::Unchanged, p1, p2);
+    }
+    similarity = static_cast<int>(stations.size());
+}
+
 const TrainName& TrainDifference::trainName() const
 {
     return train1 ? train1->trainName() : train2->trainName();
 }
 
-int TrainDifference::calSimilarity(const TrainStation &st1, const TrainStation &st2)
+quint64 TrainDifference::timetableHash(const Train& train)
 {
-    if (st1.name == st2.name)
-        return 1;
-    else return 0;
+    quint64 res = qeutil::mix64(static_cast<quint64>(train.stationCount()));
+    for (const auto& st : train.timetable()) {
+        quint64 h = qHash(st.name, size_t(0));
+        h = qeutil::mix64(h ^ static_cast<quint32>(st.arrive.msecsSinceStartOfDay()));
+        h = qeutil::mix64(h ^ (static_cast<quint64>(static_cast<quint32>(st.depart.msecsSinceStartOfDay())) << 32));
+        // 与顺序有关
+        res = qeutil::mix64(res ^ h);
+    }
+    return res;
+}
+
+bool TrainDifference::sameTimetable(const Train& train1, const Train& train2)
+{
+    if (train1.stationCount() != train2.stationCount())
+        return false;
+    auto p2 = train2.timetable().cbegin();
+    for (auto p1 = train1.timetable().cbegin(); p1 != train1.timetable().cend(); ++p1, ++p2) {
+        if (p1->name != p2->name || p1->arrive != p2->arrive || p1->depart != p2->depart)
+            return false;
+    }
+    return true;
 }
 
 void TrainDifference::compute()
@@ -62,98 +104,126 @@ void TrainDifference::compute()
         // 特殊情况？
         return;
     }
-    xtl::matrix<int> table(train1->stationCount(),train2->stationCount()),
-            next_i(train1->stationCount(),train2->stationCount()),
-            next_j(train1->stationCount(),train2->stationCount());
-    table.fill(-1);
-    next_i.fill(-1);
-    next_j.fill(-1);
-
-    similarity=solve(0,0,train1->timetable().begin(),train2->timetable().begin(),
-                     table,next_i,next_j);
-    difference=genResult(0,0,train1->timetable().begin(),train2->timetable().begin(),
-                         next_i,next_j);
+    using citr = std::list<TrainStation>::const_iterator;
+    std::vector<citr> st1, st2;
+    st1.reserve(train1->stationCount());
+    st2.reserve(train2->stationCount());
+    for (auto p = train1->timetable().cbegin(); p != train1->timetable().cend(); ++p)
+        st1.push_back(p);
+    for (auto p = train2->timetable().cbegin(); p != train2->timetable().cend(); ++p)
+        st2.push_back(p);
+
+    solveIterative(st1, st2);
     if (difference==0)
         type=Unchanged;
 }
 
-int TrainDifference::solve(int s1, int s2, std::list<TrainStation>::const_iterator itr1,
-                           std::list<TrainStation>::const_iterator itr2, xtl::matrix<int> &table,
-                           xtl::matrix<int> &next_i, xtl::matrix<int> &next_j)
+void TrainDifference::solveIterative(const std::vector<std::list<TrainStation>::const_iterator>& st1,
+    const std::vector<std::list<TrainStation>::const_iterator>& st2)
 {
-    if (s1>=train1->stationCount() && s2>=train2->stationCount()){
-        // 双越界  长度为0的话直接这里走掉了
-        return 0;
-    }else if (s1>=train1->stationCount()){
-        // s1越界，则2和空白匹配一位
-        next_i.get(s1-1,s2)=s1;
-        next_j.get(s1-1,s2)=s2+1;
-        return 0+solve(s1,s2+1,itr1,std::next(itr2),table,next_i,next_j);
-    }else if (s2>=train2->stationCount()){
-        next_i.get(s1,s2-1)=s1+1;
-        next_j.get(s1,s2-1)=s2;
-        return 0+solve(s1+1,s2,std::next(itr1),itr2,table,next_i,next_j);
+    const int n1 = static_cast<int>(st1.size()), n2 = static_cast<int>(st2.size());
+
+    // 站名编号：两站相似度为1当且仅当编号相同
+    std::vector<int> id1(n1), id2(n2);
+    {
+        QHash<StationName, int> ids;
+        auto id_of = [&ids](const StationName& name) {
+            auto itr = ids.find(name);
+            if (itr == ids.end())
+                itr = ids.insert(name, static_cast<int>(ids.size()));
+            return itr.value();
+        };
+        for (int i = 0; i < n1; i++) id1[i] = id_of(st1[i]->name);
+        for (int j = 0; j < n2; j++) id2[j] = id_of(st2[j]->name);
     }
 
-    if (table.get(s1,s2) != -1){
-        return table.get(s1,s2);
-    }
-    int rec1=calSimilarity(*itr1,*itr2)+
-            solve(s1+1,s2+1,std::next(itr1),std::next(itr2),table,next_i,next_j);
-    int rec2=0+solve(s1,s2+1,itr1,std::next(itr2),table,next_i,next_j);
-    int rec3=0+solve(s1+1,s2,std::next(itr1),itr2,table,next_i,next_j);
-    int sol=std::max({rec1,rec2,rec3});
-    table.get(s1,s2)=sol;
-    if(sol==rec1){
-        next_i.get(s1,s2)=s1+1;
-        next_j.get(s1,s2)=s2+1;
-    }else if(sol==rec2){
-        next_i.get(s1,s2)=s1;
-        next_j.get(s1,s2)=s2+1;
-    }else{
-        next_i.get(s1,s2)=s1+1;
-        next_j.get(s1,s2)=s2;
+    // row[j] = T(i, j)，row[n2] = 0；below为第i+1行
+    using row_t = std::vector<int>;
+    auto cal_row = [&](int i, const row_t& below, row_t& row) {
+        row[n2] = 0;
+        for (int j = n2 - 1; j >= 0; j--) {
+            int rec1 = (id1[i] == id2[j]) + below[j + 1];
+            row[j] = std::max({ rec1, row[j + 1], below[j] });
+        }
+    };
+
+    // 自下而上计算，保存第0, B, 2B, ...行
+    const int B = std::max(1, static_cast<int>(std::ceil(std::sqrt(static_cast<double>(n1)))));
+    const row_t zeros(n2 + 1, 0);
+    std::vector<row_t> checkpoints((n1 + B - 1) / B);
+    {
+        row_t below = zeros, row(n2 + 1);
+        for (int i = n1 - 1; i >= 0; i--) {
+            cal_row(i, below, row);
+            if (i % B == 0)
+                checkpoints[i / B] = row;
+            std::swap(below, row);
+        }
     }
-    return sol;
-}
-
-int TrainDifference::genResult(int s1, int s2, std::list<TrainStation>::const_iterator itr1,
-                               std::list<TrainStation>::const_iterator itr2,
-                               xtl::matrix<int>& next_i, xtl::matrix<int>& next_j)
-{
-    if (s1==-1 || s2==-1){
-        return 0;
+    similarity = checkpoints.front().front();
+
+    // 当前块的各行：rows[r] = T(k*B+r, ·)，最后一行为块下方的一行
+    int k = -1;
+    std::vector<row_t> rows(B + 1, row_t(n2 + 1));
+    auto load_block = [&](int kk) {
+        k = kk;
+        int r0 = k * B, r1 = std::min(r0 + B, n1);
+        rows[r1 - r0] = (r1 < n1) ? checkpoints[k + 1] : zeros;
+        for (int i = r1 - 1; i >= r0; i--) {
+            cal_row(i, rows[i - r0 + 1], rows[i - r0]);
+        }
+    };
+    auto T = [&](int i, int j) {
+        return i >= n1 ? 0 : rows[i - k * B][j];
+    };
+
+    int diff = 0;
+    int i = 0, j = 0;
+    while (i < n1 && j < n2) {
+        if (i / B != k)
+            load_block(i / B);
+        int ni, nj;
+        if ((i == n1 - 1 && j >= 1) || (n2 >= 2 && j == n2 - 1 && i >= 1)) {
+            // 原递归版本中，越界分支在回溯表的末行、末列上留下的取法（斜向）覆盖了
+            // 这些格子自身的结果，实际生效的是斜向。这里照此处理以保持结果不变。
+            ni = i + 1; nj = j + 1;
+        }
+        else {
+            int rec1 = (id1[i] == id2[j]) + T(i + 1, j + 1);
+            int rec2 = T(i, j + 1);
+            int rec3 = T(i + 1, j);
+            int sol = std::max({ rec1, rec2, rec3 });
+            if (sol == rec1) {
+                ni = i + 1; nj = j + 1;
+            }
+            else if (sol == rec2) {
+                ni = i; nj = j + 1;
+            }
+            else {
+                ni = i + 1; nj = j;
+            }
+        }
+        if (ni != i && nj != j) {
+            diff += addStation(st1[i], st2[j]);
+        }
+        else if (ni != i) {
+            diff += addStation(st1[i], std::nullopt);
+        }
+        else {
+            diff += addStation(std::nullopt, st2[j]);
+        }
+        i = ni; j = nj;
     }
-    if (s1>=train1->stationCount() && s2>=train2->stationCount()){
-        return 0;
-    }else if (s1>=train1->stationCount()){
-        addStation(std::nullopt,itr2);
-        return 1+genResult(s1,s2+1,itr1,std::next(itr2),next_i,next_j);
-    }else if(s2>=train2->stationCount()){
-        addStation(itr1,std::nullopt);
-        return 1+genResult(s1+1,s2,std::next(itr1),itr2,next_i,next_j);
+    // 其中一个车次已经走完，另一车次余下的站分别为新增、删除
+    for (; j < n2; j++) {
+        addStation(std::nullopt, st2[j]);
+        diff++;
     }
-    int nxi=next_i.get(s1,s2);
-    int nxj=next_j.get(s1,s2);
-    int diff;
-    if (nxi!=s1 && nxj!=s2){
-        diff=addStation(itr1,itr2);
-    }else if(nxi!=s1){
-        diff=addStation(itr1,std::nullopt);
-    }else{
-        diff=addStation(std::nullopt,itr2);
+    for (; i < n1; i++) {
+        addStation(st1[i], std::nullopt);
+        diff++;
     }
-    return diff+genResult(nxi,nxj,nextItr(s1,itr1,nxi),
-                          nextItr(s2,itr2,nxj),next_i,next_j);
-}
-
-
-
-std::list<TrainStation>::const_iterator TrainDifference::nextItr(int s,
-                        std::list<TrainStation>::const_iterator itr, int nx)
-{
-    std::advance(itr,nx-s);
-    return itr;
+    difference = diff;
 }
 
 int TrainDifference::addStation(std::optional<std::list<TrainStation>::const_iterator> si,
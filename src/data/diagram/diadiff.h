@@ -4,7 +4,7 @@
 #include <list>
 #include <vector>
 #include <optional>
-#include "xtl_matrix.hpp"
+#include <QtGlobal>
 
 class TrainStation;
 
@@ -60,52 +60,45 @@ public:
      */
     TrainDifference(DiffType type, std::shared_ptr<const Train> train);
 
-    const TrainName& trainName()const;
+    struct IdenticalTag {};
 
-private:
-    int calSimilarity(const TrainStation& st1, const TrainStation& st2);
+    /**
+     * 双车次构造，但已知两车次时刻表完全相同（sameTimetable()为真），
+     * 不做DP，直接逐站生成Unchanged。结果与DP构造相同。
+     */
+    TrainDifference(std::shared_ptr<const Train> train1,
+                    std::shared_ptr<const Train> train2, IdenticalTag);
+
+    const TrainName& trainName()const;
 
     /**
-     * 计算的总入口函数。将结果直接保存在类内。原则上，只能调用一次。
+     * 时刻表（站名、到达、出发时刻，按顺序）的散列值，用于预先筛出未修改的车次。
+     * 散列值相同时仍需sameTimetable()确认。
      */
-    void compute();
+    static quint64 timetableHash(const Train& train);
 
     /**
-     * @brief solve  递归求解。pyETRC.Train.globalDiff.solve()
-     * @param s1 train1车次起始下标子问题
-     * @param s2 train2车次起始下标子问题
-     * @param table DP字典
-     * @param next_i DP路径
-     * @param next_j
-     * @return 相似度
+     * 两车次时刻表是否完全相同（站数相同，且逐站站名、到达、出发时刻相同）
      */
-    int solve(int s1, int s2, std::list<TrainStation>::const_iterator itr1,
-              std::list<TrainStation>::const_iterator itr2,
-              xtl::matrix<int>& table,
-              xtl::matrix<int>& next_i, xtl::matrix<int>& next_j);
+    static bool sameTimetable(const Train& train1, const Train& train2);
 
+private:
     /**
-     * @brief genResult  pyETRC.Train.globalDiff.generate_result()
-     * itr (1,2) 是与s (1,2)对应的迭代器，用来回避下标运算。
-     * 如果s1, s2之间有一个是-1，那么立即返回，此时不用考虑迭代器。
-     * 迭代器总是单向移动的。
-     * @return
+     * 计算的总入口函数。将结果直接保存在类内。原则上，只能调用一次。
      */
-    int genResult(int s1,int s2,
-                  std::list<TrainStation>::const_iterator itr1,
-                  std::list<TrainStation>::const_iterator itr2,
-                  xtl::matrix<int>& next_i,
-                  xtl::matrix<int>& next_j);
+    void compute();
 
     /**
-     * @brief nextItr  用迭代器作差的方法，计算与nx对应的下一个迭代器。
-     * @param s 初始下标 （非-1）
-     * @param itr 初始迭代器
-     * @param nx 目标下标
-     * @return 新的迭代器，与nx对应
+     * 原自顶向下的递归记忆化求解（solve/genResult）改为自底向上的迭代DP。
+     * 设T(i, j)为从train1第i站、train2第j站起的子问题的最大相似度。
+     * 按行自下而上计算T，只保留每隔约sqrt(n1)行的检查点，内存为O(n2*sqrt(n1))；
+     * 回溯时自(0, 0)向前，路径进入哪一块就由检查点重算哪一块的各行。
+     * 每一步的取法与原递归版本完全相同（含平局时的优先顺序，以及原版本在末行、末列上
+     * 实际生效的取法），因此生成的StationDiff序列及相似度、差异数不变。
+     * 相似度只取决于站名是否相同，因此先将站名编号，DP中只比较整数。
      */
-    std::list<TrainStation>::const_iterator
-        nextItr(int s, std::list<TrainStation>::const_iterator itr, int nx);
+    void solveIterative(const std::vector<std::list<TrainStation>::const_iterator>& st1,
+        const std::vector<std::list<TrainStation>::const_iterator>& st2);
 
     int addStation(std::optional<std::list<TrainStation>::const_iterator> si,
                    std::optional<std::list<TrainStation>::const_iterator> sj);
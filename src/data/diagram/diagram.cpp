@@ -9,12 +9,16 @@
 #include "mainwindow/version.h"
 #include "data/common/qesystem.h"
 #include "log/IssueManager.h"
+#include "util/qeparallel.h"
+#include "stationtrainindex.h"
+#include "raileventpool.h"
 
 #include <QFile>
 #include <QJsonObject>
 #include <numeric>
 #include <QJsonDocument>
 #include <cmath>
+#include <algorithm>
 
 
 void Diagram::addRailway(std::shared_ptr<Railway> rail)
@@ -71,11 +75,59 @@ void Diagram::updateRailway(std::shared_ptr<Railway> r)
             p->checkIsValid();
         }
     }
-    foreach (const auto& p, _trainCollection.trains()){
-        p->updateBoundRailway(r, _config);
+
+    // incremental rebinding. Only trains touching the changed range are rebound;
+    // the others just redirect their station pointers to the new station objects.
+    const auto range = r->takePendingChange();
+    if (range.all) {
+        foreach(const auto & p, _trainCollection.trains()) {
+            p->updateBoundRailway(r, _config);
+        }
+        return;
+    }
+    foreach(const auto & p, _trainCollection.trains()) {
+        if (!p->paths().empty()) {
+            // 与Train::updateBoundRailway()一致，不处理按径路绑定的列车
+            continue;
+        }
+        auto adp = p->adapterFor(*r);
+        if (isTrainAffected(*p, adp.get(), *r, range) || (adp && !adp->remapRailStations(*r))) {
+            p->updateBoundRailway(r, _config);
+        }
+        else if (adp) {
+            p->invalidateTempData();
+        }
     }
 }
 
+bool Diagram::isTrainAffected(const Train& train, const TrainAdapter* adp,
+    const Railway& rail, const RailwayChangeRange& range)
+{
+    if (range.all)
+        return true;
+    if (adp) {
+        for (const auto& line : adp->lines()) {
+            auto first = line->firstRailStation(), last = line->lastRailStation();
+            if (!first || !last || range.overlaps(first->mile, last->mile))
+                return true;
+        }
+    }
+    // 相邻绑定站之间（包括被截断的运行线之间）的车站增删也会影响截断，
+    // 因此考察可绑定站的整个里程范围。未涉及修改的站，新旧里程相同。
+    bool found = false;
+    double mileMin = 0, mileMax = 0;
+    for (const auto& st : train.timetable()) {
+        if (range.touchedFields.contains(st.name.station()))
+            return true;
+        if (auto rst = rail.stationByGeneralName(st.name)) {
+            mileMin = found ? std::min(mileMin, rst->mile) : rst->mile;
+            mileMax = found ? std::max(mileMax, rst->mile) : rst->mile;
+            found = true;
+        }
+    }
+    return found && range.overlaps(mileMin, mileMax);
+}
+
 void Diagram::updateTrain(std::shared_ptr<Train> t)
 {
     if (t->paths().empty()) {
@@ -91,8 +143,51 @@ void Diagram::updateTrain(std::shared_ptr<Train> t)
 TrainEventList Diagram::listTrainEvents(const Train& train) const
 {
     TrainEventList res;
+    // look up the interaction table kept in the station index
+    auto& cache = stationIndexCache();
+    std::lock_guard lock(cache.mutex());
     foreach (auto p , train.adapters()) {
-        res.push_back(qMakePair(p, p->listAdapterEvents(_trainCollection)));
+        auto& index = cache.indexFor(p->railway(), _trainCollection);
+        res.push_back(qMakePair(p, p->listAdapterEvents(_trainCollection, index)));
+    }
+    return res;
+}
+
+QVector<TrainEventList> Diagram::listTrainEvents(const QList<std::shared_ptr<Train>>& trains) const
+{
+    auto& cache = stationIndexCache();
+    std::lock_guard lock(cache.mutex());
+
+    // 每条线路只同步一次索引
+    std::unordered_map<const Railway*, StationTrainIndex*> indexes;
+    auto index_of = [&](const std::shared_ptr<Railway>& railway) -> StationTrainIndex& {
+        auto& p = indexes[railway.get()];
+        if (!p) p = &cache.indexFor(railway, _trainCollection);
+        return *p;
+    };
+
+    // 先按线路并行计算尚无缓存的事件表
+    std::unordered_map<StationTrainIndex*, std::vector<const TrainLine*>> lines;
+    for (const auto& train : trains) {
+        foreach(auto p, train->adapters()) {
+            auto& lst = lines[&index_of(p->railway())];
+            for (const auto& line : p->lines()) {
+                lst.push_back(line.get());
+            }
+        }
+    }
+    for (auto& [index, lst] : lines) {
+        index->prepareLineEvents(lst, _trainCollection);
+    }
+
+    QVector<TrainEventList> res;
+    res.reserve(trains.size());
+    for (const auto& train : trains) {
+        TrainEventList lst;
+        foreach(auto p, train->adapters()) {
+            lst.push_back(qMakePair(p, p->listAdapterEvents(_trainCollection, index_of(p->railway()))));
+        }
+        res.push_back(std::move(lst));
     }
     return res;
 }
@@ -103,32 +198,98 @@ DiagnosisList Diagram::diagnoseTrain(const Train& train, bool withIntMeet,
 {
     DiagnosisList res;
     bool filtByRange = railway && start && end;
+    if (!filtByRange) {
+        start.reset();
+        end.reset();
+    }
+    // prune the other lines by the envelopes kept in the station index
+    auto& cache = stationIndexCache();
+    std::lock_guard lock(cache.mutex());
     foreach(auto adp, train.adapters()) {
         if (!railway || adp->railway() == railway) {
-            foreach(auto line, adp->lines()) {
-                auto sub = line->diagnoseLine(_trainCollection, withIntMeet);
-                if (filtByRange) {
-                    foreach(auto ev, sub) {
-                        if (ev.inRange(start,end)) {
-                            res.push_back(ev);
-                        }
-                    }
-                }
-                else {
-                    res.append(sub);
+            const auto& index = cache.indexFor(adp->railway(), _trainCollection);
+            diagnoseAdapter(res, *adp, index, withIntMeet, start, end);
+        }
+    }
+    return res;
+}
+
+void Diagram::diagnoseAdapter(DiagnosisList& res, const TrainAdapter& adp, const StationTrainIndex& index,
+    bool withIntMeet, std::shared_ptr<RailStation> start, std::shared_ptr<RailStation> end) const
+{
+    bool filtByRange = start && end;
+    foreach(auto line, adp.lines()) {
+        auto sub = line->diagnoseLine(_trainCollection, withIntMeet, index);
+        if (filtByRange) {
+            foreach(auto ev, sub) {
+                if (ev.inRange(start, end)) {
+                    res.push_back(ev);
                 }
             }
         }
+        else {
+            res.append(sub);
+        }
     }
-    return res;
 }
 
 DiagnosisList Diagram::diagnoseAllTrains(std::shared_ptr<Railway> railway, std::shared_ptr<RailStation> start,
     std::shared_ptr<RailStation> end) const
 {
+    return diagnoseAllTrains(railway, start, end, nullptr);
+}
+
+DiagnosisList Diagram::diagnoseAllTrains(std::shared_ptr<Railway> railway,
+    std::shared_ptr<RailStation> start, std::shared_ptr<RailStation> end,
+    const DiagnosisCallback& onPartial, const std::atomic_bool* cancelled) const
+{
+    const auto& trains = _trainCollection.trains();
+    const int n = trains.size();
+    if (!(railway && start && end)) {
+        start.reset();
+        end.reset();
+    }
+
+    // 各线路的索引在此单独建立，以免计算期间一直占用stationIndexCache()的锁
+    std::unordered_map<const Railway*, StationTrainIndex> indexes;
+    foreach(auto rail, railways()) {
+        if (!railway || rail == railway) {
+            indexes[rail.get()].refresh(rail, _trainCollection);
+        }
+    }
+
+    // 分块的粒度同时决定了回调的频率
+    constexpr int chunk_size = 16;
+    const int nchunks = (n + chunk_size - 1) / chunk_size;
+    std::vector<DiagnosisList> parts(nchunks);
+    std::mutex cb_mutex;
+    int done = 0;
+
+    qeutil::parallelFor(nchunks, [&](int c) {
+        if (cancelled && cancelled->load(std::memory_order_relaxed))
+            return;
+        auto& part = parts[c];
+        const int first = c * chunk_size, last = std::min(n, first + chunk_size);
+        for (int i = first; i < last; i++) {
+            foreach(auto adp, trains.at(i)->adapters()) {
+                if (!railway || adp->railway() == railway) {
+                    auto itr = indexes.find(adp->railway().get());
+                    if (itr != indexes.end()) {
+                        diagnoseAdapter(part, *adp, itr->second, true, start, end);
+                    }
+                }
+            }
+        }
+        if (onPartial) {
+            std::lock_guard lock(cb_mutex);
+            done += last - first;
+            onPartial(part, done, n);
+        }
+        });
+
     DiagnosisList res;
-    foreach(auto t, _trainCollection.trains()) {
-        res.append(diagnoseTrain(*t, true, railway, start, end));
+    for (const auto& p : parts) {
+        res.append(p);
     }
     return res;
 }
@@ -249,17 +410,7 @@ void Diagram::removeRailwayAtU(int i)
 void Diagram::rebindAllTrains()
 {
     IssueManager::get()->clear();
-    foreach (auto t , _trainCollection.trains()) {
-        if (t->paths().empty()) {
-            t->clearBoundRailways();
-            foreach(auto p, railways()) {
-                t->bindToRailway(p, _config);
-            }
-        }
-        else {
-            t->bindWithPath();
-        }
-    }
+    bindTrainsParallel(true);
 }
 
 void Diagram::refreshAll()
@@ -321,16 +472,14 @@ Diagram::stationTrainsSettled(std::shared_ptr<Railway> railway,
     std::shared_ptr<RailStation> st) const
 {
     std::vector<std::pair<std::shared_ptr<TrainLine>, const AdapterStation*>> res;
-    foreach(auto train , _trainCollection.trains()) {
-        foreach (auto adp , train->adapters()) {
-            if (adp->isInSameRailway(railway)) {
-                for (auto line : adp->lines()) {
-                    auto* p = line->stationFromRail(st);
-                    if (p) {
-                        //res.append(qMakePair(line, p));
-                        res.emplace_back(line, p);
-                    }
-                }
+    {
+        // read from the station index instead of scanning all trains
+        auto& cache = stationIndexCache();
+        std::lock_guard lock(cache.mutex());
+        const auto& index = cache.indexFor(railway, _trainCollection);
+        for (const auto& e : index.entries(st.get())) {
+            if (e.station) {
+                res.emplace_back(e.line, e.station);
             }
         }
     }
@@ -347,19 +496,22 @@ RailStationEventList
     Diagram::stationEvents(std::shared_ptr<Railway> railway, 
         std::shared_ptr<const RailStation> st,
         const ITrainFilter* filter) const
+{
+    auto& cache = stationIndexCache();
+    std::lock_guard lock(cache.mutex());
+    const auto& index = cache.indexFor(railway, _trainCollection);
+    return stationEventsFromIndex(index, st, filter);
+}
+
+RailStationEventList Diagram::stationEventsFromIndex(const StationTrainIndex& index,
+    std::shared_ptr<const RailStation> st, const ITrainFilter* filter) const
 {
     RailStationEventList res;
-    foreach (auto train , _trainCollection.trains()) {
-        if (filter && !filter->check(train)) continue;
-        foreach (auto adp , train->adapters()) {
-            if (adp->isInSameRailway(railway)) {
-                foreach (auto line , adp->lines()) {
-                    const auto& lst = line->stationEventFromRail(st);
-                    for (auto p = lst.begin(); p != lst.end(); ++p) {
-                        res.push_back(*p);
-                    }
-                }
-            }
+    for (const auto& e : index.entries(st.get())) {
+        if (filter && !filter->check(e.line->train())) continue;
+        const auto& lst = e.line->stationEventFromRail(st);
+        for (auto p = lst.begin(); p != lst.end(); ++p) {
+            res.push_back(*p);
         }
     }
     using PR = RailStationEventList::value_type;
@@ -373,9 +525,18 @@ std::map<std::shared_ptr<RailStation>, RailStationEventList>
     Diagram::stationEventsForRail(std::shared_ptr<Railway> railway)const
 {
     std::map<std::shared_ptr<RailStation>, RailStationEventList> res;
-    foreach(auto p, qAsConst(railway->stations())) {
-        if (p->direction != PassedDirection::NoVia) {
-            res.emplace(p, stationEvents(railway, p));
+    // 结果中的事件共用一个池，随最后一个事件释放
+    auto buckets = collectRailStationEvents(railway, nullptr, RailEventPool::create());
+    using PR = RailStationEventList::value_type;
+    qeutil::parallelFor(static_cast<int>(buckets.size()), [&buckets](int i) {
+        std::sort(buckets[i].begin(), buckets[i].end(), [](const PR& p1, const PR& p2) {
+            return p1->time < p2->time;
+            });
+        });
+    const auto& stations = railway->stations();
+    for (int i = 0; i < stations.size(); i++) {
+        if (stations.at(i)->direction != PassedDirection::NoVia) {
+            res.emplace(stations.at(i), std::move(buckets[i]));
         }
     }
     return res;
@@ -385,16 +546,67 @@ RailwayStationEventAxis Diagram::stationEventAxisForRail(std::shared_ptr<Railway
     const ITrainFilter& filter) const
 {
     RailwayStationEventAxis res;
-    foreach(auto p, qAsConst(railway->stations())) {
-        if (p->direction != PassedDirection::NoVia) {
-            StationEventAxis staxis = stationEvents(railway, p, &filter);
-            staxis.buildAxis();
-            res.emplace(p, std::move(staxis));
+    res.setPool(RailEventPool::create());
+    auto buckets = collectRailStationEvents(railway, &filter, res.pool());
+    qeutil::parallelFor(static_cast<int>(buckets.size()), [&buckets](int i) {
+        buckets[i].buildAxis();
+        });
+    const auto& stations = railway->stations();
+    for (int i = 0; i < stations.size(); i++) {
+        if (stations.at(i)->direction != PassedDirection::NoVia) {
+            res.emplace(stations.at(i), std::move(buckets[i]));
         }
     }
     return res;
 }
 
+std::vector<quint64> Diagram::stationEventFingerprints(std::shared_ptr<Railway> railway,
+    const ITrainFilter* filter) const
+{
+    auto& cache = stationIndexCache();
+    std::lock_guard lock(cache.mutex());
+    const auto& index = cache.indexFor(railway, _trainCollection);
+    const auto& stations = railway->stations();
+    std::vector<quint64> res(stations.size());
+    for (int i = 0; i < stations.size(); i++) {
+        res[i] = index.fingerprint(stations.at(i).get(), filter);
+    }
+    return res;
+}
+
+std::vector<RailStationEventList> Diagram::collectRailStationEvents(
+    std::shared_ptr<Railway> railway, const ITrainFilter* filter,
+    const std::shared_ptr<RailEventPool>& pool) const
+{
+    const auto& stations = railway->stations();
+    std::vector<RailStationEventList> buckets(stations.size());
+    std::unordered_map<const RailStation*, int> rail_index;
+    rail_index.reserve(stations.size());
+    for (int i = 0; i < stations.size(); i++) {
+        rail_index.emplace(stations.at(i).get(), i);
+    }
+    foreach(const auto & train, _trainCollection.trains()) {
+        if (filter && !filter->check(train)) continue;
+        foreach(const auto & adp, train->adapters()) {
+            if (adp->isInSameRailway(railway)) {
+                foreach(const auto & line, adp->lines()) {
+                    line->collectStationEvents(stations, rail_index, buckets, pool);
+                }
+            }
+        }
+    }
+    return buckets;
+}
+
+StationTrainIndexCache& Diagram::stationIndexCache() const
+{
+    // null only for a moved-from diagram
+    if (!_stationIndex) {
+        _stationIndex = std::make_unique<StationTrainIndexCache>();
+    }
+    return *_stationIndex;
+}
+
 std::vector<std::pair<std::shared_ptr<TrainLine>, QTime>> Diagram::sectionEvents(std::shared_ptr<Railway> railway, double y) const
 {
     SectionEventList res;
@@ -760,9 +972,25 @@ ReadRulerReport Diagram::rulerFromMultiTrains(std::shared_ptr<Railway> railway,
     foreach(auto p, intervals) {
         res.insert({ p,{} });
     }
-    decltype(res.begin()) itr;
 
-    foreach(auto train, trains) {
+    // 先单遍扫描所有车次，把各区间的运行时分收集到扁平数组中，
+    // 再各区间并行地生成报告。结果与逐个区间顺序计算的完全相同。
+    struct Sample {
+        int train;    // trains中的下标
+        int secs;
+        TrainLine::IntervalAttachType att;
+    };
+    std::vector<decltype(res.begin())> slots;
+    std::unordered_map<const RailInterval*, int> slot_index;
+    slots.reserve(res.size());
+    for (auto p = res.begin(); p != res.end(); ++p) {
+        slot_index.emplace(p->first.get(), static_cast<int>(slots.size()));
+        slots.push_back(p);
+    }
+    std::vector<std::vector<Sample>> samples(slots.size());
+
+    for (int t = 0; t < trains.size(); t++) {
+        const auto& train = trains.at(t);
         auto adp = train->adapterFor(*railway);
         if (!adp)continue;
         foreach(auto line, adp->lines()) {
@@ -773,28 +1001,37 @@ ReadRulerReport Diagram::rulerFromMultiTrains(std::shared_ptr<Railway> railway,
                     p->railStation.lock()) {
                     // pr->p是合法的区间
                     auto it = pr->railStation.lock()->dirNextInterval(line->dir());
-                    if ((itr = res.find(it)) != res.end()) {
+                    if (auto itr = slot_index.find(it.get()); itr != slot_index.end()) {
                         //此区间是要计算的区间
+                        auto& lst = samples[itr->second];
+                        // 同一车次只取第一次经过的数据；同一车次的数据在数组中是连续的
+                        if (!lst.empty() && lst.back().train == t)
+                            continue;
                         int secs = qeutil::secsTo(pr->trainStation->depart,
                             p->trainStation->arrive);
                         auto att = line->getIntervalAttachType(pr, p);
-                        itr->second.raw.emplace(train, std::make_pair(secs, att));
+                        lst.push_back(Sample{ t, secs, att });
                     }
                 }
             }
         }
     }
 
-    for (auto p = res.begin(); p != res.end(); ++p) {
-        __intervalFt(p->second);
+    // 各区间互不相关，只写各自的报告
+    qeutil::parallelFor(static_cast<int>(slots.size()), [&](int i) {
+        auto& rep = slots[i]->second;
+        for (const auto& sp : samples[i]) {
+            rep.raw.emplace(trains.at(sp.train), std::make_pair(sp.secs, sp.att));
+        }
+        __intervalFt(rep);
         if (useAverage) {
-            __intervalRulerMean(p->second, defaultStart, defaultStop, 
+            __intervalRulerMean(rep, defaultStart, defaultStop, 
                 prec, cutStd, cutSec, cutCount);
         }
         else {
-            __intervalRulerMode(p->second, defaultStart, defaultStop, prec, cutCount);
+            __intervalRulerMode(rep, defaultStart, defaultStop, prec, cutCount);
         }
-    }
+        });
     return res;
 }
 
@@ -811,14 +1048,68 @@ QVector<int> Diagram::pageIndexWithRail(std::shared_ptr<const Railway> railway)c
 
 void Diagram::bindAllTrains()
 {
-    foreach(auto t, _trainCollection.trains()) {
+    bindTrainsParallel(false);
+}
+
+void Diagram::bindTrainsParallel(bool clearFirst)
+{
+    const auto& trains = _trainCollection.trains();
+    const auto rails = railways();    // copy: the list is not modified during binding
+    const int n = trains.size();
+
+    // 每个车次一个结果槽位，工作线程只写自己的槽位
+    std::vector<QVector<std::shared_ptr<TrainAdapter>>> adapters(n);
+    std::vector<std::deque<PaintIssue>> issues(n);
+
+    qeutil::parallelFor(n, [&](int i) {
+        IssueManager::Collector collector;
+        const auto& t = trains.at(i);
+        auto& res = adapters[i];
         if (t->paths().empty()) {
-            foreach(auto p, railways()) {
-                t->bindToRailway(p, _config);
+            for (const auto& rail : rails) {
+                if (!clearFirst) {
+                    // 与bindToRailway()一致：已经绑定的线路不再重复绑定
+                    bool bound = std::any_of(t->adapters().cbegin(), t->adapters().cend(),
+                        [&rail](const auto& adp) {return adp->railway() == rail; });
+                    if (bound) continue;
+                }
+                auto adp = std::make_shared<TrainAdapter>(t, rail, _config);
+                if (!adp->isNull()) {
+                    res.append(adp);
+                }
             }
         }
         else {
-            t->bindWithPath();
+            for (const auto* path : t->paths()) {
+                res.append(TrainAdapter::adaptersByPath(t, path));
+            }
+        }
+        issues[i] = collector.takeIssues();
+        });
+
+    // 提交：只在调用线程中修改列车对象和IssueManager
+    auto* manager = IssueManager::get();
+    std::deque<PaintIssue> all_issues;
+    for (int i = 0; i < n; i++) {
+        const auto& t = trains.at(i);
+        if (t->paths().empty() && !clearFirst) {
+            t->adapters().append(std::move(adapters[i]));
+        }
+        else {
+            if (!t->paths().empty()) {
+                manager->clearIssuesForTrain(t.get());
+            }
+            t->adapters() = std::move(adapters[i]);
+        }
+        t->invalidateTempData();
+        std::move(issues[i].begin(), issues[i].end(), std::back_inserter(all_issues));
+    }
+    manager->commitIssues(std::move(all_issues));
+
+    if (clearFirst) {
+        // all trains are now bound to the current station objects
+        for (const auto& rail : rails) {
+            rail->clearPendingChange();
         }
     }
 }
@@ -1047,8 +1338,21 @@ bool Diagram::fromTrc(QTextStream& fin)
 
 void Diagram::__intervalFt(readruler::IntervalReport& itrep)
 {
+    // 按类型收集到数组，排序后按游程计数，依次追加到频数表末尾，
+    // 代替逐个数据在map中查找插入
+    std::map<TrainLine::IntervalAttachType, std::vector<int>> values;
     for (auto p = itrep.raw.begin(); p != itrep.raw.end(); ++p) {
-        itrep.types[p->second.second].count[p->second.first]++;
+        values[p->second.second].push_back(p->second.first);
+    }
+    for (auto& [tp, lst] : values) {
+        std::sort(lst.begin(), lst.end());
+        auto& cnt = itrep.types[tp].count;
+        for (size_t i = 0; i < lst.size();) {
+            size_t j = i + 1;
+            while (j < lst.size() && lst[j] == lst[i]) j++;
+            cnt.emplace_hint(cnt.end(), lst[i], static_cast<int>(j - i));
+            i = j;
+        }
     }
 }
 
@@ -1163,10 +1467,16 @@ void Diagram::__intervalRulerMean(readruler::IntervalReport& itrep,
         // 注意：IntervalTypeReport是天然按照数值排列的
         auto& tpcnt = tp->second.count;
         if (cutSec) {
+            // 只用到均值，维护数据量与总和（整数，精确），每次剔除O(1)；
+            // 与moment()的均值逐位相同
+            qint64 n = readruler::typeCount(tpcnt), sum = 0;
+            for (const auto& [v, c] : tpcnt) sum += static_cast<qint64>(v) * c;
             while (tpcnt.size() > 1) {
-                auto [ave, sigma] = readruler::moment(tpcnt);
+                double ave = static_cast<double>(sum) / n;
                 auto f = readruler::furthest(tpcnt, ave);
                 if (std::abs(f->first - ave) > cutSec) {
+                    n -= f->second;
+                    sum -= static_cast<qint64>(f->first) * f->second;
                     tpcnt.erase(f);
                 }
                 else break;
@@ -1615,6 +1925,7 @@ void Diagram::clear()
     _pages.clear();
     _trainCollection.clear(_defaultManager);
     railways().clear();
+    stationIndexCache().clear();
     pathCollection().clear();
     _config = _defaultConfig;
     _config.transparent_config = SystemJson::instance.transparent_config;
@@ -1,6 +1,8 @@
 ﻿#pragma once
 
 #include <memory>
+#include <atomic>
+#include <functional>
 #include <QList>
 #include <QString>
 #include "config.h"
@@ -9,10 +11,12 @@
 #include "data/rail/railcategory.h"
 #include "data/calculation/railwaystationeventaxis.h"
 #include "data/trainpath/trainpathcollection.h"
+#include "data/diagram/stationtrainindex.h"
 
 
 class Train;
 class Railway;
+struct RailwayChangeRange;
 struct TrainGap;
 class TrainFilterCore;
 class ITrainFilter;
@@ -77,6 +81,13 @@ class Diagram
     QList<std::shared_ptr<DiagramPage>> _pages;
     TrainPathCollection _pathcoll;
 
+    /**
+     * 车站-运行线倒排索引，用于车站事件等查询。
+     * 使用unique_ptr以保持Diagram可移动（内含mutex）。
+     */
+    mutable std::unique_ptr<StationTrainIndexCache> _stationIndex =
+        std::make_unique<StationTrainIndexCache>();
+
 public:
     Diagram() = default;
 
@@ -205,6 +216,8 @@ public:
      * 2023.08.21：新增更新列车径路判断。注意，每一次undo/redo之后都应该做这个判断。
      * 新增约束：此调用仅对线路修改（而非增删）有效。对于增删的情况，列车径路的更新须调用
      * TrainPathCollection::checkValidForRailway().
+     * 增量绑定。根据Railway::takePendingChange()给出的影响范围，
+     * 仅重新绑定运行线或时刻表与修改范围相关的车次；其他车次只更新车站指针。
      */
     void updateRailway(std::shared_ptr<Railway> r);
 
@@ -227,9 +240,17 @@ public:
      *    则第一站只列出出发时刻数据。
      * 4. 任何区间和停站时长都小于12小时。否则会干扰时刻前后判断。
      *    时刻前后的判断不依赖于前后文，只考虑当前：PBC下使得差值绝对值较小的理解。
+     * 由StationTrainIndex中的运行线时空包络筛选可能相交的运行线，不再两两遍历；
+     * 各运行线的事件表缓存在索引中，车次变化时只重算受影响的运行线。
      */
     TrainEventList listTrainEvents(const Train& train)const;
 
+    /**
+     * 批量版本，结果与trains一一对应。
+     * 先按线路并行计算尚无缓存的运行线事件表，再逐车次读取。
+     */
+    QVector<TrainEventList> listTrainEvents(const QList<std::shared_ptr<Train>>& trains)const;
+
     /**
      * 2021.10.23 新增按线路筛选，有两级，
      * 即Railway和Range。为空表示不筛选。
@@ -248,6 +269,24 @@ public:
         std::shared_ptr<Railway> railway, std::shared_ptr<RailStation> start,
         std::shared_ptr<RailStation> end)const;
 
+    /**
+     * diagnoseAllTrains()的回调：本块结果，已完成车次数，总车次数
+     */
+    using DiagnosisCallback = std::function<void(const DiagnosisList& partial, int done, int total)>;
+
+    /**
+     * 并行版本。车次分块交由工作线程计算（qeutil::parallelFor），
+     * 其他运行线由各线路StationTrainIndex的时空包络预先筛选。
+     * 每完成一块，调用onPartial（已加锁串行化，但在工作线程中调用）。
+     * cancelled被置位后，尚未开始的块不再计算，返回已完成的部分。
+     * 返回值按车次表顺序排列，与逐车次调用diagnoseTrain()的结果相同。
+     * 计算期间不得修改运行图。
+     */
+    DiagnosisList diagnoseAllTrains(
+        std::shared_ptr<Railway> railway, std::shared_ptr<RailStation> start,
+        std::shared_ptr<RailStation> end, const DiagnosisCallback& onPartial,
+        const std::atomic_bool* cancelled = nullptr)const;
+
 
     /**
      * 创建默认的运行图视图，即按顺序包含本线的所有线路
@@ -303,6 +342,7 @@ public:
     /**
      * 更新参数（最大跨越站数）时执行
      * 重新绑定所有列车与所有线路
+     * 改为并行绑定，see bindTrainsParallel()
      */
     void rebindAllTrains();
 
@@ -347,7 +387,9 @@ public:
 
     /**
      * 一次性获取所给线路的所有站事件表。
-     * 初版暂时是暴力调用`stationEvents`，但很明显这个可以优化。
+     * 以上单站查询改为从StationTrainIndex读取，只访问经过该站的运行线。
+     * 本函数则改为单遍扫描：每条运行线只遍历一次，将事件分发到各站（collectRailStationEvents），
+     * 再并行地对各站排序。
      */
     std::map<std::shared_ptr<RailStation>, RailStationEventList>
         stationEventsForRail(std::shared_ptr<Railway> railway)const;
@@ -357,11 +399,21 @@ public:
      * see also: stationEventsForRail
      * 算法基本一样，只是使用了子类，增加一项排序操作。
      * 此版本用于处理贪心排图。
+     * 同样改为单遍扫描，并行buildAxis()。
      */
     RailwayStationEventAxis
         stationEventAxisForRail(std::shared_ptr<Railway> railway, 
             const ITrainFilter& filter)const;
 
+    /**
+     * 线路各站事件表的指纹（StationTrainIndex::fingerprint()），
+     * 与railway->stations()一一对应。指纹不变的站，stationEvents()的结果不变，
+     * 供车站间隔等分析增量地只重算受车次修改影响的站。
+     */
+    std::vector<quint64>
+        stationEventFingerprints(std::shared_ptr<Railway> railway,
+            const ITrainFilter* filter = nullptr)const;
+
 #if 0
     /**
      * 2021.09.06
@@ -451,6 +503,49 @@ public:
 private:
     void bindAllTrains();
 
+    /**
+     * 并行绑定所有列车。
+     * 按列车划分任务：工作线程中只读列车和线路数据，生成各列车的Adapter（不修改列车对象）；
+     * 全部完成后，在调用线程中一次性提交到各列车，同时提交工作线程中产生的Issue。
+     * 线程数由SystemJson::worker_threads确定，为1时即顺序执行。
+     * @param clearFirst  是否先清除既有绑定（rebindAllTrains）；
+     * 否则保留列车在各线路的既有Adapter，只补充未绑定的线路（bindAllTrains）。
+     * 按径路绑定的列车总是重新绑定。
+     */
+    void bindTrainsParallel(bool clearFirst);
+
+    StationTrainIndexCache& stationIndexCache()const;
+
+    /**
+     * diagnoseTrain()的核心部分：诊断adp的各运行线，
+     * start, end均非空时按范围筛选
+     */
+    void diagnoseAdapter(DiagnosisList& res, const TrainAdapter& adp, const StationTrainIndex& index,
+        bool withIntMeet, std::shared_ptr<RailStation> start, std::shared_ptr<RailStation> end)const;
+
+    /**
+     * 单遍扫描所给线路上所有（通过筛选的）运行线，生成各站的事件表（未排序），
+     * 与railway->stations()一一对应。事件从pool分配，由调用者决定池的归属。
+     */
+    std::vector<RailStationEventList> collectRailStationEvents(std::shared_ptr<Railway> railway,
+        const ITrainFilter* filter, const std::shared_ptr<RailEventPool>& pool)const;
+
+    /**
+     * stationEvents()的核心部分，调用者负责锁定索引
+     */
+    RailStationEventList stationEventsFromIndex(const StationTrainIndex& index,
+        std::shared_ptr<const RailStation> st, const ITrainFilter* filter)const;
+
+    /**
+     * 增量绑定中，判断车次在线路上的绑定是否可能受修改影响：
+     * 既有运行线（按旧车站里程）与修改范围相交，或时刻表中含有修改涉及的站名，
+     * 或时刻表中可绑定到本线的各站的里程范围与修改范围相交
+     * （其间车站数的变化可能改变运行线按max_passed_stations的截断，见TrainAdapter::autoLines()）。
+     * adp为车次在该线路的既有Adapter，可以为空；rail为修改后的线路。
+     */
+    static bool isTrainAffected(const Train& train, const TrainAdapter* adp,
+        const Railway& rail, const RailwayChangeRange& range);
+
     void sectionTrainCount(std::map<std::shared_ptr<RailInterval>, int>& res,
         std::shared_ptr<TrainLine> line)const;
 
@@ -101,6 +101,14 @@ QJsonObject DiagramPage::toJson() const
     };
 }
 
+void DiagramPage::addItemMap(TrainLine* line, TrainItem* item)
+{
+    _itemMap.insert(line, item);
+    // 与TrainItem::expandItem的拾取范围一致
+    double radius = item->linePen().widthF() * std::max(_config.valid_width, 1) / 2;
+    _lineIndex.insert(line, item->linePath(), radius);
+}
+
 TrainItem* DiagramPage::getTrainItem(TrainLine* line)
 {
     if (_itemMap.contains(line))
@@ -110,16 +118,32 @@ TrainItem* DiagramPage::getTrainItem(TrainLine* line)
 
 TrainItem* DiagramPage::takeTrainItem(TrainLine* line)
 {
+    _lineIndex.remove(line);
     if (_itemMap.contains(line))
         return _itemMap.take(line);
     return nullptr;
 }
 
+TrainItem* DiagramPage::trainItemAt(const QPointF& pos, double tolerance)
+{
+    // 经_itemMap取TrainItem（持有运行线），不直接解引用索引中的指针
+    TrainItem* res = nullptr;
+    _lineIndex.lineAt(pos, tolerance, [this, &res](TrainLine* t) {
+        auto* item = _itemMap.value(t, nullptr);
+        if (!item || !item->trainLine()->show())
+            return false;
+        res = item;
+        return true;
+        });
+    return res;
+}
+
 void DiagramPage::clearTrainItems(const Train& train)
 {
     for (auto adp : train.adapters()) {
         for (auto p : adp->lines()) {
             _itemMap.remove(p.get());
+            _lineIndex.remove(p.get());
         }
     }
 }
@@ -127,6 +151,7 @@ void DiagramPage::clearTrainItems(const Train& train)
 void DiagramPage::clearAllItems()
 {
     _itemMap.clear();
+    _lineIndex.clear();
 }
 
 void DiagramPage::highlightTrainItems(const Train& train)
@@ -187,6 +212,7 @@ void DiagramPage::addForbidItem(const Forbid* forbid, Direction dir, QGraphicsRe
 void DiagramPage::clearGraphics()
 {
     _itemMap.clear();
+    _lineIndex.clear();
     _forbidDMap.clear();
     _forbidUMap.clear();
     _belowLabels.clear();
@@ -229,6 +255,7 @@ void DiagramPage::swap(DiagramPage& other)
     // Items
     SWAP(_startYs);
     SWAP(_itemMap);
+    SWAP(_lineIndex);
     SWAP(_forbidDMap);
     SWAP(_forbidUMap);
     SWAP(_overLabels);
@@ -8,6 +8,7 @@
 #include "data/train/train.h"
 #include "config.h"
 #include "data/diagram/routelinklayer.h"
+#include "data/diagram/trainlineindex.h"
 
 class Railway;
 class Diagram;
@@ -62,6 +63,11 @@ class DiagramPage
     QString _name;
     QString _note;
     QHash<TrainLine*, TrainItem*> _itemMap;
+
+    /**
+     * _itemMap中各运行线的空间索引，与_itemMap同步维护
+     */
+    TrainLineIndex _lineIndex;
     QHash<const Forbid*, QList<QGraphicsRectItem*>> _forbidDMap, _forbidUMap;   //天窗的item映射，分为上下行
     
     /**
@@ -108,7 +114,9 @@ public:
     QString& note() { return _note; }
     void setNote(const QString& n) { _note = n; }
 
-    auto& itemMap() { return _itemMap; }
+    /**
+     * 只读；增删经addItemMap()、takeTrainItem()等，以便同步维护_lineIndex
+     */
     const auto& itemMap()const { return _itemMap; }
 
     QString railNameString()const;
@@ -128,12 +136,20 @@ public:
     void fromJson(const QJsonObject& obj, Diagram& _diagram);
     QJsonObject toJson()const;
 
-    void addItemMap(TrainLine* line, TrainItem* item) {
-        _itemMap.insert(line, item);
-    }
+    /**
+     * 同时将运行线折线加入空间索引。item的运行线须已铺画。
+     */
+    void addItemMap(TrainLine* line, TrainItem* item);
 
     TrainItem* getTrainItem(TrainLine* line);
 
+    /**
+     * 由空间索引查找pos处（场景坐标）的运行线对应的TrainItem。
+     * 运行线拾取范围为其线宽（考虑Config::valid_width）再加tolerance；只考虑显示的运行线；
+     * 多条时取距离最近的。
+     */
+    TrainItem* trainItemAt(const QPointF& pos, double tolerance);
+
     TrainItem* takeTrainItem(TrainLine* line);
 
     void clearTrainItems(const Train& train);
@@ -0,0 +1,41 @@
+﻿#include "raileventpool.h"
+
+#include <new>
+#include <cstdint>
+
+std::shared_ptr<RailEventPool> RailEventPool::create()
+{
+    return std::make_shared<RailEventPool>(Tag{});
+}
+
+void* RailEventPool::allocate(std::size_t bytes, std::size_t align)
+{
+    if (align > __STDCPP_DEFAULT_NEW_ALIGNMENT__)
+        throw std::bad_alloc();
+
+    // 当前块的对齐调整
+    std::size_t pad = _cur ? (align - reinterpret_cast<std::uintptr_t>(_cur) % align) % align : 0;
+    if (!_cur || pad + bytes > _left) {
+        // 超过块大小的单独申请，不影响当前块的剩余部分
+        if (bytes > BLOCK_SIZE / 4) {
+            _blocks.emplace_back(new std::byte[bytes]);
+            _stats.bytesReserved += bytes;
+            _stats.bytesUsed += bytes;
+            _stats.allocations++;
+            _stats.blocks++;
+            return _blocks.back().get();
+        }
+        _blocks.emplace_back(new std::byte[BLOCK_SIZE]);
+        _cur = _blocks.back().get();
+        _left = BLOCK_SIZE;
+        pad = 0;
+        _stats.bytesReserved += BLOCK_SIZE;
+        _stats.blocks++;
+    }
+    void* res = _cur + pad;
+    _cur += pad + bytes;
+    _left -= pad + bytes;
+    _stats.bytesUsed += bytes;
+    _stats.allocations++;
+    return res;
+}
@@ -0,0 +1,109 @@
+﻿#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <QtGlobal>
+
+#include "trainevents.h"
+
+/**
+ * @brief The RailEventPool class
+ * RailStationEvent的分块内存池（arena）。
+ * 一次分析（例如生成一条线路的全部事件）中的车站事件从同一个池中顺序分配：
+ * 借助std::allocate_shared，控制块与事件对象一起放在池的内存块中，不再逐个调用全局分配器；
+ * 单个事件析构时不归还内存，整个池在最后一个事件析构后一次释放。
+ * 对外仍然是std::shared_ptr<RailStationEvent>，事件轴等既有接口不变。
+ * 分配器持有池的shared_ptr，因此池的生存期自动覆盖所有由其分配的事件。
+ * 池应由事件的持有者（例如一个RailwayStationEventAxis）长期持有并反复使用，
+ * 不宜每次少量分配都新建：否则每个池至少占一个块，且只要有一个事件存活就不能释放。
+ * 分配操作非线程安全：一个池只应在一个线程中分配；事件本身可以在任意线程中使用、析构。
+ */
+class RailEventPool
+{
+public:
+    struct Stats {
+        qint64 allocations = 0;     // 分配次数（每个事件一次）
+        qint64 bytesUsed = 0;       // 已分配的字节数
+        qint64 bytesReserved = 0;   // 向系统申请的字节数
+        int blocks = 0;
+    };
+
+    static constexpr std::size_t BLOCK_SIZE = 64 * 1024;
+
+private:
+    std::vector<std::unique_ptr<std::byte[]>> _blocks;
+    std::byte* _cur = nullptr;
+    std::size_t _left = 0;
+    Stats _stats;
+
+    struct Tag {};
+
+public:
+    explicit RailEventPool(Tag) {}
+    RailEventPool(const RailEventPool&) = delete;
+    RailEventPool& operator=(const RailEventPool&) = delete;
+
+    static std::shared_ptr<RailEventPool> create();
+
+    void* allocate(std::size_t bytes, std::size_t align);
+
+    const Stats& stats()const { return _stats; }
+
+    /**
+     * 在所给池中构造事件；pool为空时退化为std::make_shared
+     */
+    template <typename... Args>
+    static std::shared_ptr<RailStationEvent> makeEvent(const std::shared_ptr<RailEventPool>& pool,
+        Args&&... args);
+};
+
+
+/**
+ * 从RailEventPool分配内存的分配器，供std::allocate_shared使用。
+ * deallocate()为空操作，内存随池一起释放。
+ */
+template <typename T>
+class RailEventPoolAllocator
+{
+    template <typename U>
+    friend class RailEventPoolAllocator;
+
+    std::shared_ptr<RailEventPool> _pool;
+
+public:
+    using value_type = T;
+
+    explicit RailEventPoolAllocator(std::shared_ptr<RailEventPool> pool) :
+        _pool(std::move(pool)) {}
+
+    template <typename U>
+    RailEventPoolAllocator(const RailEventPoolAllocator<U>& other) :
+        _pool(other._pool) {}
+
+    T* allocate(std::size_t n) {
+        return static_cast<T*>(_pool->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, std::size_t) noexcept {}
+
+    template <typename U>
+    bool operator==(const RailEventPoolAllocator<U>& other)const { return _pool == other._pool; }
+
+    template <typename U>
+    bool operator!=(const RailEventPoolAllocator<U>& other)const { return _pool != other._pool; }
+};
+
+
+template <typename... Args>
+std::shared_ptr<RailStationEvent> RailEventPool::makeEvent(const std::shared_ptr<RailEventPool>& pool,
+    Args&&... args)
+{
+    if (pool) {
+        return std::allocate_shared<RailStationEvent>(RailEventPoolAllocator<RailStationEvent>(pool),
+            std::forward<Args>(args)...);
+    }
+    else {
+        return std::make_shared<RailStationEvent>(std::forward<Args>(args)...);
+    }
+}
@@ -0,0 +1,388 @@
+﻿#include "stationtrainindex.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "data/rail/railway.h"
+#include "data/train/train.h"
+#include "data/train/traincollection.h"
+#include "data/train/itrainfilter.h"
+#include "trainadapter.h"
+#include "util/utilfunc.h"
+#include "util/qeparallel.h"
+#include "trainline.h"
+
+namespace {
+constexpr int SECS_OF_DAY = 24 * 3600;
+}
+
+void StationTrainIndex::refresh(std::shared_ptr<const Railway> railway, const TrainCollection& coll)
+{
+    if (_railway.lock() != railway) {
+        clear();
+        _railway = railway;
+    }
+    // 线路的车站或纵坐标有变化时，既有的包络和事件表都不再可靠，整体重建
+    if (auto sig = railSignature(*railway); sig != _railSignature) {
+        clear();
+        _railway = railway;
+        _railSignature = std::move(sig);
+    }
+    // 自上次同步以来没有车次被编辑，车次表也没有增删：索引已是最新的
+    const quint64 latest = Train::latestEditVersion();
+    if (_syncedColl == &coll && _syncedVersion == latest && _syncedCount == coll.trainCount())
+        return;
+    ++_round;
+
+    // 线路车站序号，仅在有车次需要重建时生成
+    std::unordered_map<const RailStation*, int> rail_index;
+    auto ensure_index = [&rail_index, &railway]() {
+        if (!rail_index.empty()) return;
+        const auto& stations = railway->stations();
+        rail_index.reserve(stations.size());
+        for (int i = 0; i < stations.size(); i++) {
+            rail_index.emplace(stations.at(i).get(), i);
+        }
+    };
+
+    // 只比较编辑版本，不读取未变化车次的Adapter和时刻表
+    for (const auto& train : coll.trains()) {
+        auto itr = _trains.find(train.get());
+        if (itr != _trains.end()) {
+            if (itr->second.version == train->editVersion()) {
+                itr->second.round = _round;
+                continue;
+            }
+            removeTrain(train.get(), itr->second);
+            _trains.erase(itr);
+        }
+        // 不在本线的车次也记录版本，以免每次同步都检查其Adapter
+        auto& rec = _trains[train.get()];
+        rec.version = train->editVersion();
+        rec.round = _round;
+        rec.generation = ++_generation;
+        for (const auto& adp : train->adapters()) {
+            if (adp->isInSameRailway(railway) && !adp->isNull()) {
+                ensure_index();
+                addAdapter(train.get(), *adp, rec, rail_index);
+            }
+        }
+    }
+
+    // 已经删除的车次
+    for (auto itr = _trains.begin(); itr != _trains.end();) {
+        if (itr->second.round != _round) {
+            removeTrain(itr->first, itr->second);
+            itr = _trains.erase(itr);
+        }
+        else ++itr;
+    }
+
+    if (_envelopeDirty)
+        sortEnvelopes();
+    _syncedColl = &coll;
+    _syncedVersion = latest;
+    _syncedCount = coll.trainCount();
+}
+
+const std::vector<StationTrainIndex::Entry>& StationTrainIndex::entries(const RailStation* st) const
+{
+    static const std::vector<Entry> empty;
+    auto itr = _entries.find(st);
+    return itr == _entries.end() ? empty : itr->second;
+}
+
+quint64 StationTrainIndex::fingerprint(const RailStation* st, const ITrainFilter* filter) const
+{
+    // 各项混合后求和，与运行线在表中的顺序无关；项数一并计入
+    quint64 res = 0, count = 0;
+    for (const auto& e : entries(st)) {
+        if (filter && !filter->check(e.line->train())) continue;
+        auto itr = _trains.find(e.train);
+        quint64 gen = itr == _trains.end() ? 0 : itr->second.generation;
+        res += qeutil::mix64(reinterpret_cast<quintptr>(e.line.get()) ^ qeutil::mix64(gen));
+        count++;
+    }
+    return qeutil::mix64(res ^ qeutil::mix64(count));
+}
+
+void StationTrainIndex::clear()
+{
+    _railway.reset();
+    _entries.clear();
+    _trains.clear();
+    _envelopes.clear();
+    _longEnvelopes.clear();
+    _maxShortSpan = 0;
+    _envelopeDirty = false;
+    _touched.clear();
+    _lineEvents.clear();
+    _railSignature.clear();
+    _syncedColl = nullptr;
+    _syncedVersion = 0;
+    _syncedCount = 0;
+}
+
+void StationTrainIndex::removeTrain(const Train* train, TrainRecord& rec)
+{
+    for (const auto* st : rec.stations) {
+        auto itr = _entries.find(st);
+        if (itr == _entries.end()) continue;   // already removed (duplicated station)
+        auto& lst = itr->second;
+        lst.erase(std::remove_if(lst.begin(), lst.end(),
+            [train](const Entry& e) {return e.train == train; }), lst.end());
+        if (lst.empty()) {
+            _entries.erase(itr);
+        }
+    }
+    rec.stations.clear();
+    // 包络在sortEnvelopes()中统一清理，避免逐车次扫描
+    _envelopeDirty = true;
+}
+
+void StationTrainIndex::addAdapter(const Train* train, const TrainAdapter& adp, TrainRecord& rec,
+    const std::unordered_map<const RailStation*, int>& railIndex)
+{
+    auto railway = _railway.lock();
+    const auto& stations = railway->stations();
+    std::unordered_map<int, const AdapterStation*> bound;
+    for (const auto& line : adp.lines()) {
+        if (line->isNull()) continue;
+
+        auto env = envelopeOf(*line);
+        env.line = line;
+        env.train = train;
+        env.generation = rec.generation;
+        env.seq = rec.lineCount++;
+        _touched.push_back(env);
+        _lineEvents[line.get()].reset();
+        if (env.span > LONG_SPAN)
+            _longEnvelopes.push_back(std::move(env));
+        else
+            _envelopes.push_back(std::move(env));
+        _envelopeDirty = true;
+
+        bound.clear();
+        for (const auto& ast : line->stations()) {
+            auto itr = railIndex.find(ast.railStation.lock().get());
+            if (itr != railIndex.end()) {
+                bound.emplace(itr->second, &ast);
+            }
+        }
+        auto first = railIndex.find(line->firstRailStation().get());
+        auto last = railIndex.find(line->lastRailStation().get());
+        if (first == railIndex.end() || last == railIndex.end())
+            continue;   // not bound to the current stations (should not happen)
+        int lo = std::min(first->second, last->second), hi = std::max(first->second, last->second);
+        for (int i = lo; i <= hi; i++) {
+            const RailStation* st = stations.at(i).get();
+            auto b = bound.find(i);
+            _entries[st].push_back(Entry{ line, b == bound.end() ? nullptr : b->second, train });
+            rec.stations.push_back(st);
+        }
+    }
+}
+
+void StationTrainIndex::overlappingLines(const TrainLine& line,
+    std::vector<const LineEnvelope*>& out) const
+{
+    out.clear();
+    if (line.isNull())
+        return;
+    overlappingLines(envelopeOf(line), &line, out);
+}
+
+void StationTrainIndex::overlappingLines(const LineEnvelope& q, const TrainLine* self,
+    std::vector<const LineEnvelope*>& out) const
+{
+    auto check = [&q, self, &out](const LineEnvelope& e) {
+        if (e.line.get() == self)
+            return;
+        // 与TrainLine::eventsWithSameDir()等的提前终止条件一致
+        if (std::max(q.yMin, e.yMin) >= std::min(q.yMax, e.yMax))
+            return;
+        if (!timeOverlapped(q, e))
+            return;
+        out.push_back(&e);
+    };
+
+    for (const auto& e : _longEnvelopes) {
+        check(e);
+    }
+
+    // 可能相交的短运行线，其起始时刻必在[q.start - maxShortSpan, q.start + q.span]（环形）内
+    if (q.span + _maxShortSpan + 1 >= SECS_OF_DAY) {
+        for (const auto& e : _envelopes) {
+            check(e);
+        }
+        return;
+    }
+    auto cmp_lower = [](const LineEnvelope& e, int t) {return e.start < t; };
+    auto cmp_upper = [](int t, const LineEnvelope& e) {return t < e.start; };
+    auto scan = [&](int lo, int hi) {
+        auto first = std::lower_bound(_envelopes.begin(), _envelopes.end(), lo, cmp_lower);
+        auto last = std::upper_bound(first, _envelopes.end(), hi, cmp_upper);
+        for (auto itr = first; itr != last; ++itr) {
+            check(*itr);
+        }
+    };
+    // 1秒余量：推定事件的时刻精确到毫秒
+    int lo = q.start - _maxShortSpan - 1, hi = q.start + q.span + 1;
+    if (lo < 0) {
+        scan(lo + SECS_OF_DAY, SECS_OF_DAY);
+        scan(0, hi);
+    }
+    else if (hi >= SECS_OF_DAY) {
+        scan(lo, SECS_OF_DAY);
+        scan(0, hi - SECS_OF_DAY);
+    }
+    else {
+        scan(lo, hi);
+    }
+}
+
+void StationTrainIndex::sortEnvelopes()
+{
+    // 清除已删除或已重建的车次的包络及事件表；过期的包络暂存于_touched
+    auto stale = [this](const LineEnvelope& e) {
+        auto itr = _trains.find(e.train);
+        return itr == _trains.end() || itr->second.generation != e.generation;
+    };
+    auto drop = [this, &stale](std::vector<LineEnvelope>& lst) {
+        auto mid = std::partition(lst.begin(), lst.end(),
+            [&stale](const LineEnvelope& e) {return !stale(e); });
+        for (auto itr = mid; itr != lst.end(); ++itr) {
+            _lineEvents.erase(itr->line.get());
+            _touched.push_back(std::move(*itr));
+        }
+        lst.erase(mid, lst.end());
+    };
+    drop(_envelopes);
+    drop(_longEnvelopes);
+    // 原地修改的运行线（对象不变），上面会误删其新的表项，这里补回
+    for (const auto& e : _touched) {
+        if (!stale(e))
+            _lineEvents[e.line.get()].reset();
+    }
+
+    std::sort(_envelopes.begin(), _envelopes.end(),
+        [](const LineEnvelope& a, const LineEnvelope& b) {return a.start < b.start; });
+    _maxShortSpan = 0;
+    for (const auto& e : _envelopes) {
+        _maxShortSpan = std::max(_maxShortSpan, e.span);
+    }
+    _envelopeDirty = false;
+
+    // 与变化车次的新旧包络相交的运行线，事件表失效
+    for (const auto& e : _touched) {
+        invalidateLineEvents(e);
+    }
+    _touched.clear();
+}
+
+void StationTrainIndex::invalidateLineEvents(const LineEnvelope& env)
+{
+    if (auto itr = _lineEvents.find(env.line.get()); itr != _lineEvents.end())
+        itr->second.reset();
+    std::vector<const LineEnvelope*> lst;
+    overlappingLines(env, env.line.get(), lst);
+    for (const auto* e : lst) {
+        if (auto itr = _lineEvents.find(e->line.get()); itr != _lineEvents.end())
+            itr->second.reset();
+    }
+}
+
+LineEventList StationTrainIndex::lineEvents(const TrainLine& line, const TrainCollection& coll)
+{
+    auto itr = _lineEvents.find(&line);
+    if (itr == _lineEvents.end())
+        return line.listLineEvents(coll, *this);
+    if (!itr->second)
+        itr->second = line.listLineEvents(coll, *this);
+    return *itr->second;
+}
+
+void StationTrainIndex::prepareLineEvents(const std::vector<const TrainLine*>& lines,
+    const TrainCollection& coll)
+{
+    std::vector<const TrainLine*> todo;
+    std::vector<std::optional<LineEventList>*> slots;
+    for (const auto* line : lines) {
+        auto itr = _lineEvents.find(line);
+        if (itr != _lineEvents.end() && !itr->second) {
+            itr->second.emplace();   // 占位，同时排除重复的运行线
+            todo.push_back(line);
+            slots.push_back(&itr->second);
+        }
+    }
+    try {
+        qeutil::parallelFor(static_cast<int>(todo.size()), [&](int i) {
+            *slots[i] = todo[i]->listLineEvents(coll, *this);
+            });
+    }
+    catch (...) {
+        // 不能确定哪些已经完成，全部作废
+        for (auto* p : slots) p->reset();
+        throw;
+    }
+}
+
+std::vector<std::pair<const RailStation*, std::optional<double>>>
+StationTrainIndex::railSignature(const Railway& railway)
+{
+    std::vector<std::pair<const RailStation*, std::optional<double>>> res;
+    const auto& stations = railway.stations();
+    res.reserve(stations.size());
+    for (const auto& st : stations) {
+        res.emplace_back(st.get(), st->y_coeff);
+    }
+    return res;
+}
+
+StationTrainIndex::LineEnvelope StationTrainIndex::envelopeOf(const TrainLine& line)
+{
+    LineEnvelope env{ nullptr, nullptr, 0, 0,
+        -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity(), 0, 0 };
+    const auto& y0 = line.firstRailStation()->y_coeff;
+    const auto& y1 = line.lastRailStation()->y_coeff;
+    if (y0.has_value() && y1.has_value()) {
+        env.yMin = std::min(*y0, *y1);
+        env.yMax = std::max(*y0, *y1);
+    }
+    const QTime& tm0 = line.firstStation()->trainStation->arrive;
+    const QTime& tm1 = line.lastStation()->trainStation->depart;
+    env.start = tm0.msecsSinceStartOfDay() / 1000;
+    env.span = qeutil::secsTo(tm0, tm1);
+    return env;
+}
+
+bool StationTrainIndex::timeOverlapped(const LineEnvelope& a, const LineEnvelope& b)
+{
+    // 超过半天的运行线，事件判断中的跨日比较（见TrainLine::xComp()）不再可靠，不做筛选
+    constexpr int half_day = SECS_OF_DAY / 2;
+    if (a.span > half_day || b.span > half_day)
+        return true;
+    int d = b.start - a.start;
+    if (d < 0) d += SECS_OF_DAY;
+    // 1秒余量，同overlappingLines()
+    return d <= a.span + 1 || SECS_OF_DAY - d <= b.span + 1;
+}
+
+StationTrainIndex& StationTrainIndexCache::indexFor(std::shared_ptr<const Railway> railway,
+    const TrainCollection& coll)
+{
+    // 清理已删除线路的索引
+    for (auto itr = _indexes.begin(); itr != _indexes.end();) {
+        if (itr->first != railway.get() && itr->second.expired())
+            itr = _indexes.erase(itr);
+        else ++itr;
+    }
+    auto& index = _indexes[railway.get()];
+    index.refresh(railway, coll);
+    return index;
+}
+
+void StationTrainIndexCache::clear()
+{
+    _indexes.clear();
+}
@@ -0,0 +1,198 @@
+﻿#pragma once
+
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <optional>
+#include <QtGlobal>
+
+#include "trainevents.h"
+
+class Railway;
+class RailStation;
+class Train;
+class TrainLine;
+class TrainAdapter;
+class TrainCollection;
+class ITrainFilter;
+struct AdapterStation;
+
+/**
+ * @brief The StationTrainIndex class
+ * 单条线路的车站-运行线倒排索引。
+ * 对线路的每个车站，记录里程范围覆盖该站的所有运行线（包括图定和推算通过），
+ * 以及运行线在该站绑定的AdapterStation（未绑定即推算通过的，为空）。
+ * 车站时刻表、车站事件表等查询由此直接读取，不必遍历所有车次。
+ * 按车次增量维护：每次查询前refresh()。车次的绑定、重新绑定以及编辑命令都会更新其编辑版本
+ * （Train::editVersion()），refresh()只重建版本有变化的车次；全局编辑计数器未变时直接返回。
+ * 同时维护各运行线的时空包络（纵坐标范围、时刻范围），
+ * 供运行线事件计算预先筛选可能相交的运行线，见overlappingLines()。
+ * 并缓存各运行线的事件表（运行线间的互作用表），见lineEvents()。
+ * 车次变化（包括不重新绑定的原地修改时刻）时，只清除该车次以及与其新旧包络相交的运行线的事件表。
+ * 线路车站或纵坐标变化时，整个索引重建。
+ */
+class StationTrainIndex
+{
+public:
+    struct Entry {
+        std::shared_ptr<TrainLine> line;
+        const AdapterStation* station;
+        const Train* train;
+    };
+
+    /**
+     * 运行线的时空包络。时刻以秒计，从start起（首站到达）向后span秒（末站出发），可跨日。
+     * seq为运行线在本车次（本线）中的顺序；generation用于识别已经过期的包络。
+     */
+    struct LineEnvelope {
+        std::shared_ptr<TrainLine> line;
+        const Train* train;
+        quint64 generation;
+        int seq;
+        double yMin, yMax;
+        int start, span;
+    };
+
+    /**
+     * 时长超过此值的运行线单独存放，查询时逐个检查，以免放宽按时刻检索的窗口。
+     */
+    static constexpr int LONG_SPAN = 4 * 3600;
+
+private:
+    struct TrainRecord {
+        // 建立记录时车次的编辑版本（Train::editVersion()）
+        quint64 version = 0;
+        std::vector<const RailStation*> stations;
+        int round = 0;
+        quint64 generation = 0;
+        int lineCount = 0;
+    };
+
+    std::weak_ptr<const Railway> _railway;
+    std::unordered_map<const RailStation*, std::vector<Entry>> _entries;
+    std::unordered_map<const Train*, TrainRecord> _trains;
+    int _round = 0;
+    quint64 _generation = 0;
+
+    /**
+     * 上次同步时的车次表、全局编辑计数器（Train::latestEditVersion()）及车次数
+     */
+    const TrainCollection* _syncedColl = nullptr;
+    quint64 _syncedVersion = 0;
+    int _syncedCount = 0;
+
+    /**
+     * 时长不超过LONG_SPAN的运行线包络，refresh()结束时按start排序；
+     * 其余的在_longEnvelopes中，无序。
+     */
+    std::vector<LineEnvelope> _envelopes, _longEnvelopes;
+    int _maxShortSpan = 0;
+    bool _envelopeDirty = false;
+
+    /**
+     * 本轮新增的包络，在sortEnvelopes()中与过期的包络一起用于清除受影响的事件表
+     */
+    std::vector<LineEnvelope> _touched;
+
+    /**
+     * 索引中每条运行线都有一项；事件表尚未计算或已失效的为空
+     */
+    std::unordered_map<const TrainLine*, std::optional<LineEventList>> _lineEvents;
+
+    /**
+     * 建立索引时的线路车站及纵坐标，用于发现线路的修改
+     */
+    std::vector<std::pair<const RailStation*, std::optional<double>>> _railSignature;
+
+public:
+    /**
+     * 与当前列车绑定数据同步。调用者负责加锁（见StationTrainIndexCache）。
+     */
+    void refresh(std::shared_ptr<const Railway> railway, const TrainCollection& coll);
+
+    /**
+     * 覆盖所给车站的运行线。无序。
+     */
+    const std::vector<Entry>& entries(const RailStation* st)const;
+
+    /**
+     * 列出时空包络与line相交的运行线（不含line本身），即纵坐标范围有重叠、且时刻范围有交集的。
+     * 纵坐标的判据与TrainLine::eventsWithSameDir()等的提前终止条件相同；
+     * 时刻范围按跨日的环形区间判断，时长超过半天的运行线不做时刻筛选。
+     * 包络不相交的运行线之间不会产生事件，因此结果可直接用于事件计算。
+     * 结果按时刻检索的顺序给出，不保证与车次顺序一致。
+     */
+    void overlappingLines(const TrainLine& line, std::vector<const LineEnvelope*>& out)const;
+
+    /**
+     * 运行线的事件表，即TrainLine::listLineEvents()的结果；有缓存的直接返回，否则计算并缓存。
+     * coll须为refresh()时所用的车次表。不在本索引中的运行线，直接计算，不缓存。
+     */
+    LineEventList lineEvents(const TrainLine& line, const TrainCollection& coll);
+
+    /**
+     * 并行计算所给运行线中尚无缓存的事件表，供批量查询使用。
+     */
+    void prepareLineEvents(const std::vector<const TrainLine*>& lines, const TrainCollection& coll);
+
+    /**
+     * 车站事件表的指纹：由覆盖该站的（通过筛选的）运行线及其车次在索引中的版本生成，与顺序无关。
+     * 车次的版本（TrainRecord::generation）在其编辑版本变化（重新绑定、始发终到站变化以及原地修改时刻等）后更新。
+     * 两次查询指纹相同，则该站的事件表（Diagram::stationEvents()）相同，供增量分析判断是否需要重算。
+     * 车站本身的属性（如单双线）不在其中，由调用者另行比较。filter为空表示不筛选。
+     */
+    quint64 fingerprint(const RailStation* st, const ITrainFilter* filter)const;
+
+    void clear();
+
+    /**
+     * 所属线路已经析构
+     */
+    bool expired()const { return _railway.expired(); }
+
+private:
+    void removeTrain(const Train* train, TrainRecord& rec);
+
+    void addAdapter(const Train* train, const TrainAdapter& adp, TrainRecord& rec,
+        const std::unordered_map<const RailStation*, int>& railIndex);
+
+    void sortEnvelopes();
+
+    void overlappingLines(const LineEnvelope& q, const TrainLine* self,
+        std::vector<const LineEnvelope*>& out)const;
+
+    /**
+     * 清除与所给包络相交的运行线的事件表缓存
+     */
+    void invalidateLineEvents(const LineEnvelope& env);
+
+    static std::vector<std::pair<const RailStation*, std::optional<double>>>
+        railSignature(const Railway& railway);
+
+    /**
+     * 运行线的时空包络；line, train, seq由调用者填写。
+     * 未计算纵坐标的，纵坐标范围取为无穷大。
+     */
+    static LineEnvelope envelopeOf(const TrainLine& line);
+
+    static bool timeOverlapped(const LineEnvelope& a, const LineEnvelope& b);
+};
+
+/**
+ * 各线路的StationTrainIndex，由Diagram持有。
+ * 使用方式：先锁定mutex()，再调用indexFor()取得已同步的索引，在锁定期间读取。
+ */
+class StationTrainIndexCache
+{
+    std::mutex _mutex;
+    std::unordered_map<const Railway*, StationTrainIndex> _indexes;
+
+public:
+    std::mutex& mutex() { return _mutex; }
+
+    StationTrainIndex& indexFor(std::shared_ptr<const Railway> railway,
+        const TrainCollection& coll);
+
+    void clear();
+};
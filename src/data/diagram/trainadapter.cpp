@@ -1,5 +1,6 @@
 ﻿#include "trainadapter.h"
 #include <cassert>
+#include <atomic>
 
 //#include "kernel/trainitem.h"
 #include "util/utilfunc.h"
@@ -13,14 +14,14 @@
 
 TrainAdapter::TrainAdapter(std::weak_ptr<Train> train,
 	std::weak_ptr<Railway> railway) :
-	_railway(railway), _train(train)
+	_railway(railway), _train(train), _serial(nextSerial())
 {
 }
 
 
 TrainAdapter::TrainAdapter(std::weak_ptr<Train> train,
     std::weak_ptr<Railway> railway, const Config& config):
-    _railway(railway),_train(train)
+    _railway(railway),_train(train), _serial(nextSerial())
 {
 	autoLines(config);
 }
@@ -31,9 +32,23 @@ TrainAdapter& TrainAdapter::operator=(TrainAdapter&& another)noexcept
 	assert(&_railway == &(another._railway));
 	assert(&_train == &(another._train));
 	_lines = std::move(another._lines);
+	renewSerial();
 	return *this;
 }
 
+quint64 TrainAdapter::nextSerial()
+{
+	static std::atomic<quint64> serial{ 0 };
+	return ++serial;
+}
+
+void TrainAdapter::renewSerial()
+{
+	_serial = nextSerial();
+	if (auto t = _train.lock())
+		t->markEdited();
+}
+
 void TrainAdapter::print() const
 {
     qDebug() << "TrainAdapter: " << train()->trainName().full() << " @ " <<
@@ -46,10 +61,17 @@ void TrainAdapter::print() const
 
 void TrainAdapter::bindTrainByPath(std::shared_ptr<Train> train, const TrainPath* path)
 {
+	train->adapters().append(adaptersByPath(train, path));
+}
+
+QVector<std::shared_ptr<TrainAdapter>>
+	TrainAdapter::adaptersByPath(std::shared_ptr<Train> train, const TrainPath* path)
+{
+	QVector<std::shared_ptr<TrainAdapter>> res;
 	if (!path->valid()) {
 		qeIssueCritical(IssueInfo(IssueInfo::InvalidPath, train, {}, {}, QObject::tr("列车径路%1不可用，"
 			"此径路将被忽略").arg(path->name())));
-		return;
+		return res;
 	}
 
 	std::map<Railway*, std::shared_ptr<TrainAdapter>> adp_map;
@@ -132,9 +154,10 @@ void TrainAdapter::bindTrainByPath(std::shared_ptr<Train> train, const TrainPath
 	for (auto itr = adp_map.begin(); itr != adp_map.end(); ++itr) {
 		auto adp = itr->second;
 		if (!adp->isNull()) {
-			train->adapters().append(adp);
+			res.append(adp);
 		}
 	}
+	return res;
 }
 
 AdapterEventList TrainAdapter::listAdapterEvents(const TrainCollection& coll) const
@@ -148,6 +171,16 @@ AdapterEventList TrainAdapter::listAdapterEvents(const TrainCollection& coll) co
 	return res;
 }
 
+AdapterEventList TrainAdapter::listAdapterEvents(const TrainCollection& coll,
+	StationTrainIndex& index) const
+{
+	AdapterEventList res;
+	for (auto p : _lines) {
+		res.append(index.lineEvents(*p, coll));
+	}
+	return res;
+}
+
 const AdapterStation* TrainAdapter::lastStation() const
 {
 	if (_lines.empty())
@@ -252,6 +285,30 @@ int TrainAdapter::adapterStationCount() const
     return res;
 }
 
+bool TrainAdapter::remapRailStations(Railway& rail)
+{
+    // 先全部查找，成功以后再修改，保证失败时数据不变
+    std::vector<std::shared_ptr<RailStation>> mapped;
+    mapped.reserve(adapterStationCount());
+    for (const auto& line : _lines) {
+        for (const auto& st : line->stations()) {
+            auto old = st.railStation.lock();
+            if (!old) return false;
+            auto rs = rail.stationByName(old->name);
+            if (!rs) return false;
+            mapped.emplace_back(std::move(rs));
+        }
+    }
+    auto itr = mapped.begin();
+    for (auto& line : _lines) {
+        for (auto& st : line->stations()) {
+            st.railStation = *itr++;
+        }
+    }
+    renewSerial();
+    return true;
+}
+
 void TrainAdapter::timetableInterpolation(std::shared_ptr<const Ruler> ruler, 
 	bool toRailStart, bool toRailEnd, int prec)
 {
@@ -268,6 +325,7 @@ void TrainAdapter::timetableInterpolation(std::shared_ptr<const Ruler> ruler,
 		}
 		line->timetaleInterpolation(ruler, toBegin, toEnd, prec);
 	}
+	renewSerial();
 }
 
 double TrainAdapter::relativeError(std::shared_ptr<const Ruler> ruler) const
@@ -304,6 +362,7 @@ int TrainAdapter::timetableInterpolationSimple()
 	foreach(const auto & line, _lines) {
 		cnt += line->timetableInterpolationSimple();
 	}
+	renewSerial();
 	return cnt;
 }
 
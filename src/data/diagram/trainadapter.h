@@ -6,6 +6,7 @@
 #include "trainline.h"
 
 class TrainCollection;
+class StationTrainIndex;
 struct Config;
 class TrainPath;
 
@@ -28,6 +29,19 @@ class TrainAdapter
      */
     QVector<std::shared_ptr<TrainLine>> _lines;
 
+    /**
+     * 运行线数据的版本号，全局唯一。
+     * 构造及运行线数据修改时重新分配，用于StationTrainIndex判断是否需要更新。
+     */
+    quint64 _serial;
+
+    static quint64 nextSerial();
+
+    /**
+     * 运行线数据原地修改后调用：重新分配_serial，并更新车次的编辑版本（Train::markEdited()）
+     */
+    void renewSerial();
+
     /**
      * This version, not auto lines.
      */
@@ -69,6 +83,7 @@ public:
     std::shared_ptr<const Train> train()const { return _train.lock(); }
     inline auto& lines() { return _lines; }
     inline const auto& lines()const { return _lines; }
+    inline quint64 serial()const { return _serial; }
 
     inline bool isInSameRailway(const TrainAdapter& another)const {
         return _railway.lock() == another._railway.lock();
@@ -83,12 +98,27 @@ public:
      */
     static void bindTrainByPath(std::shared_ptr<Train> train, const TrainPath* path);
 
+    /**
+     * The core part of bindTrainByPath(): generate the adapters for the train
+     * according to the given path, but do NOT append them to the train.
+     * The train and railways are only read here, so this is safe to be called in worker threads
+     * (for different trains); issues are reported via the qeIssue* macros (see IssueManager::Collector).
+     */
+    static QVector<std::shared_ptr<TrainAdapter>>
+        adaptersByPath(std::shared_ptr<Train> train, const TrainPath* path);
+
     /**
      * @brief listAdapterEvents 列出本次列车在本线的事件表
      * 逐段运行线计算。实际上只是个转发
      */
     AdapterEventList listAdapterEvents(const TrainCollection& coll)const;
 
+    /**
+     * 从本线路的StationTrainIndex读取各运行线的事件表（有缓存的直接读取），
+     * 见StationTrainIndex::lineEvents()
+     */
+    AdapterEventList listAdapterEvents(const TrainCollection& coll, StationTrainIndex& index)const;
+
     /**
      * 返回最后一个绑定的车站。
      * 如果为空（应该不存在这种情况），返回空指针
@@ -135,6 +165,14 @@ public:
 
     int adapterStationCount()const;
 
+    /**
+     * 增量重新绑定使用。
+     * 线路基线数据交换（Railway::swapBaseWith）后，车站对象全部换新，
+     * 对于不受修改影响的运行线，将其中的车站指针按站名重新指向rail中的新对象。
+     * 如果有车站找不到（原对象已析构或新线路中不存在），返回false，此时应当整体重新绑定。
+     */
+    bool remapRailStations(Railway& rail);
+
     /**
      * 推定通过站时刻  pyETRC.data.Train.detectPassStation
      * precondition: 本次列车已经绑定到线路。
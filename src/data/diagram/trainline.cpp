@@ -6,9 +6,12 @@
 #include "data/train/train.h"
 #include "data/rail/rail.h"
 #include "util/utilfunc.h"
+#include "stationtrainindex.h"
+#include "raileventpool.h"
 
 #include <QDebug>
 #include <cmath>
+#include <algorithm>
 
 //I/O部分暂不实现
 #if 0
@@ -131,6 +134,59 @@ LineEventList TrainLine::listLineEvents(const TrainCollection& coll) const
     return res;
 }
 
+LineEventList TrainLine::listLineEvents(const TrainCollection& coll,
+    const StationTrainIndex& index) const
+{
+    LineEventList res;
+    res.reserve(static_cast<int>(_stations.size()));
+    for (size_t i = 0; i < _stations.size(); i++) {
+        res.push_back(StationEventList());
+    }
+
+    //车站到开时刻
+    listStationEvents(res);
+
+    //与其他列车的互作用：只考虑包络相交的运行线
+    forEachOverlappingLine(coll, index, [this, &res](const TrainLine& line, const Train& t) {
+        if (line.dir() == dir()) {
+            eventsWithSameDir(res, line, t);
+        }
+        else {
+            eventsWithCounter(res, line, t);
+        }
+        });
+    return res;
+}
+
+void TrainLine::forEachOverlappingLine(const TrainCollection& coll, const StationTrainIndex& index,
+    const std::function<void(const TrainLine&, const Train&)>& func) const
+{
+    std::vector<const StationTrainIndex::LineEnvelope*> cands;
+    index.overlappingLines(*this, cands);
+    std::unordered_map<const Train*, std::vector<const StationTrainIndex::LineEnvelope*>> by_train;
+    for (const auto* e : cands) {
+        if (e->train != train().get()) {
+            by_train[e->train].push_back(e);
+        }
+    }
+    if (by_train.empty())
+        return;
+
+    // 按车次表及运行线的顺序处理，同时刻事件的先后与原版本一致
+    for (const auto& t : coll.trains()) {
+        auto itr = by_train.find(t.get());
+        if (itr == by_train.end())
+            continue;
+        auto& lst = itr->second;
+        std::sort(lst.begin(), lst.end(), [](const auto* e1, const auto* e2) {
+            return e1->seq < e2->seq;
+            });
+        for (const auto* e : lst) {
+            func(*e->line, *t);
+        }
+    }
+}
+
 DiagnosisList TrainLine::diagnoseLine(const TrainCollection& coll, bool withIntMeet) const
 {
     Q_UNUSED(withIntMeet);
@@ -159,6 +215,25 @@ DiagnosisList TrainLine::diagnoseLine(const TrainCollection& coll, bool withIntM
     return res;
 }
 
+DiagnosisList TrainLine::diagnoseLine(const TrainCollection& coll, bool withIntMeet,
+    const StationTrainIndex& index) const
+{
+    Q_UNUSED(withIntMeet);
+    DiagnosisList res;
+
+    diagnoseSelf(res);
+
+    forEachOverlappingLine(coll, index, [this, &res](const TrainLine& line, const Train& t) {
+        if (line.dir() == dir()) {
+            diagnoWithSameDir(res, line, t);
+        }
+        else {
+            diagnoWithCounter(res, line, t);
+        }
+        });
+    return res;
+}
+
 int TrainLine::totalSecs() const
 {
     if (isNull())
@@ -1465,72 +1540,110 @@ RailStationEventList
     TrainLine::stationEventFromRail(std::shared_ptr<const RailStation> rail) const
 {
     if (isNull())return {};
-    auto last = std::prev(_stations.end());
     auto p = stationFromYCoeff(rail->y_coeff.value());   //运行方向区间后站
+    RailStationEventList res;
     if (p == _stations.end())
         return {};
     else if (p->railStation.lock() == rail) {
-        // 2021.09.09新增规则：运行线首站到达、末站出发不算进来
-        bool localFirst = (p == _stations.begin());
-        bool localLast = (p == last);
-        // 2022.03.12修改规则：多段运行线交接点的，出发算后段、到达算前段
-        // 实际上和普通运行线没区别了
-        //if (startLabel() || !localFirst) {
-        if (true || !localFirst) {
-            auto ts = p->trainStation;
-            if (ts->isStopped()) {
-                //只要有停车，一律按到达出发处理
-                RailStationEventList res;
-                if (!localFirst) {
-                    res.push_back(std::make_shared< RailStationEvent>(TrainEventType::Arrive, ts->arrive,
-                        p->railStation, shared_from_this(),
-                        dir() == Direction::Down ? RailStationEvent::Pre : RailStationEvent::Post,
-                        ts->note));
-                }
-                if (!localLast) {
-                    res.push_back(std::make_shared<RailStationEvent>(TrainEventType::Depart, ts->depart,
-                        p->railStation, shared_from_this(),
-                        dir() == Direction::Down ? RailStationEvent::Post : RailStationEvent::Pre,
-                        ts->note));
-                }
-                return res;
-            }
-            else if (isStartingStation(p)) {
-                //始发事件
-                return { std::make_shared<RailStationEvent>(TrainEventType::Origination,
-                    ts->depart,p->railStation,shared_from_this(),
-                    dir() == Direction::Down ? RailStationEvent::Post : RailStationEvent::Pre,ts->note) };
-            }
-            else if (isTerminalStation(p)) {
-                return { std::make_shared<RailStationEvent>(TrainEventType::Destination,
-                    ts->arrive,p->railStation,shared_from_this(),
-                    dir() == Direction::Down ? RailStationEvent::Pre : RailStationEvent::Post,ts->note) };
-            }
-            else {
-                //通过
-                return { std::make_shared<RailStationEvent>(TrainEventType::SettledPass,
-                    ts->arrive,p->railStation,shared_from_this(),
-                    passStationPos(p),ts->note) };
-            }
-        }
-
+        appendBoundStationEvents(res, p);
     }
     else if (p == _stations.begin())
         return {};
     else {
         //需要推定通过站时刻
-        auto p0 = std::prev(p);
-        double y0 = p0->yCoeff(), yn = p->yCoeff(), yi = rail->y_coeff.value();
-        double dsif = (qeutil::secsTo(p0->trainStation->depart,
-            p->trainStation->arrive)) * (yi - y0) / (yn - y0);
-        if (!std::isnan(dsif) && !std::isinf(dsif)) {
-            int dsi = int(std::round(dsif));
-            return { std::make_shared<RailStationEvent>(TrainEventType::CalculatedPass,
-                p0->trainStation->depart.addSecs(dsi), rail, shared_from_this(),
-                RailStationEvent::Both, QObject::tr("推算")) };
+        appendCalculatedPassEvent(res, std::prev(p), p, rail);
+    }
+    return res;
+}
+
+void TrainLine::collectStationEvents(const QList<std::shared_ptr<RailStation>>& railStations,
+    const std::unordered_map<const RailStation*, int>& railIndex,
+    std::vector<RailStationEventList>& buckets, const std::shared_ptr<RailEventPool>& pool) const
+{
+    int prev_idx = -1;
+    ConstAdaPtr prev = _stations.end();
+    for (auto p = _stations.begin(); p != _stations.end(); ++p) {
+        auto itr = railIndex.find(p->railStation.lock().get());
+        if (itr == railIndex.end())
+            continue;   // not bound to current stations (should not happen)
+        int idx = itr->second;
+        if (prev != _stations.end() && idx == prev_idx) {
+            // 同一车站连续绑定多次：与stationFromYCoeff()一致，事件只按第一次绑定生成；
+            // 但其后区间的推算通过以最后一次绑定为区间前站
+            prev = p;
+            continue;
         }
+        if (prev != _stations.end()) {
+            // 两绑定站之间的线路车站，推算通过
+            int lo = std::min(prev_idx, idx), hi = std::max(prev_idx, idx);
+            for (int k = lo + 1; k < hi; k++) {
+                const auto& rs = railStations.at(k);
+                if (rs->direction != PassedDirection::NoVia && rs->y_coeff.has_value())
+                    appendCalculatedPassEvent(buckets[k], prev, p, rs, pool);
+            }
+        }
+        appendBoundStationEvents(buckets[idx], p, pool);
+        prev = p;
+        prev_idx = idx;
+    }
+}
+
+void TrainLine::appendBoundStationEvents(RailStationEventList& res, ConstAdaPtr p,
+    const std::shared_ptr<RailEventPool>& pool) const
+{
+    auto last = std::prev(_stations.end());
+    // 2021.09.09新增规则：运行线首站到达、末站出发不算进来
+    bool localFirst = (p == _stations.begin());
+    bool localLast = (p == last);
+    // 2022.03.12修改规则：多段运行线交接点的，出发算后段、到达算前段
+    // 实际上和普通运行线没区别了
+    auto ts = p->trainStation;
+    if (ts->isStopped()) {
+        //只要有停车，一律按到达出发处理
+        if (!localFirst) {
+            res.push_back(RailEventPool::makeEvent(pool, TrainEventType::Arrive, ts->arrive,
+                p->railStation, shared_from_this(),
+                dir() == Direction::Down ? RailStationEvent::Pre : RailStationEvent::Post,
+                ts->note));
+        }
+        if (!localLast) {
+            res.push_back(RailEventPool::makeEvent(pool, TrainEventType::Depart, ts->depart,
+                p->railStation, shared_from_this(),
+                dir() == Direction::Down ? RailStationEvent::Post : RailStationEvent::Pre,
+                ts->note));
+        }
+    }
+    else if (isStartingStation(p)) {
+        //始发事件
+        res.push_back(RailEventPool::makeEvent(pool, TrainEventType::Origination,
+            ts->depart, p->railStation, shared_from_this(),
+            dir() == Direction::Down ? RailStationEvent::Post : RailStationEvent::Pre, ts->note));
+    }
+    else if (isTerminalStation(p)) {
+        res.push_back(RailEventPool::makeEvent(pool, TrainEventType::Destination,
+            ts->arrive, p->railStation, shared_from_this(),
+            dir() == Direction::Down ? RailStationEvent::Pre : RailStationEvent::Post, ts->note));
+    }
+    else {
+        //通过
+        res.push_back(RailEventPool::makeEvent(pool, TrainEventType::SettledPass,
+            ts->arrive, p->railStation, shared_from_this(),
+            passStationPos(p), ts->note));
+    }
+}
+
+void TrainLine::appendCalculatedPassEvent(RailStationEventList& res, ConstAdaPtr p0, ConstAdaPtr p,
+    std::shared_ptr<const RailStation> rail, const std::shared_ptr<RailEventPool>& pool) const
+{
+    double y0 = p0->yCoeff(), yn = p->yCoeff(), yi = rail->y_coeff.value();
+    double dsif = (qeutil::secsTo(p0->trainStation->depart,
+        p->trainStation->arrive)) * (yi - y0) / (yn - y0);
+    if (!std::isnan(dsif) && !std::isinf(dsif)) {
+        int dsi = int(std::round(dsif));
+        res.push_back(RailEventPool::makeEvent(pool, TrainEventType::CalculatedPass,
+            p0->trainStation->depart.addSecs(dsi), rail, shared_from_this(),
+            RailStationEvent::Both, QObject::tr("推算")));
     }
-    return {};
 }
 
 std::optional<QTime> TrainLine::sectionTime(double y) const
@@ -2,9 +2,12 @@
 
 #include <memory>
 #include <deque>
+#include <vector>
+#include <unordered_map>
 #include <optional>
 #include <tuple>
 #include <cstdint>
+#include <functional>
 #include <QPair>
 #include <QList>
 
@@ -39,6 +42,8 @@ bool operator<(double y, const AdapterStation& adp);
 
 
 class TrainCollection;
+class StationTrainIndex;
+class RailEventPool;
 
 
 /**
@@ -155,6 +160,12 @@ public:
      */
     LineEventList listLineEvents(const TrainCollection& coll)const;
 
+    /**
+     * 同上，但由index（本线路的StationTrainIndex，须已与coll同步）预先筛选出时空包络相交的运行线，
+     * 只对这些运行线逐对计算事件。结果与上一版本相同。
+     */
+    LineEventList listLineEvents(const TrainCollection& coll, const StationTrainIndex& index)const;
+
     /**
      * 列车运行情况诊断，判断可能存在的问题。
      * 采用和`listLineEvents`类似的框架。
@@ -162,6 +173,13 @@ public:
      */
     DiagnosisList diagnoseLine(const TrainCollection& coll, bool withIntMeet)const;
 
+    /**
+     * 同上，由index筛选相关运行线，见listLineEvents()的对应版本。
+     * 只读访问，可在工作线程中对不同运行线并行调用。
+     */
+    DiagnosisList diagnoseLine(const TrainCollection& coll, bool withIntMeet,
+        const StationTrainIndex& index)const;
+
     inline const AdapterStation* lastStation()const {
         return _stations.empty() ? nullptr : &(_stations.back());
     }
@@ -227,6 +245,18 @@ public:
     RailStationEventList
            stationEventFromRail(std::shared_ptr<const RailStation> rail)const;
 
+    /**
+     * 一次遍历，生成本运行线在所经过的全部线路车站的事件（含推算通过，但不含NoVia站），
+     * 追加到buckets中对应车站的表中。buckets与railStations一一对应，railIndex为车站到序号的映射。
+     * 结果与对每个车站调用stationEventFromRail()相同（未排序），但不需要逐站二分查找。
+     * 同一车站连续多次绑定的，与stationFromYCoeff()一致，只按第一次绑定生成事件。
+     * pool非空时，事件从该内存池分配，见RailEventPool。
+     */
+    void collectStationEvents(const QList<std::shared_ptr<RailStation>>& railStations,
+        const std::unordered_map<const RailStation*, int>& railIndex,
+        std::vector<RailStationEventList>& buckets,
+        const std::shared_ptr<RailEventPool>& pool = nullptr)const;
+
     /**
      * 计算通过指定纵坐标处的时刻；如果运行线不经过该点，返回空
      * 如果指定纵坐标恰好是某一车站，则以【左区间】为准，
@@ -306,6 +336,13 @@ private:
      */
     void listStationEvents(LineEventList& res)const;
 
+    /**
+     * 对index中与本运行线包络相交的其他车次的运行线，
+     * 按车次表及运行线的顺序调用func(运行线, 车次)，使结果次序与遍历全部车次时一致。
+     */
+    void forEachOverlappingLine(const TrainCollection& coll, const StationTrainIndex& index,
+        const std::function<void(const TrainLine&, const Train&)>& func)const;
+
     /**
      * @brief detectPassStations  推定区间通过站时刻
      * 注意通过站时刻放在左边那个站的StationEvent里面
@@ -484,6 +521,19 @@ private:
      */
     RailStationEvent::Position passStationPos(ConstAdaPtr st)const;
 
+    /**
+     * stationEventFromRail()的核心部分：st为绑定站，生成其图定事件
+     */
+    void appendBoundStationEvents(RailStationEventList& res, ConstAdaPtr st,
+        const std::shared_ptr<RailEventPool>& pool = nullptr)const;
+
+    /**
+     * 推定p0, p两绑定站之间的线路车站rail的通过事件
+     */
+    void appendCalculatedPassEvent(RailStationEventList& res, ConstAdaPtr p0, ConstAdaPtr p,
+        std::shared_ptr<const RailStation> rail,
+        const std::shared_ptr<RailEventPool>& pool = nullptr)const;
+
     /**
      * 单车次问题诊断，即自己时刻表直接能看出的问题
      * 停时过长以及天窗冲突
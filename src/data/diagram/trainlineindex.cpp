@@ -0,0 +1,226 @@
+﻿#include "trainlineindex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+/**
+ * 闭区间意义下的相交判断。水平或竖直线段的包围盒宽或高可能为0，不用QRectF::intersects()
+ */
+inline bool overlaps(const QRectF& a, const QRectF& b)
+{
+    return a.left() <= b.right() && a.right() >= b.left() &&
+        a.top() <= b.bottom() && a.bottom() >= b.top();
+}
+
+inline QRectF unite(const QRectF& a, const QRectF& b)
+{
+    return QRectF(QPointF(std::min(a.left(), b.left()), std::min(a.top(), b.top())),
+        QPointF(std::max(a.right(), b.right()), std::max(a.bottom(), b.bottom())));
+}
+
+double segmentDistance(const QPointF& p, const QPointF& a, const QPointF& b)
+{
+    const double dx = b.x() - a.x(), dy = b.y() - a.y();
+    const double len2 = dx * dx + dy * dy;
+    double t = len2 > 0 ? ((p.x() - a.x()) * dx + (p.y() - a.y()) * dy) / len2 : 0;
+    t = std::clamp(t, 0.0, 1.0);
+    return std::hypot(p.x() - a.x() - t * dx, p.y() - a.y() - t * dy);
+}
+
+/**
+ * STR（Sort-Tile-Recursive）排序：按包围盒中心先以横坐标分成若干竖条，条内再按纵坐标排序。
+ * 排序后每NODE_SIZE个连续元素组成一个结点。
+ */
+template <typename T>
+void strOrder(std::vector<T>& v)
+{
+    const size_t n = v.size();
+    const size_t nodes = (n + TrainLineIndex::NODE_SIZE - 1) / TrainLineIndex::NODE_SIZE;
+    const size_t slices = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(nodes))));
+    const size_t sliceSize = std::max<size_t>(slices, 1) * TrainLineIndex::NODE_SIZE;
+    std::sort(v.begin(), v.end(), [](const T& a, const T& b) {
+        return a.box.center().x() < b.box.center().x();
+        });
+    for (size_t i = 0; i < n; i += sliceSize) {
+        std::sort(v.begin() + i, v.begin() + std::min(n, i + sliceSize), [](const T& a, const T& b) {
+            return a.box.center().y() < b.box.center().y();
+            });
+    }
+}
+
+}
+
+void TrainLineIndex::insert(TrainLine* line, const QPainterPath& path, double radius)
+{
+    remove(line);
+    const int id = static_cast<int>(_infos.size());
+    int count = 0;
+    QPointF prev;
+    bool hasPrev = false;
+    for (int i = 0; i < path.elementCount(); i++) {
+        const auto& e = path.elementAt(i);
+        QPointF pt(e.x, e.y);
+        if (!e.isMoveTo() && hasPrev && pt != prev) {
+            QRectF box(QPointF(std::min(prev.x(), pt.x()) - radius, std::min(prev.y(), pt.y()) - radius),
+                QPointF(std::max(prev.x(), pt.x()) + radius, std::max(prev.y(), pt.y()) + radius));
+            _pending.push_back({ box, prev, pt, id });
+            count++;
+        }
+        prev = pt;
+        hasPrev = true;
+    }
+    _infos.push_back({ line, radius, count });
+    _ids.insert(line, id);
+}
+
+void TrainLineIndex::remove(TrainLine* line)
+{
+    auto itr = _ids.find(line);
+    if (itr == _ids.end())
+        return;
+    auto& info = _infos[itr.value()];
+    info.line = nullptr;
+    _deadSegments += info.segments;
+    _ids.erase(itr);
+}
+
+void TrainLineIndex::clear()
+{
+    _segments.clear();
+    _nodes.clear();
+    _root = -1;
+    _pending.clear();
+    _infos.clear();
+    _ids.clear();
+    _deadSegments = 0;
+}
+
+TrainLine* TrainLineIndex::lineAt(const QPointF& pos, double tolerance,
+    const std::function<bool(TrainLine*)>& accept, double* distance)
+{
+    maybeRebuild();
+    const QRectF rect(pos.x() - tolerance, pos.y() - tolerance, 2 * tolerance, 2 * tolerance);
+    TrainLine* res = nullptr;
+    double best = std::numeric_limits<double>::max();
+    search(rect, [&](const Segment& s) {
+        const auto& info = _infos[s.id];
+        double d = segmentDistance(pos, s.p1, s.p2);
+        if (d > info.radius + tolerance || d >= best)
+            return;
+        if (accept && !accept(info.line))
+            return;
+        best = d;
+        res = info.line;
+        });
+    if (distance)
+        *distance = best;
+    return res;
+}
+
+void TrainLineIndex::maybeRebuild()
+{
+    const size_t indexed = _segments.size();
+    const size_t dead = static_cast<size_t>(_deadSegments);
+    if (_pending.size() > std::max<size_t>(MIN_PENDING, indexed / 4) ||
+        (dead > MIN_PENDING && dead * 2 > indexed + _pending.size())) {
+        rebuild();
+    }
+}
+
+void TrainLineIndex::rebuild()
+{
+    // 去掉已移除的运行线，并重新编号
+    std::vector<int> remap(_infos.size(), -1);
+    std::vector<LineInfo> infos;
+    infos.reserve(_ids.size());
+    for (int i = 0; i < static_cast<int>(_infos.size()); i++) {
+        if (_infos[i].line) {
+            remap[i] = static_cast<int>(infos.size());
+            _ids[_infos[i].line] = remap[i];
+            infos.push_back(_infos[i]);
+        }
+    }
+    std::vector<Segment> all;
+    all.reserve(_segments.size() + _pending.size());
+    for (const auto* v : { &_segments, &_pending }) {
+        for (const auto& s : *v) {
+            if (int id = remap[s.id]; id >= 0) {
+                all.push_back(s);
+                all.back().id = id;
+            }
+        }
+    }
+    _infos = std::move(infos);
+    _pending.clear();
+    _deadSegments = 0;
+
+    strOrder(all);
+    _segments = std::move(all);
+    _nodes.clear();
+    _root = -1;
+    if (_segments.empty())
+        return;
+
+    // 叶结点
+    const int n = static_cast<int>(_segments.size());
+    std::vector<Node> level;
+    level.reserve((n + NODE_SIZE - 1) / NODE_SIZE);
+    for (int i = 0; i < n; i += NODE_SIZE) {
+        int count = std::min(NODE_SIZE, n - i);
+        QRectF box = _segments[i].box;
+        for (int j = i + 1; j < i + count; j++)
+            box = unite(box, _segments[j].box);
+        level.push_back({ box, i, count, true });
+    }
+
+    // 逐层向上装载，同一结点的子结点在_nodes中连续存放
+    while (level.size() > 1) {
+        strOrder(level);
+        const int offset = static_cast<int>(_nodes.size());
+        const int m = static_cast<int>(level.size());
+        _nodes.insert(_nodes.end(), level.begin(), level.end());
+        std::vector<Node> parent;
+        parent.reserve((m + NODE_SIZE - 1) / NODE_SIZE);
+        for (int i = 0; i < m; i += NODE_SIZE) {
+            int count = std::min(NODE_SIZE, m - i);
+            QRectF box = level[i].box;
+            for (int j = i + 1; j < i + count; j++)
+                box = unite(box, level[j].box);
+            parent.push_back({ box, offset + i, count, false });
+        }
+        level = std::move(parent);
+    }
+    _root = static_cast<int>(_nodes.size());
+    _nodes.push_back(level.front());
+}
+
+template <typename Func>
+void TrainLineIndex::search(const QRectF& rect, Func&& func) const
+{
+    if (_root >= 0) {
+        std::vector<int> stack{ _root };
+        while (!stack.empty()) {
+            const Node& node = _nodes[stack.back()];
+            stack.pop_back();
+            if (!overlaps(node.box, rect))
+                continue;
+            for (int i = node.first; i < node.first + node.count; i++) {
+                if (node.leaf) {
+                    const auto& s = _segments[i];
+                    if (_infos[s.id].line && overlaps(s.box, rect))
+                        func(s);
+                }
+                else {
+                    stack.push_back(i);
+                }
+            }
+        }
+    }
+    for (const auto& s : _pending) {
+        if (_infos[s.id].line && overlaps(s.box, rect))
+            func(s);
+    }
+}
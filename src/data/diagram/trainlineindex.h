@@ -0,0 +1,96 @@
+﻿#pragma once
+
+#include <vector>
+#include <functional>
+#include <QHash>
+#include <QRectF>
+#include <QPainterPath>
+
+class TrainLine;
+
+/**
+ * @brief The TrainLineIndex class
+ * 运行线图元的空间索引：以每条运行线折线的各线段包围盒建立的R树（STR批量装载）。
+ * 由DiagramPage随TrainItem的添加、移除一同维护，用于鼠标拾取、提示等，
+ * 不必依赖QGraphicsScene逐个检查长运行线的形状。
+ * 增量维护：新加入的线段先放在待索引表中线性检查，移除的运行线只做标记；
+ * 待索引或已移除的线段积累到一定比例后，在下一次查询时整体重建。
+ * 以TrainLine*为键，只用于识别，不解引用；accept回调也只拿它作键，
+ * 由DiagramPage经_itemMap找到TrainItem（其持有运行线），
+ * 因此运行线从_itemMap移除时必须同时从索引移除。
+ */
+class TrainLineIndex
+{
+public:
+    static constexpr int NODE_SIZE = 16;
+
+    /**
+     * 待索引线段数的下限；低于此值时，不因新增线段而重建
+     */
+    static constexpr int MIN_PENDING = 512;
+
+private:
+    /**
+     * 线段。box为按运行线的拾取半径扩展后的包围盒。
+     */
+    struct Segment {
+        QRectF box;
+        QPointF p1, p2;
+        int id;
+    };
+
+    /**
+     * R树结点。叶结点的子项为_segments[first, first+count)，否则为_nodes[first, first+count)
+     */
+    struct Node {
+        QRectF box;
+        int first, count;
+        bool leaf;
+    };
+
+    struct LineInfo {
+        TrainLine* line;    // 已移除的为空
+        double radius;
+        int segments;
+    };
+
+    std::vector<Segment> _segments;
+    std::vector<Node> _nodes;
+    int _root = -1;
+
+    std::vector<Segment> _pending;
+    std::vector<LineInfo> _infos;
+    QHash<TrainLine*, int> _ids;
+    int _deadSegments = 0;
+
+public:
+    /**
+     * 加入运行线的折线（绝对坐标）。radius为其拾取半径（一般为线宽的一半）。
+     * 已有的同一运行线先移除。
+     */
+    void insert(TrainLine* line, const QPainterPath& path, double radius);
+
+    void remove(TrainLine* line);
+
+    void clear();
+
+    bool contains(TrainLine* line)const { return _ids.contains(line); }
+    int size()const { return _ids.size(); }
+
+    /**
+     * 到pos的距离不超过其拾取半径加tolerance的运行线中，距离最近且accept()为真的一条；没有则返回空。
+     * distance非空时，写入其到折线的距离。
+     */
+    TrainLine* lineAt(const QPointF& pos, double tolerance,
+        const std::function<bool(TrainLine*)>& accept = {}, double* distance = nullptr);
+
+private:
+    void maybeRebuild();
+    void rebuild();
+
+    /**
+     * 对包围盒与rect相交的各有效线段调用func(const Segment&)
+     */
+    template <typename Func>
+    void search(const QRectF& rect, Func&& func)const;
+};
@@ -1144,6 +1144,15 @@ void Railway::mergeIntervalDataInequiv(const Railway& other)
 
 void Railway::swapBaseWith(Railway& other)
 {
+	// record what is changed, for incremental rebinding of trains.
+	// If the previous change is not consumed yet, we can no longer tell the range.
+	if (_pendingChange.has_value()) {
+		_pendingChange = RailwayChangeRange::wholeRailway();
+	}
+	else {
+		_pendingChange = other.changeRangeFrom(*this);
+	}
+
 	std::swap(_stations, other._stations);   //浅拷贝（移动）
 	// 2022.02.07：不能直接交换头结点引用。
 	// 按照约定，Ruler对象的地址应当保持不变
@@ -1179,6 +1188,75 @@ void Railway::swapBaseWith(Railway& other)
 	}
 }
 
+RailwayChangeRange Railway::takePendingChange()
+{
+	if (!_pendingChange.has_value())
+		return RailwayChangeRange::wholeRailway();
+	auto res = std::move(*_pendingChange);
+	_pendingChange.reset();
+	return res;
+}
+
+RailwayChangeRange Railway::changeRangeFrom(const Railway& before) const
+{
+	RailwayChangeRange res;
+	if (before._stations.empty())
+		return RailwayChangeRange::wholeRailway();
+
+	// 修改前第i站及其左右相邻站之间的范围受影响
+	const int nbefore = static_cast<int>(before._stations.size());
+	auto touchOld = [&res, &before, nbefore](int i) {
+		for (int k = std::max(i - 1, 0); k <= std::min(i + 1, nbefore - 1); k++) {
+			res.extend(before._stations.at(k)->mile);
+		}
+	};
+
+	QHash<StationName, int> indexAfter;
+	for (int j = 0; j < _stations.size(); j++) {
+		indexAfter.insert(_stations.at(j)->name, j);
+	}
+
+	int last_j = -1;
+	for (int i = 0; i < nbefore; i++) {
+		const auto& old = before._stations.at(i);
+		auto itr = indexAfter.find(old->name);
+		if (itr == indexAfter.end()) {
+			// 删除的车站
+			touchOld(i);
+			res.touchedFields.insert(old->name.station());
+			continue;
+		}
+		int j = itr.value();
+		if (j < last_j) {
+			// 公共车站的顺序改变，无法界定范围
+			return RailwayChangeRange::wholeRailway();
+		}
+		if (j > last_j + 1) {
+			// last_j与j之间为新增的车站
+			for (int k = last_j + 1; k < j; k++) {
+				res.touchedFields.insert(_stations.at(k)->name.station());
+			}
+			touchOld(i);
+		}
+		last_j = j;
+
+		const auto& st = _stations.at(j);
+		if (st->mile != old->mile || st->counter != old->counter ||
+			st->direction != old->direction) {
+			touchOld(i);
+			res.touchedFields.insert(st->name.station());
+		}
+	}
+	if (last_j < _stations.size() - 1) {
+		// 末尾新增的车站
+		for (int k = last_j + 1; k < _stations.size(); k++) {
+			res.touchedFields.insert(_stations.at(k)->name.station());
+		}
+		touchOld(nbefore - 1);
+	}
+	return res;
+}
+
 std::shared_ptr<Railway> Railway::cloneBase() const
 {
 	auto res = std::make_shared<Railway>();
@@ -1705,4 +1783,29 @@ int Railway::firstInvalidNameIndex() const
 	return -1;
 }
 
+RailwayChangeRange RailwayChangeRange::wholeRailway()
+{
+	RailwayChangeRange res;
+	res.all = true;
+	res.empty = false;
+	return res;
+}
 
+void RailwayChangeRange::extend(double mile)
+{
+	if (empty) {
+		mileFrom = mileTo = mile;
+		empty = false;
+	}
+	else {
+		mileFrom = std::min(mileFrom, mile);
+		mileTo = std::max(mileTo, mile);
+	}
+}
+
+bool RailwayChangeRange::overlaps(double m1, double m2) const
+{
+	if (all) return true;
+	if (empty) return false;
+	return std::max(m1, m2) >= mileFrom && std::min(m1, m2) <= mileTo;
+}
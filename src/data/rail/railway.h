@@ -10,9 +10,11 @@
 #include <QVariant>
 #include <QList>
 #include <QJsonObject>
+#include <QSet>
 #include <memory>
 #include <utility>
 #include <tuple>
+#include <optional>
 
 #include "railstation.h"
 #include "railinterval.h"
@@ -24,6 +26,29 @@ class Ruler;
 class Forbid;
 struct Config;
 
+/**
+ * 一次基线数据修改（Railway::swapBaseWith）的影响范围，用于增量重新绑定列车。
+ * 里程范围按照修改【前】的车站数据给出，因为既有运行线中保存的仍然是旧的车站对象。
+ * touchedFields记录新增、删除或数据变化的车站的站名（不含场名），
+ * 用于判断时刻表中经过这些车站的列车（包括原来没有绑定到的车站）。
+ * all为true时，表示无法界定范围（如车站顺序改变），应全部重新绑定。
+ */
+struct RailwayChangeRange {
+    bool all = false;
+    bool empty = true;
+    double mileFrom = 0, mileTo = 0;
+    QSet<QString> touchedFields;
+
+    static RailwayChangeRange wholeRailway();
+
+    void extend(double mile);
+
+    /**
+     * 里程区间[m1, m2]（不要求有序）是否与影响范围有交集
+     */
+    bool overlaps(double m1, double m2)const;
+};
+
 class Railway:
     public std::enable_shared_from_this<Railway>
 {
@@ -70,6 +95,9 @@ class Railway:
     // if the railway does not belong to RailCategory (i.e. deleted or is data object), this is false
     bool _valid = true;
 
+    // change range recorded by swapBaseWith(), consumed by Diagram::updateRailway()
+    std::optional<RailwayChangeRange> _pendingChange;
+
 public:
     Railway(const QString& name="");
     // 2021.09.28  删除这个构造函数；因为shared_from_this，
@@ -584,6 +612,17 @@ public:
      */
     void swapBaseWith(Railway& other);
 
+    /**
+     * 取出并清除最近一次swapBaseWith()记录的影响范围。
+     * 如果没有记录（或者连续多次交换而未取出），返回全线范围。
+     */
+    RailwayChangeRange takePendingChange();
+
+    /**
+     * 丢弃记录的影响范围；全部重新绑定列车之后调用。
+     */
+    void clearPendingChange() { _pendingChange.reset(); }
+
     /**
      * 生成一个新的对象，仅包含基线数据，不包括标尺
      */
@@ -792,6 +831,13 @@ private:
     */
     void mergeIntervalDataInequiv(const Railway& another);
 
+    /**
+     * this为修改后的基线数据，before为修改前的。
+     * 比较两者车站表，给出修改所影响的范围（按照before的里程）。
+     * 线性算法。
+     */
+    RailwayChangeRange changeRangeFrom(const Railway& before)const;
+
 };
 
 
@@ -13,6 +13,7 @@
 #include "log/IssueManager.h"
 #include <QFile>
 #include <QTextStream>
+#include <atomic>
 
 Train::Train(const TrainName &trainName,
              const StationName &starting,
@@ -317,6 +318,7 @@ void Train::updateBoundRailway(std::shared_ptr<Railway> railway, const Config& c
     //2021.07.04  TrainLine里面有Adapter的引用。不要move assign，直接删了重来好了
     unbindToRailway(railway);
     bindToRailway(railway, config);
+    markEdited();   // 车次的Adapter可能已在外面移走（见TrainContext::commitTimetableChange()）
 }
 
 void Train::unbindToRailway(std::shared_ptr<const Railway> railway)
@@ -847,6 +849,21 @@ void Train::invalidateTempData()
     _locMile = std::nullopt;
     _locRunSecs = std::nullopt;
     _locStaySecs = std::nullopt;
+    markEdited();
+}
+
+namespace {
+std::atomic<quint64> editCounter{ 0 };
+}
+
+quint64 Train::latestEditVersion()
+{
+    return editCounter.load();
+}
+
+quint64 Train::bumpEditVersion()
+{
+    return ++editCounter;
 }
 
 bool Train::timetableSame(const Train& other)const
@@ -867,6 +884,7 @@ void Train::swapTimetable(Train& other)
 {
     std::swap(_timetable, other._timetable);
     invalidateTempData();
+    other.markEdited();
 }
 
 #define SWAP(_key) std::swap(_key,other._key)
@@ -879,6 +897,8 @@ void Train::swapBaseInfo(Train& other)
     SWAP(_type);
     SWAP(_passenger);
     SWAP(_pen);
+    markEdited();
+    other.markEdited();
 }
 
 #if 0
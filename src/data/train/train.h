@@ -89,6 +89,11 @@ class Train:
 
     std::vector<TrainPath*> _paths;
 
+    /**
+     * 编辑版本，取自全局递增的计数器，见markEdited()
+     */
+    quint64 _editVersion = bumpEditVersion();
+
 public:
     using StationPtr=std::list<TrainStation>::iterator;
     using ConstStationPtr=std::list<TrainStation>::const_iterator;
@@ -489,6 +494,25 @@ public:
      */
     void invalidateTempData();
 
+    /**
+     * 编辑版本：绑定、重新绑定（invalidateTempData()）、交换时刻表或基本信息、
+     * 原地修改时刻（编辑命令调用markEdited()）以及TrainAdapter原地修改后更新。
+     * StationTrainIndex据此只重建有变化的车次，而不必逐个比较时刻表。
+     */
+    quint64 editVersion()const { return _editVersion; }
+    void markEdited() { _editVersion = bumpEditVersion(); }
+
+    /**
+     * 全局编辑计数器的当前值。车次被编辑或者TrainCollection增删车次时递增；
+     * 不变则说明没有任何车次变化。
+     */
+    static quint64 latestEditVersion();
+
+    /**
+     * 递增全局编辑计数器，返回新值
+     */
+    static quint64 bumpEditVersion();
+
     inline QString startEndString()const {
         return _starting.toSingleLiteral() + "->" + _terminal.toSingleLiteral();
     }
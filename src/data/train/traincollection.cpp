@@ -9,6 +9,9 @@
 #include <QJsonDocument>
 
 #include "predeftrainfiltercore.h"
+#include "util/qeparallel.h"
+
+#include <mutex>
 
 TrainCollection::TrainCollection(const QJsonObject& obj, const TypeManager& defaultManager)
 {
@@ -17,6 +20,7 @@ TrainCollection::TrainCollection(const QJsonObject& obj, const TypeManager& defa
 
 void TrainCollection::fromJson(const QJsonObject& obj, const TypeManager& defaultManager)
 {
+	Train::bumpEditVersion();
 	_trains.clear();
 	_manager.readForDiagram(obj.value("config").toObject(), defaultManager);
 	_routings.clear();
@@ -122,12 +126,14 @@ QJsonObject TrainCollection::toLocalJson(std::shared_ptr<Railway> rail, bool loc
 
 void TrainCollection::appendTrain(std::shared_ptr<Train> train)
 {
+	Train::bumpEditVersion();
 	_trains.append(train);
 	addMapInfo(train);
 }
 
 void TrainCollection::removeTrain(std::shared_ptr<Train> train)
 {
+	Train::bumpEditVersion();
 	removeMapInfo(train);
 	_trains.removeOne(train);
 }
@@ -180,6 +186,7 @@ QList<std::shared_ptr<Train>> TrainCollection::multiSearchTrain(const QString& n
 
 void TrainCollection::clear(const TypeManager& defaultManager)
 {
+	Train::bumpEditVersion();
 	_trains.clear();
 	_routings.clear();
 	fullNameMap.clear();
@@ -197,6 +204,7 @@ void TrainCollection::clearTrains()
 
 void TrainCollection::clearTrainsAndRoutings()
 {
+	Train::bumpEditVersion();
 	_trains.clear();
 	_routings.clear();
 	fullNameMap.clear();
@@ -205,6 +213,7 @@ void TrainCollection::clearTrainsAndRoutings()
 
 std::shared_ptr<Train> TrainCollection::takeTrainAt(int i)
 {
+	Train::bumpEditVersion();
 	auto t = _trains.takeAt(i);
 	removeMapInfo(t);
 	if (t->hasRouting()) {
@@ -215,6 +224,7 @@ std::shared_ptr<Train> TrainCollection::takeTrainAt(int i)
 
 std::shared_ptr<Train> TrainCollection::takeLastTrain()
 {
+	Train::bumpEditVersion();
 	auto t = _trains.takeLast();
 	removeMapInfo(t);
 	if (t->hasRouting()) {
@@ -225,6 +235,7 @@ std::shared_ptr<Train> TrainCollection::takeLastTrain()
 
 void TrainCollection::removeTrainAt(int i)
 {
+	Train::bumpEditVersion();
 	auto t = _trains.takeAt(i);
 	removeMapInfo(t);
 	if (t->hasRouting()) {
@@ -236,6 +247,7 @@ void TrainCollection::removeTrainAt(int i)
 
 void TrainCollection::insertTrainForUndo(int i, std::shared_ptr<Train> train)
 {
+	Train::bumpEditVersion();
 	_trains.insert(i, train);
 	if (train->hasRouting()) {
 		train->routingNode().value()->setTrain(train);
@@ -377,23 +389,83 @@ QList<QString> TrainCollection::typeNames() const
 
 diagram_diff_t TrainCollection::diffWith(const TrainCollection& other)
 {
-	diagram_diff_t res{};
+	return diffWith(other, nullptr);
+}
+
+diagram_diff_t TrainCollection::diffWith(const TrainCollection& other, const DiffCallback& onPartial,
+	const std::atomic_bool* cancelled)const
+{
+	// 先按原顺序配对：本车次集合中的各车次，然后是对方余下的车次
+	struct Slot {
+		std::shared_ptr<const Train> train1, train2;
+	};
+	std::vector<Slot> slots;
+	slots.reserve(_trains.size() + other._trains.size());
 	auto anotherFullMap = other.fullNameMap;   // copy construct
 	foreach(auto train, _trains) {
 		const auto& name = train->trainName().full();
 		if (auto itr = anotherFullMap.find(name); itr == anotherFullMap.end()) {
-            res.emplace_back(std::make_shared<TrainDifference>(
-                                 TrainDifference::Deleted, train));
+			slots.push_back({ train, nullptr });
 		}
 		else {
-            res.emplace_back(std::make_shared<TrainDifference>(train, itr.value()));  // 最慢
+			slots.push_back({ train, itr.value() });
 			anotherFullMap.erase(itr);
 		}
 	}
-
 	for (auto itr = anotherFullMap.begin(); itr != anotherFullMap.end(); ++itr) {
-        res.emplace_back(std::make_shared<TrainDifference>(
-                             TrainDifference::NewAdded, itr.value()));
+		slots.push_back({ nullptr, itr.value() });
+	}
+
+	const int n = static_cast<int>(slots.size());
+	diagram_diff_t res(n);
+
+	// 分块的粒度同时决定了回调的频率
+	constexpr int chunk_size = 32;
+	const int nchunks = (n + chunk_size - 1) / chunk_size;
+	std::vector<char> finished(nchunks, 0);
+	std::mutex cb_mutex;
+	int done = 0;
+
+	qeutil::parallelFor(nchunks, [&](int c) {
+		if (cancelled && cancelled->load(std::memory_order_relaxed))
+			return;
+		const int first = c * chunk_size, last = std::min(n, first + chunk_size);
+		for (int i = first; i < last; i++) {
+			const auto& s = slots[i];
+			if (!s.train2) {
+				res[i] = std::make_shared<TrainDifference>(TrainDifference::Deleted, s.train1);
+			}
+			else if (!s.train1) {
+				res[i] = std::make_shared<TrainDifference>(TrainDifference::NewAdded, s.train2);
+			}
+			else if (TrainDifference::timetableHash(*s.train1) == TrainDifference::timetableHash(*s.train2)
+				&& TrainDifference::sameTimetable(*s.train1, *s.train2)) {
+				res[i] = std::make_shared<TrainDifference>(s.train1, s.train2,
+					TrainDifference::IdenticalTag{});
+			}
+			else {
+				res[i] = std::make_shared<TrainDifference>(s.train1, s.train2);  // 最慢
+			}
+		}
+		finished[c] = 1;
+		if (onPartial) {
+			diagram_diff_t part(res.begin() + first, res.begin() + last);
+			std::lock_guard lock(cb_mutex);
+			done += last - first;
+			onPartial(part, done, n);
+		}
+		});
+
+	if (cancelled && cancelled->load()) {
+		// 去掉未计算的块
+		diagram_diff_t part;
+		for (int c = 0; c < nchunks; c++) {
+			if (finished[c]) {
+				const int first = c * chunk_size, last = std::min(n, first + chunk_size);
+				part.insert(part.end(), res.begin() + first, res.begin() + last);
+			}
+		}
+		return part;
 	}
 	return res;
 }
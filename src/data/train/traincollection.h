@@ -7,6 +7,8 @@
 #include <QMap>
 
 #include <deque>
+#include <functional>
+#include <atomic>
 
 #include "data/train/typemanager.h"
 #include "data/diagram/diadiff.h"
@@ -268,6 +270,22 @@ public:
      */
     diagram_diff_t diffWith(const TrainCollection& other);
 
+    /**
+     * diffWith()的回调：本块结果（按原顺序），已完成的对比数，总数
+     */
+    using DiffCallback = std::function<void(const diagram_diff_t& partial, int done, int total)>;
+
+    /**
+     * 并行、散列预筛选的版本。
+     * 同名车次先比较时刻表散列值（TrainDifference::timetableHash()），
+     * 散列相同且逐站确认相同的直接判为Unchanged，不做DP；其余的DP交由工作线程计算。
+     * 每完成一块，调用onPartial（已加锁串行化，但在工作线程中调用；块之间的先后不定）。
+     * cancelled被置位后，尚未开始的块不再计算，返回已完成的部分。
+     * 返回值的顺序、内容与原串行版本相同。计算期间不得修改两个车次集合。
+     */
+    diagram_diff_t diffWith(const TrainCollection& other, const DiffCallback& onPartial,
+        const std::atomic_bool* cancelled = nullptr)const;
+
     /**
      * 绑定到指定线路的列车集合
      */
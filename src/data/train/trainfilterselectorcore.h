@@ -11,9 +11,14 @@ class TrainFilterCore;
 class TrainFilterSelectorCore
 {
     friend class TrainFilterSelector;
-    const  TrainFilterCore* _core;
+    const  TrainFilterCore* _core = nullptr;
 public:
     TrainFilterSelectorCore()=default;
+
+    /**
+     * 不经界面直接指定筛选器，用于GreedyPainter::paintBatch()等无界面的调用
+     */
+    explicit TrainFilterSelectorCore(const TrainFilterCore* core): _core(core) {}
     auto* filter()const{return _core;}
 };
 
@@ -7,6 +7,7 @@
 #include <QLabel>
 #include <QLineEdit>
 #include <QSpinBox>
+#include <QDoubleSpinBox>
 #include <QVBoxLayout>
 #include "util/buttongroup.hpp"
 #include <data/common/qesystem.h>
@@ -127,6 +128,33 @@ void SystemJsonDialog::initUI()
     ckTransparentConfig->setToolTip(tr("对新创建的运行图的显示设置、类型管理默认使用透明模式。"));
     flay->addRow(tr("透明设置"), ckTransparentConfig);
 
+    spWorkerThreads = new QSpinBox;
+    spWorkerThreads->setRange(0, 256);
+    spWorkerThreads->setSpecialValueText(tr("自动"));
+    spWorkerThreads->setToolTip(tr("后台计算线程数\n"
+        "打开运行图、刷新（F5）等操作中绑定列车与线路时所用的并行线程数。"
+        "0表示按处理器核心数自动确定；1表示不启用并行计算。"));
+    flay->addRow(tr("后台计算线程数"), spWorkerThreads);
+
+    ckProgressive = new QCheckBox(tr("启用"));
+    ckProgressive->setToolTip(tr("铺画运行图时，先铺画当前视口内的运行线，其余运行线在后台分批铺画。\n"
+        "不启用时，全部运行线铺画完毕后才能操作。"));
+    flay->addRow(tr("渐进式铺画"), ckProgressive);
+
+    spLodScale = new QDoubleSpinBox;
+    spLodScale->setRange(0, 1);
+    spLodScale->setSingleStep(0.1);
+    spLodScale->setDecimals(2);
+    spLodScale->setSpecialValueText(tr("不启用"));
+    spLodScale->setToolTip(tr("简化显示缩放比例\n"
+        "运行图缩小到此比例以下时，运行线简化显示，不显示车次标签等；放大后恢复完整显示。"));
+    flay->addRow(tr("简化显示缩放比例"), spLodScale);
+
+    ckBulkPaint = new QCheckBox(tr("启用"));
+    ckBulkPaint->setToolTip(tr("未选中的运行线按颜色、线宽合并绘制，以提高运行线很多时的显示性能。\n"
+        "车次标签等仍正常显示。重新铺画运行图后生效。"));
+    flay->addRow(tr("合并绘制运行线"), ckBulkPaint);
+
     vlay->addLayout(flay);
 
     auto* g=new ButtonGroup<3>({"确定","还原", "关闭"});
@@ -171,6 +199,10 @@ void SystemJsonDialog::setData()
     cbSysStyle->setCurrentText(t.app_style);
     ckDrag->setChecked(t.drag_time);
     ckTransparentConfig->setChecked(t.transparent_config);
+    spWorkerThreads->setValue(t.worker_threads);
+    ckProgressive->setChecked(t.progressive_paint);
+    spLodScale->setValue(t.lod_scale);
+    ckBulkPaint->setChecked(t.bulk_paint);
     setLanguageCombo();
 }
 
@@ -195,6 +227,10 @@ void SystemJsonDialog::actApply()
     t.show_start_page = ckStartup->isChecked();
     t.drag_time = ckDrag->isChecked();
     t.transparent_config = ckTransparentConfig->isChecked();
+    t.worker_threads = spWorkerThreads->value();
+    t.progressive_paint = ckProgressive->isChecked();
+    t.lod_scale = spLodScale->value();
+    t.bulk_paint = ckBulkPaint->isChecked();
 }
 
 #endif
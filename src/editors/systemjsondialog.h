@@ -7,6 +7,7 @@ class QCheckBox;
 class QComboBox;
 class QLineEdit;
 class QSpinBox;
+class QDoubleSpinBox;
 
 /**
  * @brief The SystemJsonDialog class
@@ -16,12 +17,13 @@ class SystemJsonDialog : public QDialog
 {
     Q_OBJECT
     QComboBox* cbLanguage;
-    QSpinBox* spRowHeight;
+    QSpinBox* spRowHeight, * spWorkerThreads;
+    QDoubleSpinBox* spLodScale;
     QLineEdit* edDefaultFile;
     //QComboBox* cbRibbonStyle;  // 2024.03.28: move to another dialog
     QComboBox* cbSysStyle;
     QCheckBox* ckWeaken, * ckTooltip, * ckCentral, * ckStartup, * ckAutoHighlight;
-    QCheckBox* ckDrag, * ckTransparentConfig;
+    QCheckBox* ckDrag, * ckTransparentConfig, * ckProgressive, * ckBulkPaint;
 public:
     SystemJsonDialog(QWidget* parent=nullptr);
 private:
@@ -12,6 +12,9 @@
 #include <QPair>
 #include <QMouseEvent>
 #include <cmath>
+#include <algorithm>
+#include <map>
+#include <tuple>
 #include <QMessageBox>
 #include <QDialog>
 #include <QVBoxLayout>
@@ -20,6 +23,7 @@
 #include <QMenu>
 #include <QGraphicsProxyWidget>
 #include <QTimer>
+#include <QElapsedTimer>
 
 #if defined(QT_PRINTSUPPORT_LIB)
 #include <QPrinter>
@@ -35,6 +39,9 @@
 #include "paintstationpointitem.h"
 #include "paintstationinfowidget.h"
 #include "util/qeprogressthread.h"
+#include "util/qeparallel.h"
+#include "trainlinegeometry.h"
+#include "trainbulkitem.h"
 
 
 DiagramWidget::DiagramWidget(Diagram& diagram, std::shared_ptr<DiagramPage> page, QWidget* parent):
@@ -69,6 +76,7 @@ void DiagramWidget::autoPaintGraph()
 void DiagramWidget::paintGraph()
 {
     auto clock_start = std::chrono::system_clock::now();
+    _paintStart = clock_start;
     updating = true;
     clearGraph();
     // 2022.02.07：更改页面设置后，这个可能会变
@@ -126,10 +134,9 @@ void DiagramWidget::paintGraph()
     marginItems.right = scene()->createItemGroup(rightItems);
     marginItems.right->setZValue(15);
     
-    //todo: 绘制提示进度条
-    for (auto p : _diagram.trainCollection().trains()) {
-        paintTrain(p);
-    }
+    bool finished = paintAllTrains();
+    // 设置可能已改变，按当前设置重新判断是否启用合并绘制层
+    updateBulkLayer();
 
     showAllForbids();
     
@@ -143,12 +150,23 @@ void DiagramWidget::paintGraph()
     updateTimeAxis();
     updateDistanceAxis();
     auto clock_end = std::chrono::system_clock::now();
-    emit showNewStatus(QObject::tr("运行图 [%1] 铺画完毕  用时%2毫秒").arg(_page->name())
-        .arg((clock_end - clock_start) / std::chrono::milliseconds(1)));
+    if (finished) {
+        emit showNewStatus(QObject::tr("运行图 [%1] 铺画完毕  用时%2毫秒").arg(_page->name())
+            .arg((clock_end - clock_start) / std::chrono::milliseconds(1)));
+    }
+    else {
+        emit showNewStatus(QObject::tr("运行图 [%1] 视口内运行线铺画完毕  用时%2毫秒  其余%3条运行线正在铺画")
+            .arg(_page->name()).arg((clock_end - clock_start) / std::chrono::milliseconds(1))
+            .arg(_pendingTotal));
+    }
 }
 
 void DiagramWidget::clearGraph()
 {
+    dropPendingLines();
+    clearBulkLayer(true);
+    _bulk.active = false;
+    _bulk.simplified = false;
     weakItem = nullptr;
     // 2024.03.19: clean the drag widget
     if (_dragInfoProxy) {
@@ -170,6 +188,7 @@ bool DiagramWidget::toPdf(const QString& filename, const QString& title, const Q
             "无法使用导出PDF功能。请考虑使用导出PNG功能。"));
     return false;
 #else
+    finishPendingPaint();
     using namespace std::chrono_literals;
     auto start = std::chrono::system_clock::now();
     QPrinter printer(QPrinter::HighResolution);
@@ -208,6 +227,7 @@ void DiagramWidget::toPdfAsync(const QString& filename, const QString& title, co
         "无法使用导出PDF功能。请考虑使用导出PNG功能。"));
     return;
 #else
+    finishPendingPaint();
     using namespace std::chrono_literals;
     auto start = std::chrono::system_clock::now();
 
@@ -347,8 +367,13 @@ void DiagramWidget::paintToFile(QPainter& painter, const QString& title, const Q
     QString mark = tr("由 %1_%2 导出").arg(qespec::TITLE.data()).arg(qespec::VERSION.data());
     painter.drawText(scene()->width() - 400, scene()->height() + 100 + 40, mark);
     painter.setRenderHint(QPainter::Antialiasing);
+    // 导出不用合并绘制层（及LOD简化），临时恢复完整的TrainItem，导出后再重建
+    if (_bulk.active)
+        showFullItems();
     scene()->render(&painter, QRectF(0, 100, scene()->width(), scene()->height()));
     painter.end();
+    if (_bulk.active)
+        rebuildBulkLayer();
 
     updateDistanceAxis();
     updateTimeAxis();
@@ -552,6 +577,7 @@ void DiagramWidget::showPaintingInfoWidget(const QPointF& pos, TrainItem* item,
 
 bool DiagramWidget::toPng(const QString& filename, const QString& title, const QString& note)
 {
+    finishPendingPaint();
     using namespace std::chrono_literals;
     auto start = std::chrono::system_clock::now();
     constexpr int note_apdx = 80;
@@ -571,8 +597,10 @@ bool DiagramWidget::toPng(const QString& filename, const QString& title, const Q
 
 void DiagramWidget::removeTrain(const Train& train)
 {
+    dropPendingLines(&train);
     for (auto adp : train.adapters()) {
         for (auto p : adp->lines()) {
+            removeFromBulkLayer(p.get());
             auto* item = _page->takeTrainItem(p.get());
             if (item) {
                 scene()->removeItem(item);
@@ -587,7 +615,9 @@ void DiagramWidget::removeTrain(const Train& train)
 void DiagramWidget::removeTrain(QVector<std::shared_ptr<TrainAdapter>>&& adps)
 {
     for (auto adp : adps) {
+        dropPendingLines(adp->train().get());
         for (auto p : adp->lines()) {
+            removeFromBulkLayer(p.get());
             auto* item = _page->takeTrainItem(p.get());
             if (item) {
                 scene()->removeItem(item);
@@ -657,7 +687,8 @@ void DiagramWidget::setTrainShow(std::shared_ptr<TrainLine> line, bool show)
         //显示
         auto* item = _page->getTrainItem(line.get());
         if (item) {
-            item->setVisible(true);
+            // LOD下由合并绘制层显示
+            item->setVisible(!_bulk.simplified);
         }
         else {
             paintTrainLine(line);
@@ -669,6 +700,13 @@ void DiagramWidget::setTrainShow(std::shared_ptr<TrainLine> line, bool show)
         if (item)
             item->setVisible(false);
     }
+    // 合并绘制层中只移入、移出这一条运行线；新铺画的由adoptIntoBulkLayer()处理
+    if (_bulk.active) {
+        if (auto* item = _page->getTrainItem(line.get())) {
+            placeInBulkLayer(line.get(), item);
+            attachBulkItems();
+        }
+    }
 }
 
 void DiagramWidget::setupMenu(const SharedActions& actions)
@@ -758,6 +796,8 @@ void DiagramWidget::mousePressEvent(QMouseEvent* e)
 
         if constexpr (true) {
             auto* item = scene()->itemAt(pos, transform());
+            // 被坐标轴、控件等覆盖的位置，不再查找运行线
+            bool covered = item && item->topLevelItem()->zValue() >= COVER_Z;
             while (item) {
                 if (item->isWidget()) {
                     posWidget = item;
@@ -772,6 +812,9 @@ void DiagramWidget::mousePressEvent(QMouseEvent* e)
                 }
                 item = item->parentItem();
             }
+            if (!trainItem && !posWidget && !covered) {
+                trainItem = lineTrainItemAt(pos);
+            }
         }
 
 
@@ -1300,6 +1343,7 @@ void DiagramWidget::paintTrain(std::shared_ptr<Train> train)
 
 void DiagramWidget::paintTrain(Train& train)
 {
+    dropPendingLines(&train);
     _page->clearTrainItems(train);
     if (!train.isShow())
         return;
@@ -1321,11 +1365,299 @@ void DiagramWidget::paintTrain(Train& train)
                         _page->addItemMap(line.get(), item);
                         item->setZValue(5);
                         scene()->addItem(item);
+                        adoptIntoBulkLayer(item);
+                    }
+                }
+            }
+        }
+    }
+}
+
+bool DiagramWidget::paintAllTrains()
+{
+    std::vector<PendingLine> tasks;
+
+    // 与paintTrain()相同的筛选与顺序
+    for (auto train : _diagram.trainCollection().trains()) {
+        if (!train->isShow())
+            continue;
+        for (auto adp : train->adapters()) {
+            for (int i = 0; i < _page->railwayCount(); i++) {
+                if (adp->railway() == _page->railways().at(i)) {
+                    for (auto line : adp->lines()) {
+                        if (line->isNull()) {
+                            //这个是不应该的
+                            qDebug() << "DiagramWidget::paintAllTrains: WARNING: " <<
+                                "Unexpected null TrainLine! " << train->trainName().full() << Qt::endl;
+                        }
+                        else if (line->show()) {
+                            tasks.push_back({ train, line, adp->railway(), _page->startYs().at(i), {} });
+                        }
                     }
                 }
             }
         }
     }
+
+    // 几何计算只读运行图数据，各运行线之间互不相关
+    const Config& cfg = config();
+    qeutil::parallelFor(static_cast<int>(tasks.size()), [&](int k) {
+        auto& t = tasks[k];
+        t.geometry = TrainLineGeometry::compute(*t.line, *t.railway, cfg, t.startY);
+        }, 64);
+
+    if (!SystemJson::instance.progressive_paint) {
+        for (auto& t : tasks) {
+            addPendingLine(t, false);
+        }
+        return true;
+    }
+
+    // 渐进式：先铺画与视口（时间范围×纵坐标范围）相交的运行线。
+    // 适当外扩，使视口边缘附近的标签也先铺画
+    constexpr double margin = 100;
+    const QRectF vis = mapToScene(viewport()->rect()).boundingRect()
+        .adjusted(-margin, -margin, margin, margin);
+    for (auto& t : tasks) {
+        // 水平或竖直的运行线包围盒宽或高为0，QRectF::intersects()不适用
+        const QRectF r = t.geometry.path.boundingRect();
+        bool inView = !t.geometry.path.isEmpty() &&
+            r.left() <= vis.right() && r.right() >= vis.left() &&
+            r.top() <= vis.bottom() && r.bottom() >= vis.top();
+        if (inView) {
+            addPendingLine(t, false);
+        }
+        else {
+            _pendingLines.push_back(std::move(t));
+        }
+    }
+    _pendingTotal = static_cast<int>(_pendingLines.size());
+    if (_pendingLines.empty())
+        return true;
+
+    if (!_pendingTimer) {
+        _pendingTimer = new QTimer(this);
+        _pendingTimer->setInterval(0);
+        connect(_pendingTimer, &QTimer::timeout, this, &DiagramWidget::paintPendingBatch);
+    }
+    _pendingTimer->start();
+    return false;
+}
+
+void DiagramWidget::addPendingLine(PendingLine& t, bool check)
+{
+    if (check) {
+        // 延后期间数据可能已经变化：车次仍须显示，运行线仍属于该车次在本线路上的绑定，且尚未单独铺画
+        if (!t.train->isShow())
+            return;
+        bool found = false;
+        for (const auto& adp : t.train->adapters()) {
+            if (adp->railway() == t.railway && adp->lines().contains(t.line)) {
+                found = true;
+                break;
+            }
+        }
+        if (!found || !t.line->show() || _page->getTrainItem(t.line.get()))
+            return;
+    }
+    auto* item = new TrainItem(_diagram, t.line, *t.railway, *_page, t.startY, std::move(t.geometry));
+    _page->addItemMap(t.line.get(), item);
+    item->setZValue(5);
+    scene()->addItem(item);
+    // 延后期间被选中的车次，其余运行线图元已在选中时高亮
+    if (t.train == _selectedTrain)
+        item->highlight();
+    adoptIntoBulkLayer(item);
+}
+
+void DiagramWidget::paintPendingBatch()
+{
+    // 每个时间片的时长，其间不处理事件
+    constexpr qint64 slice_ms = 30;
+    QElapsedTimer timer;
+    timer.start();
+    while (!_pendingLines.empty() && timer.elapsed() < slice_ms) {
+        addPendingLine(_pendingLines.front(), true);
+        _pendingLines.pop_front();
+    }
+
+    if (_pendingLines.empty()) {
+        _pendingTimer->stop();
+        auto clock_end = std::chrono::system_clock::now();
+        emit showNewStatus(QObject::tr("运行图 [%1] 铺画完毕  用时%2毫秒").arg(_page->name())
+            .arg((clock_end - _paintStart) / std::chrono::milliseconds(1)));
+    }
+    else {
+        int done = _pendingTotal - static_cast<int>(_pendingLines.size());
+        emit showNewStatus(QObject::tr("正在铺画运行图 [%1]  %2/%3").arg(_page->name())
+            .arg(done).arg(_pendingTotal));
+    }
+}
+
+void DiagramWidget::finishPendingPaint()
+{
+    if (_pendingLines.empty())
+        return;
+    while (!_pendingLines.empty()) {
+        addPendingLine(_pendingLines.front(), true);
+        _pendingLines.pop_front();
+    }
+    paintPendingBatch();   // 停止计时器并报告用时
+}
+
+void DiagramWidget::dropPendingLines(const Train* train)
+{
+    if (!train) {
+        _pendingLines.clear();
+    }
+    else {
+        _pendingLines.erase(std::remove_if(_pendingLines.begin(), _pendingLines.end(),
+            [train](const PendingLine& t) { return t.train.get() == train; }), _pendingLines.end());
+    }
+    if (_pendingLines.empty() && _pendingTimer) {
+        _pendingTimer->stop();
+    }
+}
+
+void DiagramWidget::updateBulkLayer()
+{
+    const double threshold = SystemJson::instance.lod_scale;
+    bool simplified = threshold > 0 && transform().m11() < threshold;
+    bool on = simplified || SystemJson::instance.bulk_paint;
+    if (on == _bulk.active && simplified == _bulk.simplified) {
+        if (simplified) {
+            // 简化的容差与缩放比例有关
+            scheduleBulkRebuild(200);
+        }
+        return;
+    }
+    _bulk.active = on;
+    _bulk.simplified = simplified;
+    if (on) {
+        rebuildBulkLayer();
+    }
+    else {
+        showFullItems();
+    }
+}
+
+void DiagramWidget::showFullItems()
+{
+    clearBulkLayer();
+    for (auto itr = _page->itemMap().begin(); itr != _page->itemMap().end(); ++itr) {
+        itr.value()->setVisible(itr.key()->show());
+        itr.value()->setBodyVisible(true);
+    }
+}
+
+void DiagramWidget::rebuildBulkLayer()
+{
+    clearBulkLayer();
+    if (!_bulk.active)
+        return;
+    for (auto itr = _page->itemMap().begin(); itr != _page->itemMap().end(); ++itr) {
+        placeInBulkLayer(itr.key(), itr.value());
+    }
+    attachBulkItems();
+}
+
+void DiagramWidget::clearBulkLayer(bool sceneCleared)
+{
+    if (!sceneCleared) {
+        for (auto& [key, b] : _bulk.items) {
+            if (b->scene())
+                scene()->removeItem(b);
+            delete b;
+        }
+    }
+    _bulk.items.clear();
+    _bulk.owners.clear();
+}
+
+void DiagramWidget::placeInBulkLayer(TrainLine* line, TrainItem* item)
+{
+    if (auto* b = _bulk.owners.take(line))
+        b->removeLine(line);
+    item->setVisible(line->show());
+    if (item->isHighlighted() || item->isOnDragging()) {
+        // 选中、高亮、拖动的运行线由TrainItem完整显示
+        item->setBodyVisible(true);
+        return;
+    }
+    if (_bulk.simplified) {
+        // 标签、停点标记等一并不显示
+        item->setVisible(false);
+    }
+    else {
+        item->setBodyVisible(false);
+    }
+    if (!line->show())
+        return;
+
+    // 简化容差：半个像素
+    const double tol = 0.5 / transform().m11();
+    QPainterPath path = _bulk.simplified ?
+        TrainLineGeometry::simplified(item->linePath(), tol) : item->linePath();
+    if (path.isEmpty())
+        return;
+    const QPen& pen = item->linePen();
+    auto& b = _bulk.items[{ pen.color().rgba(), pen.widthF(), static_cast<int>(pen.style()) }];
+    if (!b)
+        b = new TrainBulkItem(pen);
+    b->addLine(line, std::move(path));
+    _bulk.owners.insert(line, b);
+}
+
+void DiagramWidget::attachBulkItems()
+{
+    for (auto& [key, b] : _bulk.items) {
+        if (!b->scene()) {
+            b->setZValue(5);
+            scene()->addItem(b);
+        }
+    }
+}
+
+void DiagramWidget::updateBulkLines(const Train& train)
+{
+    if (!_bulk.active)
+        return;
+    for (auto adp : train.adapters()) {
+        for (auto p : adp->lines()) {
+            if (auto* item = _page->getTrainItem(p.get()))
+                placeInBulkLayer(p.get(), item);
+        }
+    }
+    attachBulkItems();
+}
+
+void DiagramWidget::adoptIntoBulkLayer(TrainItem* item)
+{
+    if (!_bulk.active)
+        return;
+    placeInBulkLayer(item->trainLine().get(), item);
+    attachBulkItems();
+}
+
+void DiagramWidget::removeFromBulkLayer(TrainLine* line)
+{
+    if (auto* b = _bulk.owners.take(line))
+        b->removeLine(line);
+}
+
+void DiagramWidget::scheduleBulkRebuild(int delayMs)
+{
+    if (!_bulk.active)
+        return;
+    if (!_bulkTimer) {
+        _bulkTimer = new QTimer(this);
+        _bulkTimer->setSingleShot(true);
+        connect(_bulkTimer, &QTimer::timeout, this, &DiagramWidget::rebuildBulkLayer);
+    }
+    // 已有更早的重建，不再推迟
+    if (_bulkTimer->isActive() && _bulkTimer->remainingTime() <= delayMs)
+        return;
+    _bulkTimer->start(delayMs);
 }
 
 void DiagramWidget::paintTrainTmp(std::shared_ptr<Train> train)
@@ -1349,6 +1681,7 @@ void DiagramWidget::paintTrainLine(std::shared_ptr<TrainLine> line)
         _page->addItemMap(line.get(), item);
         item->setZValue(5);
         scene()->addItem(item);
+        adoptIntoBulkLayer(item);
     }
 }
 
@@ -1478,6 +1811,7 @@ void DiagramWidget::selectTrain(TrainItem* item)
     nowItem->setText(_selectedTrain->trainName().full());
 
     showWeakenItem();
+    updateBulkLines(*_selectedTrain);
     emit trainSelected(_selectedTrain);
     emit showNewStatus(tr("运行图 [%1] 选中车次运行线 [%2]").arg(_page->name(),
         _selectedTrain->trainName().full()));
@@ -1489,6 +1823,7 @@ void DiagramWidget::unselectTrain()
         return;
     if (_selectedTrain) {
         _page->unhighlightTrainItems(*_selectedTrain);
+        updateBulkLines(*_selectedTrain);
         _selectedTrain = nullptr;
         nowItem->setText(" ");
     }
@@ -1515,11 +1850,13 @@ void DiagramWidget::updateForbid(std::shared_ptr<Forbid> forbid, Direction dir)
 void DiagramWidget::zoomIn()
 {
     scale(1.25, 1.25);
+    updateBulkLayer();
 }
 
 void DiagramWidget::zoomOut()
 {
     scale(0.80, 0.80);
+    updateBulkLayer();
 }
 
 void DiagramWidget::locateToStation(std::shared_ptr<const Railway> railway, 
@@ -1671,19 +2008,22 @@ double DiagramWidget::calXFromStart(const QTime& time) const
 
 TrainItem* DiagramWidget::posTrainItem(const QPointF& pos)
 {
+    // 标签、停点标记等仍由场景查找；运行线主体不参与场景的碰撞检测，由空间索引查找
     auto* item = scene()->itemAt(pos, transform());
-    if (!item)
-        return nullptr;
-    //qDebug() << "item: " << item->type() << Qt::endl;
-    //if (item == marginItems.left) {
-    //    qDebug() << "left!!" << Qt::endl;
-    //    //scene()->addRect(item->boundingRect());
-    //}
-    while (item->parentItem())
-        item = item->parentItem();
-    if (item->type() == TrainItem::Type)
-        return qgraphicsitem_cast<TrainItem*>(item);
-    return nullptr;
+    if (item) {
+        //qDebug() << "item: " << item->type() << Qt::endl;
+        item = item->topLevelItem();
+        if (item->type() == TrainItem::Type)
+            return qgraphicsitem_cast<TrainItem*>(item);
+        if (item->zValue() >= COVER_Z)
+            return nullptr;
+    }
+    return lineTrainItemAt(pos);
+}
+
+TrainItem* DiagramWidget::lineTrainItemAt(const QPointF& pos)
+{
+    return _page->trainItemAt(pos, PICK_PIXELS / transform().m11());
 }
 
 void DiagramWidget::stationToolTip(std::deque<AdapterStation>::const_iterator st, const TrainLine& line)
@@ -1769,6 +2109,7 @@ void DiagramWidget::highlightTrain(std::shared_ptr<Train> train)
 
     nowItem->setText(_selectedTrain->trainName().full());
     showWeakenItem();
+    updateBulkLines(*_selectedTrain);
 }
 
 void DiagramWidget::highlightRouting(std::shared_ptr<Routing> routing)
@@ -1777,6 +2118,7 @@ void DiagramWidget::highlightRouting(std::shared_ptr<Routing> routing)
         if (p.isVirtual())
             continue;
         _page->highlightTrainItemsWithLink(*(p.train()));
+        updateBulkLines(*(p.train()));
     }
     showWeakenItem();
 }
@@ -1787,6 +2129,7 @@ void DiagramWidget::unhighlightRouting(std::shared_ptr<Routing> routing)
         if (p.isVirtual())
             continue;
         _page->unhighlightTrainItemsWithLink(*(p.train()));
+        updateBulkLines(*(p.train()));
     }
     hideWeakenItem();
 }
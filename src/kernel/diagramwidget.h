@@ -5,9 +5,15 @@
 #include <QString>
 #include <QTime>
 #include <deque>
+#include <chrono>
+#include <vector>
+#include <map>
+#include <tuple>
+#include <QHash>
 #include "data/common/direction.h"
 #include "data/diagram/trainline.h"
 #include "data/common/qeglobal.h"
+#include "trainlinegeometry.h"
 
 class Diagram;
 class QGraphicsItemGroup;
@@ -26,6 +32,8 @@ class Routing;
 class DragTimeInfoWidget;
 class PaintStationPointItem;
 class PaintStationInfoWidget;
+class QTimer;
+class TrainBulkItem;
 namespace qeutil {
     class QEBalloonTip;
 }
@@ -90,6 +98,37 @@ class DiagramWidget : public QGraphicsView
     QGraphicsProxyWidget* _dragInfoProxy = nullptr;
     std::map<PaintStationInfoWidget*, QGraphicsProxyWidget*> _paintInfoProxies;
 
+    /**
+     * 渐进式铺画中尚未创建图元的运行线（几何数据已算好），参见paintAllTrains()
+     */
+    struct PendingLine {
+        std::shared_ptr<Train> train;
+        std::shared_ptr<TrainLine> line;
+        std::shared_ptr<Railway> railway;
+        double startY;
+        TrainLineGeometry geometry;
+    };
+    std::deque<PendingLine> _pendingLines;
+    int _pendingTotal = 0;
+    QTimer* _pendingTimer = nullptr;
+    std::chrono::system_clock::time_point _paintStart;
+
+    /**
+     * 合并绘制层（TrainBulkItem）。未选中、未高亮的运行线主体按画笔合并绘制，
+     * 只有选中、高亮、拖动的运行线由各自的TrainItem完整显示。
+     * 启用条件：SystemJson::bulk_paint，或者缩放比例低于SystemJson::lod_scale；
+     * 后者为低细节层次（LOD），运行线简化，TrainItem整体隐藏（不显示标签、停点标记等）。
+     */
+    struct {
+        bool active = false;
+        bool simplified = false;
+        // 按画笔（颜色、宽度、线型）合并
+        std::map<std::tuple<QRgb, double, int>, TrainBulkItem*> items;
+        // 各运行线所在的TrainBulkItem，用于增量地移出、移回
+        QHash<TrainLine*, TrainBulkItem*> owners;
+    } _bulk;
+    QTimer* _bulkTimer = nullptr;
+
 public:
     struct SharedActions {
         QAction* refreshAll;
@@ -231,6 +270,93 @@ private:
      */
     void paintTrain(std::shared_ptr<Railway> railway, std::shared_ptr<Train> train);
 
+    /**
+     * paintGraph()中铺画全部列车：
+     * 先在工作线程中并行计算各运行线的几何数据（TrainLineGeometry），
+     * 再在GUI线程中按原顺序创建TrainItem（标签高度等与顺序有关的部分仍在此串行确定）。
+     * 结果与逐车次调用paintTrain()相同。
+     * 启用渐进式铺画（SystemJson::progressive_paint）时，只立即创建与当前视口相交的运行线，
+     * 其余的放入_pendingLines，由paintPendingBatch()在事件循环中分批创建。
+     * 此时标签避让的先后与顺序铺画不同，标签高度可能略有差别。
+     * 返回是否已全部铺画完毕。
+     */
+    bool paintAllTrains();
+
+    /**
+     * 创建一条预先算好几何数据的运行线图元。
+     * 对于渐进式铺画中延后的运行线，先检查其是否仍然有效（数据可能已经变化）。
+     */
+    void addPendingLine(PendingLine& t, bool check);
+
+    /**
+     * 在一个时间片内创建若干延后的运行线，并报告进度；全部完成后报告铺画用时
+     */
+    void paintPendingBatch();
+
+    /**
+     * 立即铺画全部延后的运行线。导出等需要完整运行图的操作之前调用。
+     */
+    void finishPendingPaint();
+
+    /**
+     * 放弃延后的运行线：train为空时放弃全部，否则放弃该车次的。
+     * 单独重新铺画、删除车次时调用，以免之后再创建出过期的图元。
+     */
+    void dropPendingLines(const Train* train = nullptr);
+
+    /**
+     * 按设置与当前缩放比例启用、切换或停用合并绘制层
+     */
+    void updateBulkLayer();
+
+    /**
+     * 重新生成合并绘制层：选中、高亮、拖动的运行线由TrainItem完整显示，
+     * 其余的运行线主体（LOD下为整个TrainItem）隐藏，并按画笔合并到TrainBulkItem中
+     */
+    void rebuildBulkLayer();
+
+    /**
+     * 删除合并绘制层的图元。sceneCleared表示图元已随scene()->clear()删除
+     */
+    void clearBulkLayer(bool sceneCleared = false);
+
+    /**
+     * 删除合并绘制层的图元，所有TrainItem按原样完整显示（停用合并绘制层、导出时）
+     */
+    void showFullItems();
+
+    /**
+     * 按运行线当前的高亮、拖动、显示状态，把它移出或移回合并绘制层（只改动其所在的TrainBulkItem）。
+     * 新建的TrainBulkItem暂不加入场景，由attachBulkItems()统一加入。
+     */
+    void placeInBulkLayer(TrainLine* line, TrainItem* item);
+
+    /**
+     * 把尚未加入场景的TrainBulkItem加入场景
+     */
+    void attachBulkItems();
+
+    /**
+     * 车次的高亮、显示状态变化后，只把该车次的运行线移出或移回合并绘制层，不整体重建
+     */
+    void updateBulkLines(const Train& train);
+
+    /**
+     * 新建的TrainItem在合并绘制层启用时，直接放入对应画笔的TrainBulkItem，不整体重建
+     */
+    void adoptIntoBulkLayer(TrainItem* item);
+
+    /**
+     * 删除运行线图元前，把它移出合并绘制层
+     */
+    void removeFromBulkLayer(TrainLine* line);
+
+    /**
+     * LOD简化容差随缩放比例变化后，延迟delayMs毫秒重新生成合并绘制层（合并多次缩放）。
+     * 新建、删除运行线及高亮、显示状态的变化均增量处理。未启用时不做任何操作。
+     */
+    void scheduleBulkRebuild(int delayMs);
+
     /**
      * pyETRC.GraphicsWidget._addLeftTableText(self, text: str, 
      *           textFont, textColor, start_x, start_y, width, height)
@@ -313,6 +439,21 @@ private:
      */
     TrainItem* posTrainItem(const QPointF& pos);
 
+    /**
+     * 拾取运行线时，在线宽之外再放宽的范围（像素）
+     */
+    static constexpr double PICK_PIXELS = 2;
+
+    /**
+     * 顶层图元的Z值不小于此值（坐标轴、控件等）时，认为其覆盖了下方的运行线
+     */
+    static constexpr double COVER_Z = 15;
+
+    /**
+     * 由DiagramPage的空间索引查找pos处运行线主体对应的TrainItem
+     */
+    TrainItem* lineTrainItemAt(const QPointF& pos);
+
     void stationToolTip(std::deque<AdapterStation>::const_iterator st, const TrainLine& line);
 
     void intervalToolTip(std::deque<AdapterStation>::const_iterator former,
@@ -0,0 +1,67 @@
+﻿#include "trainbulkitem.h"
+
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+#include <algorithm>
+
+TrainBulkItem::TrainBulkItem(const QPen& pen, QGraphicsItem* parent):
+    QGraphicsItem(parent), _pen(pen)
+{
+    // 需要exposedRect，以只绘制可见部分
+    setFlag(ItemUsesExtendedStyleOption);
+}
+
+void TrainBulkItem::addLine(TrainLine* line, QPainterPath path)
+{
+    prepareGeometryChange();
+    QRectF bound = path.boundingRect();
+    _bounding |= bound;
+    _entries.push_back({ line, std::move(path), bound });
+}
+
+bool TrainBulkItem::removeLine(TrainLine* line)
+{
+    auto itr = std::find_if(_entries.begin(), _entries.end(),
+        [line](const Entry& t) { return t.line == line; });
+    if (itr == _entries.end())
+        return false;
+    prepareGeometryChange();
+    _entries.erase(itr);
+    _bounding = QRectF();
+    for (const auto& t : _entries)
+        _bounding |= t.bound;
+    return true;
+}
+
+QRectF TrainBulkItem::boundingRect() const
+{
+    double w = _pen.widthF() / 2 + 1;
+    return _bounding.adjusted(-w, -w, w, w);
+}
+
+void TrainBulkItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget)
+{
+    Q_UNUSED(widget);
+    painter->setPen(_pen);
+    painter->setBrush(Qt::NoBrush);
+    double w = _pen.widthF() / 2 + 1;
+    const QRectF exposed = option->exposedRect.adjusted(-w, -w, w, w);
+    for (const auto& t : _entries) {
+        // 水平或竖直的运行线包围盒宽或高为0，不用QRectF::intersects()
+        if (t.bound.left() <= exposed.right() && t.bound.right() >= exposed.left() &&
+            t.bound.top() <= exposed.bottom() && t.bound.bottom() >= exposed.top()) {
+            painter->drawPath(t.path);
+        }
+    }
+}
+
+QPainterPath TrainBulkItem::shape() const
+{
+    return QPainterPath();
+}
+
+bool TrainBulkItem::contains(const QPointF& pos) const
+{
+    Q_UNUSED(pos);
+    return false;
+}
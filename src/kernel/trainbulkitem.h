@@ -0,0 +1,57 @@
+﻿#pragma once
+
+#include <QGraphicsItem>
+#include <QPainterPath>
+#include <QPen>
+#include <vector>
+
+class TrainLine;
+
+/**
+ * @brief The TrainBulkItem class
+ * 合并绘制的运行线层：同一画笔的多条运行线主体由一个图元绘制，
+ * 以减少场景中的图元数量。只绘制运行线主体，标签等仍由各自的TrainItem负责。
+ * 不参与场景的碰撞检测：拾取由DiagramPage的空间索引（TrainLineIndex）完成。
+ * 选中、高亮、拖动的运行线不放在这里，而是由其TrainItem单独显示（参见DiagramWidget::placeInBulkLayer()）。
+ */
+class TrainBulkItem : public QGraphicsItem
+{
+public:
+    struct Entry {
+        TrainLine* line;
+        QPainterPath path;
+        QRectF bound;
+    };
+
+private:
+    QPen _pen;
+    std::vector<Entry> _entries;
+    QRectF _bounding;
+
+public:
+    enum { Type = UserType + 3 };
+
+    TrainBulkItem(const QPen& pen, QGraphicsItem* parent = nullptr);
+
+    void addLine(TrainLine* line, QPainterPath path);
+
+    /**
+     * 移除运行线（选中、高亮时移出），返回是否找到
+     */
+    bool removeLine(TrainLine* line);
+
+    const QPen& pen()const { return _pen; }
+    bool isEmpty()const { return _entries.empty(); }
+    const auto& entries()const { return _entries; }
+
+    virtual QRectF boundingRect()const override;
+
+    virtual void paint(QPainter* painter, const QStyleOptionGraphicsItem* option,
+        QWidget* widget = nullptr)override;
+
+    inline int type()const override { return Type; }
+
+    virtual QPainterPath shape()const override;
+
+    virtual bool contains(const QPointF& pos)const override;
+};
@@ -13,8 +13,38 @@
 #include <QPen>
 #include <QGraphicsScene>
 
+namespace {
+
+/**
+ * 运行线主体图元。不参与场景的碰撞检测（拾取由DiagramPage的空间索引完成），
+ * 以免场景对包围盒很大的长运行线逐个计算描边形状。
+ */
+class TrainPathItem : public QGraphicsPathItem
+{
+public:
+    using QGraphicsPathItem::QGraphicsPathItem;
+
+    // QGraphicsPathItem的包围盒由shape()求得，这里须直接计算（线帽、拐角外延不超过线宽）
+    QRectF boundingRect()const override {
+        double w = pen().widthF();
+        return path().controlPointRect().adjusted(-w, -w, w, w);
+    }
+    QPainterPath shape()const override { return QPainterPath(); }
+    bool contains(const QPointF& pos)const override { Q_UNUSED(pos); return false; }
+};
+
+}
+
 TrainItem::TrainItem(Diagram& diagram, std::shared_ptr<TrainLine> line,
     Railway& railway, DiagramPage& page, double startY, QGraphicsItem* parent):
+    TrainItem(diagram, line, railway, page, startY,
+        TrainLineGeometry::compute(*line, railway, page.config(), startY), parent)
+{
+}
+
+TrainItem::TrainItem(Diagram& diagram, std::shared_ptr<TrainLine> line,
+    Railway& railway, DiagramPage& page, double startY, TrainLineGeometry&& geometry,
+    QGraphicsItem* parent):
     QGraphicsItem(parent),
     _line(line),_diagram(diagram),_page(page),_railway(railway),
     startTime(page.config().start_hour,0,0),
@@ -30,16 +60,13 @@ TrainItem::TrainItem(Diagram& diagram, std::shared_ptr<TrainLine> line,
     }
 
     // 如果这里报QtGui.dll的错误，考虑trainType()是不是空！
-    setLine();
+    setLine(geometry);
+    updateBounding();
 }
 
 QRectF TrainItem::boundingRect() const
 {
-    return QRectF();
-    if (pathItem)
-        return _bounding;
-    else
-        return QRectF();
+    return _bounding;
 }
 
 void TrainItem::paint(QPainter* painter, const QStyleOptionGraphicsItem* option, QWidget* widget)
@@ -172,6 +199,8 @@ void TrainItem::highlight()
 
     setZValue(10);
     _isHighlighted = true;
+    // 可能新增了停点标记、交路连线等
+    updateBounding();
 }
 
 void TrainItem::unhighlight()
@@ -275,6 +304,19 @@ void TrainItem::unhighlightWithLink()
     }
 }
 
+QPainterPath TrainItem::linePath() const
+{
+    return pathItem ? pathItem->path() : QPainterPath();
+}
+
+void TrainItem::setBodyVisible(bool on)
+{
+    if (pathItem)
+        pathItem->setVisible(on);
+    if (expandItem)
+        expandItem->setVisible(on);
+}
+
 bool TrainItem::contains(const QPointF& f) const
 {
     Q_UNUSED(f);
@@ -293,6 +335,7 @@ void TrainItem::repaintLinkLine()
         return;
     clearLinkLines();
     hasLinkLine = addLinkLine(labelTrainName());
+    updateBounding();
 }
 
 TrainItem::~TrainItem() noexcept
@@ -556,11 +599,11 @@ const MarginConfig &TrainItem::margins() const
     return _page.margins();
 }
 
-void TrainItem::setLine()
+void TrainItem::setLine(const TrainLineGeometry& geometry)
 {
     const QString& trainName = labelTrainName();
 
-    setPathItem(trainName);
+    setPathItem(trainName, geometry);
 
     QPen labelPen = trainPen();
     labelPen.setWidth(0.5);
@@ -588,143 +631,43 @@ void TrainItem::setLine()
     }
 }
 
-void TrainItem::setPathItem(const QString& trainName)
+void TrainItem::updateBounding()
+{
+    prepareGeometryChange();
+    _bounding = childrenBoundingRect();
+}
+
+void TrainItem::setPathItem(const QString& trainName, const TrainLineGeometry& geometry)
 {
     //和图幅有关的数值
     double width = config().diagramWidth();
 
-    bool started = false;    //是否已经开始铺画
-    double ylast = -1, xlast = -1;
-    bool inlast = false;   //上一个点是否在图幅内
-
-    bool mark = (config().show_time_mark == 2);
-
-    //QPainterPath path;
-    QEMultiLinePath path;
-
-    QList<double> spanLeft, spanRight;   //跨界点纵坐标
-
-    auto lastIter = _line->stations().end(); --lastIter;
-
-    for (auto p = _line->stations().begin(); p != _line->stations().end(); ++p) {
-        auto ts = p->trainStation;
-        auto rs = p->railStation.lock();
-        double ycur = _railway.yValueFromCoeff(rs->y_coeff.value(), config());   // 绝对坐标
-        double xarr = calXFromStart(ts->arrive), xdep = calXFromStart(ts->depart);
-
-        //首先处理到达点
-        if (xarr <= width) {
-            //到达点在范围内，铺画到达点
-            QPointF parr(xarr + start_x, ycur + start_y);
-            if (!started) {
-                if (startInRange) {
-                    //表示这就是第一个站，p==begin()
-                    startPoint = parr;
-                }
-                path.moveTo(parr);
-                started = true;
-            }
-            // else  // 2024.02.15: no-else; for the first paining point may not be the actual first?
-            {
-                if (xarr < xlast) {
-                    //横坐标数值减小，表明出现左入图情况（跨界）
-                    if (inlast) {
-                        //上一个点在界内，就还要补充右出图的情况
-                        spanRight.append(getOutGraph(xlast, ylast, xarr, ycur, path));
-                    }
-                    //现在：左入图操作
-                    spanLeft.append(getInGraph(xlast, ylast, xarr, ycur, path));
-                    path.lineTo(parr);
-                }
-                else {
-                    path.lineTo(parr);
-                }
-            }
-            if (mark && ts->isStopped()) {
-                if (_line->startLabel() || p != _line->stations().begin()) {
-                    markArriveTime(xarr, ycur, ts->arrive);
-                }
-            }
-        }
-        else {  //xarr > width  在图外
-            if (!started) {
-                startInRange = false;
-            }
-            if (inlast) {
-                //补充右出图情况
-                //qDebug() << "Out of graph: " << train()->trainName().full() << " "
-                //    << xlast << ", " << ylast << ", " << xarr << ", " << ycur;
-                spanRight.append(getOutGraph(xlast, ylast, xarr, ycur, path));
-            }
-        }
-
-        //下面处理出发点
-        if (ts->isStopped()) {
-            //存在停点，到点和开点不同
-            if (xdep <= width) {
-                //界内
-                if (!started)  // 此条件：解决界外到达、界内出发的首站没有设置started的问题
-                    started = true;
-                QPointF pdep(start_x + xdep, start_y + ycur);
-                if (xdep < xarr) {
-                    //站内越界
-                    if (xarr <= width) {
-                        //到达点也在界内，先补充右出界
-                        spanRight.append(getOutGraph(xarr, ycur, xdep, ycur, path));
-                    }
-                    //左入界
-                    spanLeft.append(getInGraph(xarr, ycur, xdep, ycur, path));
-                }
-                if (config().show_line_in_station)
-                    path.lineTo(pdep);
-                else
-                    path.moveTo(pdep);
-            }
-            else {
-                //界外
-                if (xarr <= width) {
-                    spanRight.append(getOutGraph(xarr, ycur, xdep, ycur, path));
-                }
-            }
-        }
-        //标记时刻 无论有没有停点，都要标注开点，除非是折返车的最后一站
-        if (mark && xdep <= width) {
-            if (p == lastIter) {
-                if (_line->endLabel() && !ts->isStopped()) {
-                    markArriveTime(xdep, ycur, ts->depart);
-                }
-            }
-            else{
-                markDepartTime(xdep, ycur, ts->depart);
-            }
-        }
+    startPoint = geometry.startPoint;
+    endPoint = geometry.endPoint;
+    startInRange = geometry.startInRange;
+    endInRange = geometry.endInRange;
+    const auto& spanLeft = geometry.spanLeft, & spanRight = geometry.spanRight;
 
-        ylast = ycur;
-        xlast = xdep;
-        inlast = (xlast <= width);
+    // 停点标记先于运行线图元创建，以保持原有的叠放次序
+    for (const auto& m : geometry.timeMarks) {
+        if (m.arrive)
+            markArriveTime(m.x, m.y, m.time);
+        else
+            markDepartTime(m.x, m.y, m.time);
     }
 
-    //最后一个站，以及终止点
-    endInRange = inlast;
-    if (endInRange) {
-        endPoint = path.currentPosition();
-    }
     QPen pen = trainPen();
 
     //QPainterPathStroker stroker;
     //stroker.setWidth(0.5);
     //auto outpath = stroker.createStroke(path);
 
-    pathItem = new QGraphicsPathItem(path.path(), this);
+    pathItem = new TrainPathItem(geometry.path, this);
     pathItem->setPen(pen);
     if (config().valid_width > 1) {
         QPen expen(Qt::transparent, pen.width() * config().valid_width);
-        expandItem = new QGraphicsPathItem(path.path(), this);
+        expandItem = new TrainPathItem(geometry.path, this);
         expandItem->setPen(expen);
-        //_bounding = expandItem->boundingRect();
-    }
-    else {
-        //_bounding = pathItem->boundingRect();
     }
 
     //跨界点标记
@@ -820,8 +763,6 @@ void TrainItem::setStartItem(const QString& text,const QPen& pen)
     //auto label_out = s.createStroke(label);
     startLabelItem = new QGraphicsPathItem(label.path(), this);
     startLabelItem->setPen(pen);
-    _bounding |= startLabelItem->boundingRect();
-    _bounding |= startLabelText->boundingRect();
 }
 
 void TrainItem::setEndItem(const QString& text, const QPen& pen)
@@ -896,8 +837,6 @@ void TrainItem::setEndItem(const QString& text, const QPen& pen)
     //auto label_out = s.createStroke(label);
     endLabelItem = new QGraphicsPathItem(label.path(), this);
     endLabelItem->setPen(pen);
-    _bounding |= endLabelItem->boundingRect();
-    _bounding |= endLabelText->boundingRect();
 }
 
 QGraphicsSimpleTextItem* TrainItem::setStartEndLabelText(const QString& text, const QColor& color)
@@ -927,29 +866,6 @@ QTime TrainItem::calTimeByXFromStart(double x_from_start) const
     return startTime.addSecs(sec);
 }
 
-double TrainItem::getOutGraph(double xin, double yin, double xout, double yout, 
-    QEMultiLinePath& path)
-{
-    // Note, that xout may be out of graph or actually in graph (in this case, xout < xin)
-    double fullwidth = config().fullWidth();
-    double width = config().diagramWidth();
-    double xright = xout < xin ? xout + fullwidth: xout;
-    double yp = yin + (width - xin) * (yout - yin) / (xright - xin);
-    QPointF pout(start_x + width, start_y + yp);
-    path.lineTo(pout);
-    return yp;
-}
-
-double TrainItem::getInGraph(double xout, double yout, double xin, double yin, QEMultiLinePath& path)
-{
-    double fullwidth = config().fullWidth();
-    double xleft = xout - fullwidth;
-    double yp = yout - xleft * (yin - yout) / (xin - xleft);  //入图点纵坐标
-    QPointF pin(start_x, yp + start_y);
-    path.moveTo(pin);
-    return yp;
-}
-
 const QPen& TrainItem::trainPen() const
 {
     return this->pen;
@@ -6,6 +6,7 @@
 
 #include "data/diagram/diagrampage.h"
 #include "data/train/stationpoint.h"
+#include "trainlinegeometry.h"
 
 class DiagramPage;
 class Diagram;
@@ -125,6 +126,13 @@ public:
     TrainItem(Diagram& diagram, std::shared_ptr<TrainLine> line, Railway& railway, DiagramPage& page, double startY,
         QGraphicsItem* parent = nullptr);
 
+    /**
+     * 由预先计算好的几何数据构造（参见TrainLineGeometry），
+     * 运行线折线、跨界点、停点标记位置不再重新计算。geometry须由同一line、railway、startY算得。
+     */
+    TrainItem(Diagram& diagram, std::shared_ptr<TrainLine> line, Railway& railway, DiagramPage& page, double startY,
+        TrainLineGeometry&& geometry, QGraphicsItem* parent = nullptr);
+
     virtual QRectF boundingRect()const override;
 
     virtual void paint(QPainter* painter, const QStyleOptionGraphicsItem* option, 
@@ -148,6 +156,20 @@ public:
     void highlightWithLink();
     void unhighlightWithLink();
 
+    bool isHighlighted()const { return _isHighlighted; }
+
+    /**
+     * 运行线主体的实际画笔与路径（绝对坐标），供合并绘制层（TrainBulkItem）使用
+     */
+    const QPen& linePen()const { return pen; }
+    QPainterPath linePath()const;
+
+    /**
+     * 显示或隐藏运行线主体（pathItem及其拾取范围expandItem），标签等不受影响。
+     * 运行线主体由合并绘制层绘制时隐藏。
+     */
+    void setBodyVisible(bool on);
+
     virtual bool contains(const QPointF& f)const override;
 
     /**
@@ -208,14 +230,20 @@ private:
     const Config& config()const;
     const MarginConfig& margins()const;
 
-    void setLine();
+    void setLine(const TrainLineGeometry& geometry);
+
+    /**
+     * 按子图元重新计算包围盒（boundingRect()）。子图元增加后调用。
+     */
+    void updateBounding();
 
     /**
      * @brief setPathItem
      * 绘制运行线主体部分  完全重写
      * 注意：合并主体和span的创建过程！
+     * 几何计算移至TrainLineGeometry::compute()，这里只创建图元
      */
-    void setPathItem(const QString& trainName);
+    void setPathItem(const QString& trainName, const TrainLineGeometry& geometry);
 
     // 2024.02.26 split from setLine: 
     // returns the text to be shown in train name label
@@ -239,15 +267,6 @@ private:
      */
     QTime calTimeByXFromStart(double x_from_start)const;
 
-    /**
-     * @brief 出图操作  运行线右越界
-     * 铺画越界边界，以及越界标签。注意所给参数都是直接算出的  i.e.正值
-     * 返回跨界点纵坐标
-     */
-    double getOutGraph(double xin, double yin, double xout, double yout, QEMultiLinePath& path);
-
-    double getInGraph(double xout, double yout, double xin, double yin, QEMultiLinePath& path);
-
     /**
      * @brief 封装查询列车绘制图形的方法
      * 暂定给个默认的
@@ -0,0 +1,252 @@
+﻿#include "trainlinegeometry.h"
+#include "qemultilinepath.h"
+#include "data/diagram/trainline.h"
+#include "data/diagram/config.h"
+#include "data/rail/railway.h"
+#include "data/train/train.h"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+struct GeometryContext {
+    const Config& config;
+    QTime startTime;
+    double start_x, start_y;
+    double width, fullwidth;
+
+    double calXFromStart(const QTime& time)const
+    {
+        int sec = startTime.secsTo(time);
+        if (sec < 0)
+            sec += 24 * 3600;
+        return sec / config.seconds_per_pix;
+    }
+
+    // 出图操作：运行线右越界，补充出图点。所给参数都是直接算出的（正值），返回跨界点纵坐标
+    double getOutGraph(double xin, double yin, double xout, double yout, QEMultiLinePath& path)const
+    {
+        double xright = xout < xin ? xout + fullwidth : xout;
+        double yp = yin + (width - xin) * (yout - yin) / (xright - xin);
+        QPointF pout(start_x + width, start_y + yp);
+        path.lineTo(pout);
+        return yp;
+    }
+
+    // 入图操作：运行线左入图
+    double getInGraph(double xout, double yout, double xin, double yin, QEMultiLinePath& path)const
+    {
+        double xleft = xout - fullwidth;
+        double yp = yout - xleft * (yin - yout) / (xin - xleft);  //入图点纵坐标
+        QPointF pin(start_x, yp + start_y);
+        path.moveTo(pin);
+        return yp;
+    }
+};
+
+// 点p到线段ab的距离
+double segmentDistance(const QPointF& p, const QPointF& a, const QPointF& b)
+{
+    const QPointF ab = b - a, ap = p - a;
+    double len2 = QPointF::dotProduct(ab, ab);
+    if (len2 <= 0)
+        return std::hypot(ap.x(), ap.y());
+    double t = std::clamp(QPointF::dotProduct(ap, ab) / len2, 0., 1.);
+    const QPointF d = ap - t * ab;
+    return std::hypot(d.x(), d.y());
+}
+
+/**
+ * Douglas-Peucker简化：保留首尾点，若中间各点到首尾连线的最大距离超过tolerance，
+ * 则在距离最大处分开，两侧分别处理。用显式栈，避免长运行线上递归过深。
+ */
+std::vector<QPointF> douglasPeucker(const std::vector<QPointF>& poly, double tolerance)
+{
+    const size_t n = poly.size();
+    if (n <= 2)
+        return poly;
+    std::vector<char> keep(n, 0);
+    keep.front() = keep.back() = 1;
+    std::vector<std::pair<size_t, size_t>> stack{ {0, n - 1} };
+    while (!stack.empty()) {
+        auto [first, last] = stack.back();
+        stack.pop_back();
+        double dmax = -1;
+        size_t index = first;
+        for (size_t i = first + 1; i < last; i++) {
+            double d = segmentDistance(poly[i], poly[first], poly[last]);
+            if (d > dmax) {
+                dmax = d;
+                index = i;
+            }
+        }
+        if (index != first && dmax > tolerance) {
+            keep[index] = 1;
+            stack.push_back({ first, index });
+            stack.push_back({ index, last });
+        }
+    }
+    std::vector<QPointF> res;
+    for (size_t i = 0; i < n; i++) {
+        if (keep[i])
+            res.push_back(poly[i]);
+    }
+    return res;
+}
+
+}
+
+TrainLineGeometry TrainLineGeometry::compute(const TrainLine& line, const Railway& railway,
+    const Config& config, double startY)
+{
+    TrainLineGeometry res;
+    const GeometryContext ctx{ config, QTime(config.start_hour, 0, 0),
+        config.totalLeftMargin(), startY, config.diagramWidth(), config.fullWidth() };
+    const double width = ctx.width, start_x = ctx.start_x, start_y = ctx.start_y;
+
+    bool started = false;    //是否已经开始铺画
+    double ylast = -1, xlast = -1;
+    bool inlast = false;   //上一个点是否在图幅内
+
+    bool mark = (config.show_time_mark == 2);
+
+    QEMultiLinePath path;
+
+    auto lastIter = line.stations().end(); --lastIter;
+
+    for (auto p = line.stations().begin(); p != line.stations().end(); ++p) {
+        auto ts = p->trainStation;
+        auto rs = p->railStation.lock();
+        double ycur = railway.yValueFromCoeff(rs->y_coeff.value(), config);   // 绝对坐标
+        double xarr = ctx.calXFromStart(ts->arrive), xdep = ctx.calXFromStart(ts->depart);
+
+        //首先处理到达点
+        if (xarr <= width) {
+            //到达点在范围内，铺画到达点
+            QPointF parr(xarr + start_x, ycur + start_y);
+            if (!started) {
+                if (res.startInRange) {
+                    //表示这就是第一个站，p==begin()
+                    res.startPoint = parr;
+                }
+                path.moveTo(parr);
+                started = true;
+            }
+            if (xarr < xlast) {
+                //横坐标数值减小，表明出现左入图情况（跨界）
+                if (inlast) {
+                    //上一个点在界内，就还要补充右出图的情况
+                    res.spanRight.append(ctx.getOutGraph(xlast, ylast, xarr, ycur, path));
+                }
+                //现在：左入图操作
+                res.spanLeft.append(ctx.getInGraph(xlast, ylast, xarr, ycur, path));
+            }
+            path.lineTo(parr);
+            if (mark && ts->isStopped()) {
+                if (line.startLabel() || p != line.stations().begin()) {
+                    res.timeMarks.push_back({ xarr, ycur, ts->arrive, true });
+                }
+            }
+        }
+        else {  //xarr > width  在图外
+            if (!started) {
+                res.startInRange = false;
+            }
+            if (inlast) {
+                //补充右出图情况
+                res.spanRight.append(ctx.getOutGraph(xlast, ylast, xarr, ycur, path));
+            }
+        }
+
+        //下面处理出发点
+        if (ts->isStopped()) {
+            //存在停点，到点和开点不同
+            if (xdep <= width) {
+                //界内
+                if (!started)  // 此条件：解决界外到达、界内出发的首站没有设置started的问题
+                    started = true;
+                QPointF pdep(start_x + xdep, start_y + ycur);
+                if (xdep < xarr) {
+                    //站内越界
+                    if (xarr <= width) {
+                        //到达点也在界内，先补充右出界
+                        res.spanRight.append(ctx.getOutGraph(xarr, ycur, xdep, ycur, path));
+                    }
+                    //左入界
+                    res.spanLeft.append(ctx.getInGraph(xarr, ycur, xdep, ycur, path));
+                }
+                if (config.show_line_in_station)
+                    path.lineTo(pdep);
+                else
+                    path.moveTo(pdep);
+            }
+            else {
+                //界外
+                if (xarr <= width) {
+                    res.spanRight.append(ctx.getOutGraph(xarr, ycur, xdep, ycur, path));
+                }
+            }
+        }
+        //标记时刻 无论有没有停点，都要标注开点，除非是折返车的最后一站
+        if (mark && xdep <= width) {
+            if (p == lastIter) {
+                if (line.endLabel() && !ts->isStopped()) {
+                    res.timeMarks.push_back({ xdep, ycur, ts->depart, true });
+                }
+            }
+            else {
+                res.timeMarks.push_back({ xdep, ycur, ts->depart, false });
+            }
+        }
+
+        ylast = ycur;
+        xlast = xdep;
+        inlast = (xlast <= width);
+    }
+
+    //最后一个站，以及终止点
+    res.endInRange = inlast;
+    if (res.endInRange) {
+        res.endPoint = path.currentPosition();
+    }
+    res.path = path.path();
+    return res;
+}
+
+QPainterPath TrainLineGeometry::simplified(const QPainterPath& path, double tolerance)
+{
+    QPainterPath res;
+    std::vector<QPointF> poly;
+    auto flush = [&res, &poly, tolerance]() {
+        if (poly.size() >= 2) {
+            const auto kept = douglasPeucker(poly, tolerance);
+            res.moveTo(kept.front());
+            for (size_t i = 1; i < kept.size(); i++)
+                res.lineTo(kept[i]);
+        }
+        poly.clear();
+    };
+
+    for (int i = 0; i < path.elementCount(); i++) {
+        const auto& e = path.elementAt(i);
+        const QPointF p(e.x, e.y);
+        if (e.isMoveTo()) {
+            // QEMultiLinePath的每一段都是单独的子路径，首尾相接的连起来
+            if (poly.empty() || poly.back() != p) {
+                flush();
+                poly.push_back(p);
+            }
+        }
+        else if (e.isLineTo()) {
+            if (!poly.empty() && p.y() == poly.back().y()) {
+                // 站内停车线段，不画
+                flush();
+            }
+            poly.push_back(p);
+        }
+    }
+    flush();
+    return res;
+}
@@ -0,0 +1,53 @@
+﻿#pragma once
+
+#include <QPainterPath>
+#include <QPointF>
+#include <QList>
+#include <QVector>
+#include <QTime>
+
+class TrainLine;
+class Railway;
+struct Config;
+
+/**
+ * @brief The TrainLineGeometry struct
+ * 从TrainItem::setPathItem()中拆出的纯几何计算部分：
+ * 运行线折线（QEMultiLinePath）、跨界点纵坐标、首末点，以及show_time_mark==2时详细停点标记的位置。
+ * 只读取TrainLine、Railway和Config，不创建图元，也不涉及DiagramPage中的标签高度等
+ * 与铺画顺序有关的数据，因此可以在工作线程中对各运行线并行计算；
+ * 之后在GUI线程中由TrainItem据此创建图元。
+ * 坐标约定与原TrainItem相同：path、startPoint、endPoint为绝对坐标，
+ * spanLeft、spanRight以及TimeMark的坐标相对于(start_x, start_y)。
+ */
+struct TrainLineGeometry
+{
+    struct TimeMark {
+        double x, y;
+        QTime time;
+        bool arrive;
+    };
+
+    QPainterPath path;
+    QList<double> spanLeft, spanRight;
+    QPointF startPoint, endPoint;
+    bool startInRange = true, endInRange = true;
+
+    /**
+     * 按原铺画顺序排列的详细停点标记
+     */
+    QVector<TimeMark> timeMarks;
+
+    /**
+     * 计算运行线几何数据。startY为所在线路的起始纵坐标。线程安全（只读）。
+     */
+    static TrainLineGeometry compute(const TrainLine& line, const Railway& railway,
+        const Config& config, double startY);
+
+    /**
+     * 低细节层次（LOD）用的简化路径：
+     * 首尾相接的各子路径连成折线，去掉站内停车的水平线段，
+     * 再用Douglas-Peucker算法简化：去掉的每个点到简化后对应线段的距离都不超过tolerance。
+     */
+    static QPainterPath simplified(const QPainterPath& path, double tolerance);
+};
@@ -1,5 +1,6 @@
 #include "GlobalLogger.h"
 #include <QTextBrowser>
+#include <QThread>
 #include <iostream>
 #include "util/utilfunc.h"
 
@@ -19,7 +20,14 @@ void GlobalLogger::handleLog(QtMsgType type, const QMessageLogContext& context,
 {
 	auto txt = formatMsg(type, context, msg);
 	if (text_out) {
-		text_out->append(txt);
+		if (QThread::currentThread() == text_out->thread()) {
+			text_out->append(txt);
+		}
+		else {
+			// messages from worker threads: the widget may only be touched in the GUI thread
+			QTextBrowser* w = text_out;
+			QMetaObject::invokeMethod(w, [w, txt]() { w->append(txt); }, Qt::QueuedConnection);
+		}
 	}
 	else {
 #ifdef _DEBUG
@@ -3,7 +3,10 @@
 #include "data/train/train.h"
 #include "data/rail/railway.h"
 
+#include <algorithm>
+
 std::unique_ptr<IssueManager> IssueManager::_instance;
+thread_local IssueManager::Collector* IssueManager::_collector = nullptr;
 
 IssueManager* IssueManager::get()
 {
@@ -13,6 +16,30 @@ IssueManager* IssueManager::get()
 	return _instance.get();
 }
 
+IssueManager::Collector::Collector():
+	_previous(IssueManager::_collector)
+{
+	IssueManager::_collector = this;
+}
+
+IssueManager::Collector::~Collector()noexcept
+{
+	IssueManager::_collector = _previous;
+}
+
+bool IssueManager::report(QtMsgType type, const IssueInfo& info)
+{
+	if (_collector) {
+		// debug-level issues are kept for the deferred log only; see commitIssues()
+		_collector->issues().emplace_back(type, info);
+		return true;
+	}
+	else {
+		get()->emplaceIssue(type, info);
+		return false;
+	}
+}
+
 int IssueManager::rowCount(const QModelIndex& parent) const
 {
 	return _issues.size();
@@ -91,6 +118,26 @@ void IssueManager::emplaceIssue(QtMsgType type, const IssueInfo& info)
 	emplaceIssue(PaintIssue(type, info));
 }
 
+void IssueManager::commitIssues(std::deque<PaintIssue>&& issues)
+{
+	for (const auto& t : issues) {
+		switch (t.level) {
+		case QtDebugMsg: qDebug() << t.info.toString(); break;
+		case QtInfoMsg: qInfo() << t.info.toString(); break;
+		case QtWarningMsg: qWarning() << t.info.toString(); break;
+		default: qCritical() << t.info.toString(); break;
+		}
+	}
+	issues.erase(std::remove_if(issues.begin(), issues.end(),
+		[](const PaintIssue& t) {return t.level == QtDebugMsg; }), issues.end());
+	if (issues.empty())
+		return;
+	beginInsertRows({}, _issues.size(), _issues.size() + issues.size() - 1);
+	std::move(issues.begin(), issues.end(), std::back_inserter(_issues));
+	endInsertRows();
+	issues.clear();
+}
+
 void IssueManager::clearIssuesForTrain(const Train* train)
 {
 	for (int i = _issues.size() - 1; i >= 0; --i) {
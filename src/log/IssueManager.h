@@ -27,6 +27,35 @@ public:
 
 	static IssueManager* get();
 
+	/**
+	 * Thread-local issue buffer for background (worker-thread) computations.
+	 * While a Collector is alive on a thread, all issues reported from this thread via report()
+	 * (i.e. the qeIssue* macros) are stored in the collector instead of the global model,
+	 * since the model (QAbstractTableModel) may only be modified in the GUI thread.
+	 * The collected issues should then be committed by commitIssues() in the GUI thread.
+	 * The log output of the collected issues is also deferred to commitIssues(), since the
+	 * log handler (GlobalLogger) writes to a widget.
+	 */
+	class Collector {
+		std::deque<PaintIssue> _buffer;
+		Collector* _previous;
+	public:
+		Collector();
+		~Collector()noexcept;
+		Collector(const Collector&) = delete;
+		Collector& operator=(const Collector&) = delete;
+		auto& issues() { return _buffer; }
+		std::deque<PaintIssue> takeIssues() { return std::move(_buffer); }
+	};
+
+	/**
+	 * Thread-safe entry for reporting issues (used by the qeIssue* macros).
+	 * If there is an active Collector on current thread, the issue goes there and true is returned,
+	 * meaning that the log output is deferred; otherwise, it is directly emplaced into the global
+	 * manager and false is returned: the caller should write the log.
+	 */
+	static bool report(QtMsgType type, const IssueInfo& info);
+
 	//auto& issues() { return _issues; }
 	auto& issues()const { return _issues; }
 
@@ -42,38 +71,45 @@ public:
 
 	void emplaceIssue(QtMsgType type, const IssueInfo& info);
 
+	/**
+	 * Append the issues collected by worker threads, in one model insertion,
+	 * and write their (deferred) log output. Should be called in the GUI thread.
+	 */
+	void commitIssues(std::deque<PaintIssue>&& issues);
+
 	void clearIssuesForTrain(const Train* train);
 
 private:
 	IssueManager() = default;
 	static std::unique_ptr<IssueManager> _instance;
+	static thread_local Collector* _collector;
 
 	void removeIssueAt(int index);
 };
 
 
 #define qeIssueInfo(_issueInfo) do {\
-IssueManager::get()->emplaceIssue(QtInfoMsg, _issueInfo); \
+if (!IssueManager::report(QtInfoMsg, _issueInfo)) \
 qInfo() << _issueInfo.toString(); \
 }while(false)
 
 #define qeIssueWarning(_issueInfo) do {\
-IssueManager::get()->emplaceIssue(QtWarningMsg, _issueInfo); \
+if (!IssueManager::report(QtWarningMsg, _issueInfo)) \
 qWarning() << _issueInfo.toString(); \
 }while(false)
 
 #define qeIssueCritical(_issueInfo) do {\
-IssueManager::get()->emplaceIssue(QtCriticalMsg, _issueInfo); \
+if (!IssueManager::report(QtCriticalMsg, _issueInfo)) \
 qCritical() << _issueInfo.toString(); \
 }while(false)
 
 #define qeIssueFatal(_issueInfo) do {\
-IssueManager::get()->emplaceIssue(QtFatalMsg, _issueInfo); \
+IssueManager::report(QtFatalMsg, _issueInfo); \
 qFatal() << _issueInfo.toString(); \
 }while(false)
 
 #define qeIssueDebug(_issueInfo) do {\
-IssueManager::get()->emplaceIssue(QtDebugMsg, _issueInfo); \
+if (!IssueManager::report(QtDebugMsg, _issueInfo)) \
 qDebug() << _issueInfo.toString(); \
 }while(false)
 
@@ -547,6 +547,8 @@ void TrainContext::commitTimetableChange(std::shared_ptr<Train> train, std::shar
 
 void TrainContext::onTrainStationTimeChanged(std::shared_ptr<Train> train, bool repaint)
 {
+	// 原地修改时刻，不重新绑定；更新编辑版本，使StationTrainIndex重建该车次
+	train->markEdited();
 	updateTrainWidget(train);
 	if (repaint) {
 		mw->repaintTrainLines(train);
@@ -1114,8 +1116,8 @@ void TrainContext::batchExportTrainEvents(const QList<std::shared_ptr<Train>>& t
 
 	auto clk_s = std::chrono::system_clock::now();
 
-	foreach(auto train, trains) {
-		TrainEventList evlst = diagram.listTrainEvents(*train);
+	const auto& evlsts = diagram.listTrainEvents(trains);
+	for (const auto& evlst : evlsts) {
 		TrainEventModel::exportToCsvBatch(s, evlst);
 	}
 
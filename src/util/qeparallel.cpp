@@ -0,0 +1,66 @@
+﻿#include "qeparallel.h"
+#include "data/common/qesystem.h"
+
+#include <QThreadPool>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+int qeutil::workerThreadCount()
+{
+    int n = SystemJson::instance.worker_threads;
+    if (n <= 0) {
+        n = static_cast<int>(std::thread::hardware_concurrency());
+    }
+    return std::max(n, 1);
+}
+
+namespace {
+
+// 线程池中的任务可能在runOnPool()返回后才开始，因此状态放在堆上，由各任务共享
+struct PoolState {
+    std::mutex mutex;
+    std::condition_variable cv;
+    int running = 0;
+    bool closed = false;
+};
+
+class PoolTask : public QRunnable
+{
+    std::shared_ptr<PoolState> _state;
+    const std::function<void()>* _body;
+public:
+    PoolTask(std::shared_ptr<PoolState> state, const std::function<void()>* body) :
+        _state(std::move(state)), _body(body) {}
+
+    void run()override
+    {
+        {
+            std::lock_guard lock(_state->mutex);
+            if (_state->closed)
+                return;
+            _state->running++;
+        }
+        (*_body)();
+        std::lock_guard lock(_state->mutex);
+        if (--_state->running == 0)
+            _state->cv.notify_all();
+    }
+};
+
+}
+
+void qeutil::detail::runOnPool(int extra, const std::function<void()>& body)
+{
+    auto state = std::make_shared<PoolState>();
+    auto* pool = QThreadPool::globalInstance();
+    for (int t = 0; t < extra; t++) {
+        pool->start(new PoolTask(state, &body));   // autoDelete
+    }
+
+    body();
+    std::unique_lock lock(state->mutex);
+    state->closed = true;
+    state->cv.wait(lock, [&state]() { return state->running == 0; });
+}
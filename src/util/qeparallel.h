@@ -0,0 +1,72 @@
+﻿#pragma once
+
+#include <atomic>
+#include <algorithm>
+#include <vector>
+#include <exception>
+#include <functional>
+
+namespace qeutil {
+
+/**
+ * 后台计算使用的工作线程数。
+ * 由SystemJson::worker_threads给定；0表示使用硬件并发数。返回值至少为1。
+ */
+int workerThreadCount();
+
+namespace detail {
+
+/**
+ * 在全局线程池（QThreadPool::globalInstance()）中提交至多extra个任务，与调用线程一起执行body()；
+ * 调用线程执行完body()后，等待已开始执行的任务结束再返回。
+ * 调用线程返回后才开始的任务不再执行body()，因此嵌套调用或线程池繁忙时不会死锁，
+ * 只是退化为由调用线程完成全部工作。body()不得抛出异常。
+ */
+void runOnPool(int extra, const std::function<void()>& body);
+
+}
+
+/**
+ * 简易的并行for循环：对[0, n)中的每个下标调用func(i)。
+ * 采用原子计数器动态分配下标，以适应各任务耗时差别大的情况（例如列车站数差别很大）。
+ * 工作线程取自全局线程池，不在每次调用时创建；调用线程本身也参与计算，全部下标处理完毕后才返回。
+ * n小于minParallel，或者只有一个工作线程时，直接在调用线程上顺序执行。
+ * 要求func对不同下标的调用互不干扰（只读共享数据，写入各自的结果槽位）。
+ * 如果func抛出异常，则其他线程停止领取新下标，并在返回前将第一个异常重新抛出。
+ */
+template <typename Func>
+void parallelFor(int n, Func&& func, int minParallel = 2)
+{
+    int nthreads = std::min(workerThreadCount(), n);
+    if (n < minParallel || nthreads <= 1) {
+        for (int i = 0; i < n; i++)
+            func(i);
+        return;
+    }
+
+    std::atomic_int next{ 0 };
+    std::atomic_bool failed{ false };
+    std::exception_ptr error;
+    std::atomic_flag errorSet = ATOMIC_FLAG_INIT;
+
+    auto worker = [&]() {
+        try {
+            for (int i = next++; i < n && !failed.load(std::memory_order_relaxed); i = next++) {
+                func(i);
+            }
+        }
+        catch (...) {
+            if (!errorSet.test_and_set()) {
+                error = std::current_exception();
+            }
+            failed = true;
+        }
+    };
+
+    detail::runOnPool(nthreads - 1, worker);
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+}
@@ -165,4 +165,14 @@ QColor inversedColorIf(const QColor& color, bool stat);
 
 void inverseColorIf(QColor& color, bool on);
 
+/**
+ * splitmix64的混合函数，用于组合指纹、哈希值
+ */
+inline quint64 mix64(quint64 x) {
+	x += 0x9e3779b97f4a7c15ull;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+	return x ^ (x >> 31);
+}
+
 }
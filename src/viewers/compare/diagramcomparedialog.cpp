@@ -1,6 +1,7 @@
 ﻿#include "diagramcomparedialog.h"
 
 #include <chrono>
+#include <atomic>
 #include <QCheckBox>
 #include <QLabel>
 #include <QAction>
@@ -18,6 +19,7 @@
 #include <data/diagram/diagram.h>
 #include <viewers/traintimetableplane.h>
 #include <util/dialogadapter.h>
+#include <util/qeprogressthread.h>
 
 #include "traincomparedialog.h"
 
@@ -31,58 +33,62 @@ DiagramCompareModel::DiagramCompareModel(QObject *parent):
 
 void DiagramCompareModel::refreshData()
 {
-    using SI = QStandardItem;
     setRowCount(diagram_diff.size());
     for(size_t i=0;i<diagram_diff.size();i++){
-        auto t=diagram_diff.at(i);
-        auto* nameit=new SI(t->trainName().full());
-        setItem(i,ColTrainName,nameit);
-        //直接一个个来
-        if (t->type==TrainDifference::Unchanged){
-            auto* it=new SI(t->train1->starting().toSingleLiteral());
-            setItem(i,ColStarting1,it);
-            it=new SI(t->train1->terminal().toSingleLiteral());
-            setItem(i,ColTerminal1,it);
-            setItem(i,ColDiff,new SI("0"));
-            it=new SI(t->train2->starting().toSingleLiteral());
-            setItem(i,ColStarting2,it);
-            it=new SI(t->train2->terminal().toSingleLiteral());
-            setItem(i,ColTerminal2,it);
-        }else if(t->type==TrainDifference::Changed){
-            nameit->setForeground(Qt::red);
-            auto* it=new SI(t->train1->starting().toSingleLiteral());
-            setItem(i,ColStarting1,it);
-            it->setForeground(Qt::red);
-            it=new SI(t->train1->terminal().toSingleLiteral());
-            setItem(i,ColTerminal1,it);
-            it->setForeground(Qt::red);
-            setItem(i,ColDiff,new SI(QString::number(t->difference)));
-            it=new SI(t->train2->starting().toSingleLiteral());
-            setItem(i,ColStarting2,it);
-            it->setForeground(Qt::red);
-            it=new SI(t->train2->terminal().toSingleLiteral());
-            setItem(i,ColTerminal2,it);
-            it->setForeground(Qt::red);
-        }else if(t->type==TrainDifference::NewAdded){
-            nameit->setForeground(Qt::blue);
-            setItem(i,ColDiff,new SI(tr("新增")));
-            auto* it=new SI(t->train2->starting().toSingleLiteral());
-            setItem(i,ColStarting2,it);
-            it->setForeground(Qt::blue);
-            it=new SI(t->train2->terminal().toSingleLiteral());
-            setItem(i,ColTerminal2,it);
-            it->setForeground(Qt::blue);
-        }else{
-            // 删除
-            nameit->setForeground(Qt::darkGray);
-            auto* it=new SI(t->train1->starting().toSingleLiteral());
-            setItem(i,ColStarting1,it);
-            it->setForeground(Qt::darkGray);
-            it=new SI(t->train1->terminal().toSingleLiteral());
-            setItem(i,ColTerminal1,it);
-            it->setForeground(Qt::darkGray);
-            setItem(i,ColDiff,new SI(tr("删除")));
-        }
+        setupRow(i, diagram_diff.at(i));
+    }
+}
+
+void DiagramCompareModel::setupRow(int i, const std::shared_ptr<TrainDifference>& t)
+{
+    using SI = QStandardItem;
+    auto* nameit=new SI(t->trainName().full());
+    setItem(i,ColTrainName,nameit);
+    //直接一个个来
+    if (t->type==TrainDifference::Unchanged){
+        auto* it=new SI(t->train1->starting().toSingleLiteral());
+        setItem(i,ColStarting1,it);
+        it=new SI(t->train1->terminal().toSingleLiteral());
+        setItem(i,ColTerminal1,it);
+        setItem(i,ColDiff,new SI("0"));
+        it=new SI(t->train2->starting().toSingleLiteral());
+        setItem(i,ColStarting2,it);
+        it=new SI(t->train2->terminal().toSingleLiteral());
+        setItem(i,ColTerminal2,it);
+    }else if(t->type==TrainDifference::Changed){
+        nameit->setForeground(Qt::red);
+        auto* it=new SI(t->train1->starting().toSingleLiteral());
+        setItem(i,ColStarting1,it);
+        it->setForeground(Qt::red);
+        it=new SI(t->train1->terminal().toSingleLiteral());
+        setItem(i,ColTerminal1,it);
+        it->setForeground(Qt::red);
+        setItem(i,ColDiff,new SI(QString::number(t->difference)));
+        it=new SI(t->train2->starting().toSingleLiteral());
+        setItem(i,ColStarting2,it);
+        it->setForeground(Qt::red);
+        it=new SI(t->train2->terminal().toSingleLiteral());
+        setItem(i,ColTerminal2,it);
+        it->setForeground(Qt::red);
+    }else if(t->type==TrainDifference::NewAdded){
+        nameit->setForeground(Qt::blue);
+        setItem(i,ColDiff,new SI(tr("新增")));
+        auto* it=new SI(t->train2->starting().toSingleLiteral());
+        setItem(i,ColStarting2,it);
+        it->setForeground(Qt::blue);
+        it=new SI(t->train2->terminal().toSingleLiteral());
+        setItem(i,ColTerminal2,it);
+        it->setForeground(Qt::blue);
+    }else{
+        // 删除
+        nameit->setForeground(Qt::darkGray);
+        auto* it=new SI(t->train1->starting().toSingleLiteral());
+        setItem(i,ColStarting1,it);
+        it->setForeground(Qt::darkGray);
+        it=new SI(t->train1->terminal().toSingleLiteral());
+        setItem(i,ColTerminal1,it);
+        it->setForeground(Qt::darkGray);
+        setItem(i,ColDiff,new SI(tr("删除")));
     }
 }
 
@@ -92,6 +98,16 @@ void DiagramCompareModel::resetData(diagram_diff_t &&diff)
     refreshData();
 }
 
+void DiagramCompareModel::appendData(const diagram_diff_t& diff)
+{
+    int row = rowCount();
+    diagram_diff.insert(diagram_diff.end(), diff.begin(), diff.end());
+    setRowCount(row + static_cast<int>(diff.size()));
+    for (const auto& t : diff) {
+        setupRow(row++, t);
+    }
+}
+
 DiagramCompareDialog::DiagramCompareDialog(Diagram& diagram, QWidget *parent):
     QDialog(parent), diagram(diagram), model(new DiagramCompareModel(this))
 {
@@ -155,22 +171,68 @@ void DiagramCompareDialog::initUI()
 
 bool DiagramCompareDialog::loadFile(const QString &filename)
 {
-    Diagram dia;
-    bool flag=dia.fromJson(filename);
+    // 对比结果中的StationDiff引用对方车次的时刻表，计算期间由任务持有对方运行图
+    auto dia = std::make_shared<Diagram>();
+    bool flag=dia->fromJson(filename);
     if (!flag){
         QMessageBox::warning(this,tr("错误"),tr("运行图文件错误或为空，无法读取。"));
         return false;
     }
-    using namespace std::chrono_literals;
+    model->resetData({});
     auto c_start = std::chrono::system_clock::now();
-    auto t=diagram.trainCollection().diffWith(dia.trainCollection());
-    auto c_end = std::chrono::system_clock::now();
-    model->resetData(std::move(t));
-    auto c_end2 = std::chrono::system_clock::now();
-    table->resizeColumnsToContents();
-    auto c_end3 = std::chrono::system_clock::now();
-    emit showStatus(tr("运行图对比  计算用时 %1 毫秒  整理用时 %2 毫秒  调整用时 %3 毫秒").arg((c_end - c_start) / 1ms)
-        .arg((c_end2 - c_end) / 1ms).arg((c_end3-c_end2)/1ms));
+    auto cancelled = std::make_shared<std::atomic_bool>(false);
+    auto result = std::make_shared<diagram_diff_t>();
+
+    // diffWith() runs in background; partial results are shown chunk by chunk
+    auto* task = new QEProgressThread([this, dia, cancelled, result](QEProgressThread* th) {
+        *result = diagram.trainCollection().diffWith(dia->trainCollection(),
+            [this, th](const diagram_diff_t& part, int done, int total) {
+                if (!part.empty()) {
+                    QMetaObject::invokeMethod(model, [model = model, part]() {
+                        model->appendData(part);
+                        }, Qt::QueuedConnection);
+                }
+                th->setValue(done * 100 / std::max(total, 1));
+            }, cancelled.get());
+        return 0;
+        }, this);
+
+    // 计算期间不得修改运行图，故采用模态进度对话框
+    auto* pd = task->progressDialog();
+    pd->setWindowTitle(tr("运行图对比"));
+    pd->setLabelText(tr("正在对比车次时刻表"));
+    pd->setWindowModality(Qt::WindowModal);
+    pd->setMinimumDuration(0);
+    pd->setAutoReset(false);
+    pd->setRange(0, 100);
+    pd->setValue(0);
+    connect(pd, &QProgressDialog::canceled, [cancelled]() {
+        *cancelled = true;
+        });
+
+    connect(task, &QThread::finished, this, [this, task, c_start, cancelled, result]() {
+        using namespace std::chrono_literals;
+        auto c_end = std::chrono::system_clock::now();
+        if (*cancelled) {
+            // 保留已逐块显示的部分结果
+            if (model->rowCount() > 0)
+                table->resizeColumnsToContents();
+            emit showStatus(tr("运行图对比已取消  用时 %1 毫秒").arg((c_end - c_start) / 1ms));
+        }
+        else {
+            // 按原顺序重新整理
+            model->resetData(std::move(*result));
+            auto c_end2 = std::chrono::system_clock::now();
+            table->resizeColumnsToContents();
+            auto c_end3 = std::chrono::system_clock::now();
+            emit showStatus(tr("运行图对比  计算用时 %1 毫秒  整理用时 %2 毫秒  调整用时 %3 毫秒").arg((c_end - c_start) / 1ms)
+                .arg((c_end2 - c_end) / 1ms).arg((c_end3 - c_end2) / 1ms));
+        }
+        resetRowShow();
+        task->deleteLater();
+        });
+
+    task->start();
     return true;
 }
 
@@ -29,8 +29,14 @@ public:
     DiagramCompareModel(QObject* parent=nullptr);
     auto& diagramDiff(){return diagram_diff;}
     void resetData(diagram_diff_t&& diff);
+
+    /**
+     * 在末尾追加部分结果，用于后台计算时逐块显示
+     */
+    void appendData(const diagram_diff_t& diff);
 private:
     void refreshData();
+    void setupRow(int row, const std::shared_ptr<TrainDifference>& t);
 
 };
 
@@ -6,6 +6,7 @@
 #include "util/buttongroup.hpp"
 #include "util/selecttraincombo.h"
 #include "data/train/train.h"
+#include "util/qeprogressthread.h"
 
 #include <QCheckBox>
 #include <QFormLayout>
@@ -14,6 +15,7 @@
 #include <QMessageBox>
 #include <QTableView>
 #include <chrono>
+#include <atomic>
 #include <QScroller>
 #include <QAction>
 #include <util/railrangecombo.h>
@@ -29,34 +31,38 @@ DiagnosisModel::DiagnosisModel(Diagram &diagram_, QObject *parent):
 
 void DiagnosisModel::setupModel()
 {
-    using SI = QStandardItem;
     setRowCount(lst.size());
     for (int i = 0; i < lst.size(); i++) {
-        const auto& iss = lst.at(i);
-        auto train = iss.line->train();
-        setItem(i, ColTrainName, new SI(train->trainName().full()));
-        setItem(i, ColTime, new SI(iss.time.toString("hh:mm:ss")));
-        setItem(i, ColMile, new SI(QString::number(iss.mile, 'f', 3)));
-        setItem(i, ColRailway, new SI(iss.line->railway()->name()));
-        setItem(i, ColPos, new SI(iss.posString()));
-        setItem(i, ColLevel, new SI(qeutil::diagnoLevelString(iss.level)));
-        setItem(i, ColType, new SI(qeutil::diagnoTypeString(iss.type)));
-        setItem(i, ColDescription, new SI(iss.description));
-        QColor color(Qt::black);
-        switch (iss.level)
-        {
-        case qeutil::Information:color = Qt::black;
-            break;
-        case qeutil::Warning:color = Qt::blue;
-            break;
-        case qeutil::Error:color = Qt::red;
-            break;
-        default:
-            break;
-        }
-        for (int c = 0; c < ColMAX; c++) {
-            item(i, c)->setForeground(color);
-        }
+        setupRow(i, lst.at(i));
+    }
+}
+
+void DiagnosisModel::setupRow(int i, const DiagnosisIssue& iss)
+{
+    using SI = QStandardItem;
+    auto train = iss.line->train();
+    setItem(i, ColTrainName, new SI(train->trainName().full()));
+    setItem(i, ColTime, new SI(iss.time.toString("hh:mm:ss")));
+    setItem(i, ColMile, new SI(QString::number(iss.mile, 'f', 3)));
+    setItem(i, ColRailway, new SI(iss.line->railway()->name()));
+    setItem(i, ColPos, new SI(iss.posString()));
+    setItem(i, ColLevel, new SI(qeutil::diagnoLevelString(iss.level)));
+    setItem(i, ColType, new SI(qeutil::diagnoTypeString(iss.type)));
+    setItem(i, ColDescription, new SI(iss.description));
+    QColor color(Qt::black);
+    switch (iss.level)
+    {
+    case qeutil::Information:color = Qt::black;
+        break;
+    case qeutil::Warning:color = Qt::blue;
+        break;
+    case qeutil::Error:color = Qt::red;
+        break;
+    default:
+        break;
+    }
+    for (int c = 0; c < ColMAX; c++) {
+        item(i, c)->setForeground(color);
     }
 }
 
@@ -78,6 +84,22 @@ void DiagnosisModel::setupForAll(
     setupModel();
 }
 
+void DiagnosisModel::setupForList(const DiagnosisList& issues)
+{
+    lst = issues;
+    setupModel();
+}
+
+void DiagnosisModel::appendIssues(const DiagnosisList& issues)
+{
+    int row = lst.size();
+    lst.append(issues);
+    setRowCount(lst.size());
+    for (const auto& iss : issues) {
+        setupRow(row++, iss);
+    }
+}
+
 void DiagnosisModel::locateToRow(int row)
 {
     const auto& iss = lst.at(row);
@@ -209,10 +231,71 @@ void DiagnosisDialog::actApply()
                              getFilterRailway(),sst,est);
     }
     else {
-        model->setupForAll(getFilterRailway(),sst,est);
+        // all trains are diagnosed in background, see diagnoseAllAsync()
+        diagnoseAllAsync(getFilterRailway(), sst, est);
+        return;
     }
     auto end = std::chrono::system_clock::now();
-    emit showStatus(tr("时刻诊断  用时%1毫秒").arg((end - start) / 1ms));
+    onDiagnoseFinished((end - start) / 1ms);
+}
+
+void DiagnosisDialog::diagnoseAllAsync(std::shared_ptr<Railway> railway,
+    std::shared_ptr<RailStation> start, std::shared_ptr<RailStation> end)
+{
+    model->setupForList({});
+    auto tm_start = std::chrono::system_clock::now();
+    auto cancelled = std::make_shared<std::atomic_bool>(false);
+    auto result = std::make_shared<DiagnosisList>();
+
+    auto* task = new QEProgressThread([this, railway, start, end, cancelled, result](QEProgressThread* th) {
+        *result = diagram.diagnoseAllTrains(railway, start, end,
+            [this, th](const DiagnosisList& part, int done, int total) {
+                if (!part.empty()) {
+                    QMetaObject::invokeMethod(model, [model = model, part]() {
+                        model->appendIssues(part);
+                        }, Qt::QueuedConnection);
+                }
+                th->setValue(done * 100 / std::max(total, 1));
+            }, cancelled.get());
+        return 0;
+        }, this);
+
+    // 计算期间不得修改运行图，故采用模态进度对话框
+    auto* pd = task->progressDialog();
+    pd->setWindowTitle(tr("时刻诊断"));
+    pd->setLabelText(tr("正在诊断所有车次"));
+    pd->setWindowModality(Qt::WindowModal);
+    pd->setMinimumDuration(0);
+    pd->setAutoReset(false);
+    pd->setRange(0, 100);
+    pd->setValue(0);
+    connect(pd, &QProgressDialog::canceled, [cancelled]() {
+        *cancelled = true;
+        });
+
+    connect(task, &QThread::finished, this, [this, task, tm_start, cancelled, result]() {
+        using namespace std::chrono_literals;
+        auto tm_end = std::chrono::system_clock::now();
+        if (*cancelled) {
+            // 保留已逐块显示的部分结果
+            emit showStatus(tr("时刻诊断已取消  用时%1毫秒").arg((tm_end - tm_start) / 1ms));
+            if (model->rowCount() > 0)
+                table->resizeColumnsToContents();
+        }
+        else {
+            // 按车次顺序重新整理
+            model->setupForList(*result);
+            onDiagnoseFinished((tm_end - tm_start) / 1ms);
+        }
+        task->deleteLater();
+        });
+
+    task->start();
+}
+
+void DiagnosisDialog::onDiagnoseFinished(qint64 msecs)
+{
+    emit showStatus(tr("时刻诊断  用时%1毫秒").arg(msecs));
 
     if (model->rowCount() == 0)
         QMessageBox::information(this, tr("提示"), tr("当前所选范围内未发现问题。"));
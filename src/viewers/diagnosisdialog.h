@@ -38,6 +38,7 @@ public:
     DiagnosisModel(Diagram& diagram_, QObject* parent=nullptr);
 private:
     void setupModel();
+    void setupRow(int row, const DiagnosisIssue& iss);
 signals:
     void locateToRailMile(std::shared_ptr<const Railway> rail, double mile, const QTime& tm);
 public slots:
@@ -49,6 +50,12 @@ public slots:
                      std::shared_ptr<Railway> railway,
                      std::shared_ptr<RailStation> start,
                      std::shared_ptr<RailStation> end);
+
+    /**
+     * 直接设置结果列表；以及后台计算过程中逐块追加结果
+     */
+    void setupForList(const DiagnosisList& issues);
+    void appendIssues(const DiagnosisList& issues);
     void locateToRow(int row);
 };
 
@@ -86,6 +93,14 @@ private:
     std::shared_ptr<Railway> getFilterRailway();
     std::pair<std::shared_ptr<RailStation>,std::shared_ptr<RailStation>>
         getFilterRange();
+
+    /**
+     * 在后台线程中并行诊断所有车次，结果逐块显示；可以取消。
+     */
+    void diagnoseAllAsync(std::shared_ptr<Railway> railway,
+        std::shared_ptr<RailStation> start, std::shared_ptr<RailStation> end);
+
+    void onDiagnoseFinished(qint64 msecs);
 signals:
     void showStatus(const QString&);
 private slots:
@@ -142,10 +142,11 @@ void TrainGapSummaryModel::setupHeader()
     localMin.clear();
     typeCols.clear();
     TrainGapAna ana(diagram, filter);
-    for (auto _p = events.begin(); _p != events.end(); ++_p) {
-        const RailStationEventList& lst = _p->second;
-        auto gaps = ana.calTrainGaps(lst, *filter, _p->first);
-        TrainGapStatistics stat = ana.countTrainGaps(gaps, cutSecs);
+    ana.setCutSecs(cutSecs);
+    // 各站并行计算，结果保持events的顺序
+    const auto res = ana.railwayGaps(events);
+    for (const auto& r : res) {
+        const TrainGapStatistics& stat = r.stat;
         for (auto q = stat.begin(); q != stat.end(); ++q) {
             const typename TrainGap::GapTypesV2& tp = q->first;
             std::shared_ptr<TrainGap> gap = q->second.begin().operator*();
@@ -159,7 +160,7 @@ void TrainGapSummaryModel::setupHeader()
             }
 
             // 登记当前车站的最小
-            localMin.operator[](_p->first).emplace(tp, gap->secs());
+            localMin.operator[](r.station).emplace(tp, gap->secs());
 
             // 计算列数
             if (auto itr = typeCols.find(tp); itr == typeCols.end()) {
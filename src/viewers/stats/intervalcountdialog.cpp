@@ -7,6 +7,9 @@
 #include <QLabel>
 #include <QHeaderView>
 #include <QTableView>
+#include <QInputDialog>
+#include <QFileDialog>
+#include <QMessageBox>
 #include <data/common/qesystem.h>
 #include <model/delegate/qedelegate.h>
 #include <util/utilfunc.h>
@@ -172,9 +175,9 @@ void IntervalCountDialog::initUI()
 
     vlay->addWidget(table);
 
-    auto* g=new ButtonGroup<2>({"导出CSV","关闭"});
+    auto* g=new ButtonGroup<3>({"导出CSV","导出全线矩阵","关闭"});
     g->connectAll(SIGNAL(clicked()),this,
-                  {SLOT(toCsv()),SLOT(close())});
+                  {SLOT(toCsv()),SLOT(toMatrixCsv()),SLOT(close())});
     vlay->addLayout(g);
 
     refreshData();
@@ -254,4 +257,39 @@ void IntervalCountDialog::toCsv()
         tr("%1区间对数表").arg(rail->name()));
 }
 
+void IntervalCountDialog::toMatrixCsv()
+{
+    auto rail = cbStation->railway();
+    if (!rail)return;
 
+    using Value = IntervalCountMatrix::Value;
+    QStringList items;
+    for (int v = static_cast<int>(Value::Total); v <= static_cast<int>(Value::StartEnd); v++) {
+        items.append(IntervalCountMatrix::valueName(static_cast<Value>(v)));
+    }
+    bool ok;
+    auto item = QInputDialog::getItem(this, tr("导出全线矩阵"),
+        tr("导出线路[%1]所有（符合条件的）车站两两之间的区间对数矩阵，行为发站，列为到站。\n"
+            "停车、营业、车站及车次筛选条件与当前设置相同。请选择导出的数据：").arg(rail->name()),
+        items, 0, false, &ok);
+    if (!ok)return;
+
+    QString fn = QFileDialog::getSaveFileName(this, tr("导出全线矩阵"),
+        tr("%1区间对数矩阵").arg(rail->name()),
+        tr("逗号分隔文件 (*.csv)\n 所有文件 (*)"));
+    if (fn.isEmpty())return;
+
+    // 办客、办货的勾选只触发refreshShow()，这里重新设置一次
+    counter.setBusinessOnly(ckBusiness->isChecked());
+    counter.setStopOnly(ckStop->isChecked());
+    counter.setPassengerOnly(ckPassenger->isChecked());
+    counter.setFreightOnly(ckFreight->isChecked());
+    counter.setFilter(filter->filter());
+    auto mat = counter.getIntervalCountMatrix(rail);
+    if (mat.toCsv(fn, static_cast<Value>(items.indexOf(item)))) {
+        QMessageBox::information(this, tr("提示"), tr("导出CSV文件成功"));
+    }
+    else {
+        QMessageBox::warning(this, tr("提示"), tr("导出CSV文件失败"));
+    }
+}
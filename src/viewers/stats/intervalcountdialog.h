@@ -71,5 +71,10 @@ private slots:
     void refreshShow();
     void onDoubleClicked();
     void toCsv();
+
+    /**
+     * 导出全线区间对数矩阵
+     */
+    void toMatrixCsv();
 };
 
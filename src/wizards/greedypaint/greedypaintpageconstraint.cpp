@@ -8,6 +8,7 @@
 #include <QCheckBox>
 #include <QFormLayout>
 #include <QSpinBox>
+#include <QComboBox>
 #include <QTableView>
 #include <QHeaderView>
 #include <QVBoxLayout>
@@ -60,6 +61,27 @@ void GreedyPaintPageConstraint::initUI()
 
     flay->addRow(tr("最大尝试回溯次数"),hlay);
 
+    hlay = new QHBoxLayout;
+    spSpecCandidates = new QSpinBox;
+    spSpecCandidates->setRange(1, 64);
+    spSpecCandidates->setValue(1);
+    spSpecCandidates->setSpecialValueText(tr("不启用"));
+    spSpecCandidates->setToolTip(tr("推测搜索\n"
+        "以锚点时刻及其后若干个时刻为候选，并行地分别铺画，按所选策略从可行解中选取结果。"));
+    hlay->addWidget(spSpecCandidates);
+    hlay->addWidget(new QLabel(tr("候选间隔")));
+    spSpecStep = new QSpinBox;
+    spSpecStep->setRange(1, 3600);
+    spSpecStep->setValue(60);
+    spSpecStep->setSuffix(tr(" 秒"));
+    hlay->addWidget(spSpecStep);
+    cbSpecPolicy = new QComboBox;
+    cbSpecPolicy->addItem(tr("锚点时刻最早"));
+    cbSpecPolicy->addItem(tr("停站时间最少"));
+    hlay->addWidget(cbSpecPolicy);
+    hlay->addStretch(1);
+    flay->addRow(tr("推测搜索候选数"), hlay);
+
     gpGapSet=new RadioButtonGroup<2>({"追踪/会车间隔方案","完整方案"}, this);
     flay->addRow(tr("间隔控制方案"),gpGapSet);
     connect(gpGapSet->group(),&QButtonGroup::idToggled,
@@ -157,6 +179,9 @@ void GreedyPaintPageConstraint::onApply()
     painter.setRailway(rail);
     painter.setRuler(ruler);
     painter.setMaxBackoffTimes(spBack->value());
+    painter.setSpeculative(spSpecCandidates->value(), spSpecStep->value(),
+        cbSpecPolicy->currentIndex() == 0 ? GreedyPainter::SpeculativePolicy::FirstFeasible :
+        GreedyPainter::SpeculativePolicy::LeastStopTime);
 
     painter.usedForbids()=_mdForbid->selectedForbids();
 
@@ -197,7 +222,7 @@ void GreedyPaintPageConstraint::onGetGapFromCurrent()
     //gapana.setSingleLine(ckSingle->isChecked());
     gapana.setCutSecs(spMinGap->value());
 
-    auto res = gapana.globalMinimal(cbRuler->railway());
+    auto res = gapana.globalMinimal(cbRuler->railway(), &_gapCache);
 
     _model->setConstrainFromCurrent(res, spMinGap->value(), spMaxGap->value());
 }
@@ -3,6 +3,7 @@
 #include <util/buttongroup.hpp>
 #include <array>
 #include <data/gapset/gapsetabstract.h>
+#include <data/analysis/traingap/traingapana.h>
 
 class SelectForbidModel;
 class QListView;
@@ -12,6 +13,7 @@ class QTableView;
 class GreedyPainter;
 class QCheckBox;
 class QSpinBox;
+class QComboBox;
 class TrainFilterSelector;
 class RailRulerCombo;
 /**
@@ -22,6 +24,8 @@ class GreedyPaintPageConstraint : public QWidget
     Q_OBJECT;
     RailRulerCombo* cbRuler;
     QSpinBox* spBack;
+    QSpinBox* spSpecCandidates, * spSpecStep;
+    QComboBox* cbSpecPolicy;
     //QCheckBox* ckSingle;
 
     Diagram& diagram;
@@ -39,6 +43,11 @@ class GreedyPaintPageConstraint : public QWidget
     QSpinBox* spMinGap, * spMaxGap;
 
     bool filterInformed = false;
+
+    /**
+     * 从现有运行图提取间隔时的增量缓存：再次提取时只重算有变化的车站
+     */
+    RailwayGapCache _gapCache;
 public:
     explicit GreedyPaintPageConstraint(
             Diagram& _diagram,
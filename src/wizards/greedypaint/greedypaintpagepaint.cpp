@@ -9,6 +9,7 @@
 #include <QMessageBox>
 #include <QLabel>
 #include <QTextBrowser>
+#include <QSignalBlocker>
 
 #include <data/train/trainname.h>
 #include <data/common/qesystem.h>
@@ -641,6 +642,12 @@ std::shared_ptr<Train> GreedyPaintPagePaint::doPaintTrain()
     auto tm_end = std::chrono::system_clock::now();
     emit showStatus(tr("自动推线 用时 %1 毫秒").arg((tm_end - tm_start) / 1ms));
 
+    if (res && painter.anchorTime() != edAnchorTime->time()) {
+        // 推测搜索可能采用了偏移后的锚点时刻
+        QSignalBlocker blocker(edAnchorTime);
+        edAnchorTime->setTime(painter.anchorTime());
+    }
+
     // 整理报告
     QString report;
     report.append(tr("已配置间隔约束：\n%1\n").arg(painter.constraints().toString()));
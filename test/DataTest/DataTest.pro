@@ -3,7 +3,7 @@ QT += testlib \
 
 CONFIG += qt console warn_on depend_includepath testcase
 CONFIG -= app_bundle
-CONFIG += c++17
+CONFIG += c++20
 
 TEMPLATE = app
 
@@ -12,6 +12,7 @@ INCLUDEPATH += ../../src
 SOURCES +=  tst_railtest.cpp \
     ../../src/data/rail/railstation.cpp \
     ../../src/data/common/stationname.cpp \
+    ../../src/data/common/qesystem.cpp \
     ../../src/data/rail/railway.cpp \
     ../../src/data/rail/railinterval.cpp \
     ../../src/data/rail/rulernode.cpp \
@@ -23,6 +24,27 @@ SOURCES +=  tst_railtest.cpp \
     ../../src/data/train/traincollection.cpp \
     ../../src/data/diagram/trainadapter.cpp \
     ../../src/data/diagram/trainline.cpp \
+    ../../src/data/diagram/diadiff.cpp \
+    ../../src/data/diagram/trainevents.cpp \
+    ../../src/data/diagram/traingap.cpp \
+    ../../src/data/diagram/raileventpool.cpp \
+    ../../src/data/diagram/config.cpp \
+    ../../src/data/diagram/stationtrainindex.cpp \
+    ../../src/data/diagram/trainlineindex.cpp \
+    ../../src/data/calculation/stationeventaxis.cpp \
+    ../../src/data/calculation/gapconstraints.cpp \
+    ../../src/data/calculation/greedypainter.cpp \
+    ../../src/data/calculation/calculationlog.cpp \
+    ../../src/data/calculation/railwaystationeventaxis.cpp \
+    ../../src/data/calculation/intervalconflictreport.cpp \
+    ../../src/data/diagram/diagram.cpp \
+    ../../src/data/train/trainfiltercore.cpp \
+    ../../src/data/train/trainfilterselectorcore.cpp \
+    ../../src/kernel/trainlinegeometry.cpp \
+    ../../src/kernel/qemultilinepath.cpp \
+    ../../src/util/qeparallel.cpp \
+    ../../src/log/IssueManager.cpp \
+    ../../src/log/IssueInfo.cpp \
     diagramwidget.cpp
 
 
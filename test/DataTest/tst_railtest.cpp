@@ -9,6 +9,298 @@
 #include "data/train/train.h"
 #include "data/diagram/trainadapter.h"
 #include "data/train/traincollection.h"
+#include "data/diagram/trainline.h"
+#include "data/calculation/stationeventaxis.h"
+#include "data/calculation/gapconstraints.h"
+#include "data/diagram/stationtrainindex.h"
+#include "data/diagram/diadiff.h"
+#include "kernel/trainlinegeometry.h"
+#include "data/diagram/trainlineindex.h"
+#include "data/diagram/diagram.h"
+#include "data/calculation/greedypainter.h"
+#include "data/train/trainfiltercore.h"
+#include "data/train/trainfilterselectorcore.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+namespace {
+
+/**
+ * 测试用线路：stations中各站等距（10 km）排列，并计算纵坐标
+ */
+std::shared_ptr<Railway> makeTestRailway(const QStringList& stations)
+{
+    auto railway = std::make_shared<Railway>(QObject::tr("测试线"));
+    for (int i = 0; i < stations.size(); i++) {
+        railway->appendStation(StationName(stations.at(i)), i * 10.0, 4, i * 10.0);
+    }
+    railway->calStationYCoeff();
+    return railway;
+}
+
+/**
+ * 测试用车次：timetable中每项为站名、到达、出发（hh:mm:ss）
+ */
+std::shared_ptr<Train> makeTestTrain(const QString& name,
+    std::initializer_list<std::tuple<QString, QString, QString>> timetable)
+{
+    auto train = std::make_shared<Train>(TrainName(name));
+    for (const auto& t : timetable) {
+        train->appendStation(StationName::fromSingleLiteral(std::get<0>(t)),
+            QTime::fromString(std::get<1>(t), "hh:mm:ss"),
+            QTime::fromString(std::get<2>(t), "hh:mm:ss"));
+    }
+    return train;
+}
+
+/**
+ * 原地平移车次的全部时刻，不重新绑定；同拖动修改时刻的命令，更新编辑版本
+ * （见TrainContext::onTrainStationTimeChanged()）
+ */
+void shiftTrainTimes(Train& train, int secs)
+{
+    for (auto& st : train.timetable()) {
+        st.arrive = st.arrive.addSecs(secs);
+        st.depart = st.depart.addSecs(secs);
+    }
+    train.markEdited();
+}
+
+/**
+ * 旧版TrainDifference的求解过程（自顶向下递归记忆化，完整的n1*n2表），逐句移植，用于对照。
+ * 结果为StationDiff序列，每项为（类型，train1站序，train2站序），没有的站序为-1。
+ */
+class ReferenceTrainDiff
+{
+    using itr_t = std::list<TrainStation>::const_iterator;
+    std::vector<itr_t> st1, st2;
+    int n1, n2;
+    std::vector<int> table, next_i, next_j;
+
+    int& at(std::vector<int>& m, int i, int j) { return m[static_cast<size_t>(i) * n2 + j]; }
+
+    int solve(int s1, int s2)
+    {
+        if (s1 >= n1 && s2 >= n2) {
+            return 0;
+        }
+        else if (s1 >= n1) {
+            at(next_i, s1 - 1, s2) = s1;
+            at(next_j, s1 - 1, s2) = s2 + 1;
+            return solve(s1, s2 + 1);
+        }
+        else if (s2 >= n2) {
+            at(next_i, s1, s2 - 1) = s1 + 1;
+            at(next_j, s1, s2 - 1) = s2;
+            return solve(s1 + 1, s2);
+        }
+        if (at(table, s1, s2) != -1)
+            return at(table, s1, s2);
+        int rec1 = (st1[s1]->name == st2[s2]->name) + solve(s1 + 1, s2 + 1);
+        int rec2 = solve(s1, s2 + 1);
+        int rec3 = solve(s1 + 1, s2);
+        int sol = std::max({ rec1, rec2, rec3 });
+        at(table, s1, s2) = sol;
+        if (sol == rec1) {
+            at(next_i, s1, s2) = s1 + 1;
+            at(next_j, s1, s2) = s2 + 1;
+        }
+        else if (sol == rec2) {
+            at(next_i, s1, s2) = s1;
+            at(next_j, s1, s2) = s2 + 1;
+        }
+        else {
+            at(next_i, s1, s2) = s1 + 1;
+            at(next_j, s1, s2) = s2;
+        }
+        return sol;
+    }
+
+    int addStation(int i, int j)
+    {
+        int diff = 1;
+        StationDiff::DiffType tp;
+        if (i < 0) {
+            tp = StationDiff::NewAdded;
+        }
+        else if (j < 0) {
+            tp = StationDiff::Deleted;
+        }
+        else {
+            tp = StationDiff::stationCompareType(*st1[i], *st2[j]);
+            if (tp == StationDiff::Unchanged) {
+                diff = 0;
+            }
+            else if (tp == StationDiff::NewAdded) {
+                stations.emplace_back(StationDiff::Deleted, i, -1);
+                diff = 2;
+                i = -1;
+            }
+        }
+        stations.emplace_back(tp, i, j);
+        return diff;
+    }
+
+    int genResult(int s1, int s2)
+    {
+        if (s1 == -1 || s2 == -1)
+            return 0;
+        if (s1 >= n1 && s2 >= n2) {
+            return 0;
+        }
+        else if (s1 >= n1) {
+            addStation(-1, s2);
+            return 1 + genResult(s1, s2 + 1);
+        }
+        else if (s2 >= n2) {
+            addStation(s1, -1);
+            return 1 + genResult(s1 + 1, s2);
+        }
+        int nxi = at(next_i, s1, s2), nxj = at(next_j, s1, s2);
+        int diff;
+        if (nxi != s1 && nxj != s2)
+            diff = addStation(s1, s2);
+        else if (nxi != s1)
+            diff = addStation(s1, -1);
+        else
+            diff = addStation(-1, s2);
+        return diff + genResult(nxi, nxj);
+    }
+
+public:
+    std::vector<std::tuple<int, int, int>> stations;
+    int similarity = -1, difference = -1;
+
+    ReferenceTrainDiff(const Train& train1, const Train& train2)
+    {
+        for (auto itr = train1.timetable().cbegin(); itr != train1.timetable().cend(); ++itr)
+            st1.push_back(itr);
+        for (auto itr = train2.timetable().cbegin(); itr != train2.timetable().cend(); ++itr)
+            st2.push_back(itr);
+        n1 = static_cast<int>(st1.size());
+        n2 = static_cast<int>(st2.size());
+        if (n1 == 0 || n2 == 0)
+            return;
+        table.assign(static_cast<size_t>(n1) * n2, -1);
+        next_i = table;
+        next_j = table;
+        similarity = solve(0, 0);
+        difference = genResult(0, 0);
+    }
+};
+
+/**
+ * TrainDifference的结果，表示为与ReferenceTrainDiff相同的形式
+ */
+std::vector<std::tuple<int, int, int>> diffSummary(const TrainDifference& diff)
+{
+    auto index_of = [](const StationDiff::station_t& st, const Train& train) {
+        return st.has_value() ?
+            static_cast<int>(std::distance(train.timetable().cbegin(), *st)) : -1;
+    };
+    std::vector<std::tuple<int, int, int>> res;
+    for (const auto& st : diff.stations) {
+        res.emplace_back(st.type, index_of(st.station1, *diff.train1),
+            index_of(st.station2, *diff.train2));
+    }
+    return res;
+}
+
+/**
+ * 随机车次：站名取自较小的集合，以产生大量同名站
+ */
+std::shared_ptr<Train> makeRandomTrain(QRandomGenerator& gen, int count, int names)
+{
+    auto train = std::make_shared<Train>(TrainName("T"));
+    for (int i = 0; i < count; i++) {
+        QTime tm = QTime(0, 0).addSecs(60 * gen.bounded(24 * 60));
+        train->appendStation(StationName(QString("S%1").arg(gen.bounded(names))), tm,
+            tm.addSecs(60 * gen.bounded(3)));
+    }
+    return train;
+}
+
+/**
+ * 由train随机修改得到的车次：删站、加站、改时刻、改站名
+ */
+std::shared_ptr<Train> mutateTrain(QRandomGenerator& gen, const Train& train, int edits, int names)
+{
+    auto res = std::make_shared<Train>(train);
+    auto& tt = res->timetable();
+    for (int k = 0; k < edits && !tt.empty(); k++) {
+        auto itr = std::next(tt.begin(), gen.bounded(static_cast<int>(tt.size())));
+        switch (gen.bounded(4)) {
+        case 0: tt.erase(itr); break;
+        case 1: tt.insert(itr, TrainStation(StationName(QString("S%1").arg(gen.bounded(names))),
+            itr->arrive, itr->arrive)); break;
+        case 2: itr->depart = itr->depart.addSecs(60); break;
+        default: itr->name = StationName(QString("S%1").arg(gen.bounded(names))); break;
+        }
+    }
+    return res;
+}
+
+/**
+ * 事件表各站的（类型，时刻）列表，排序后比较，不依赖同时刻事件的先后
+ */
+std::vector<std::vector<std::pair<int, int>>> eventSummary(const LineEventList& events)
+{
+    std::vector<std::vector<std::pair<int, int>>> res;
+    for (const auto& lst : events) {
+        auto& cur = res.emplace_back();
+        for (const auto& ev : lst.stEvents)
+            cur.emplace_back(static_cast<int>(ev.type), ev.time.msecsSinceStartOfDay());
+        for (const auto& ev : lst.itEvents)
+            cur.emplace_back(static_cast<int>(ev.type), ev.time.msecsSinceStartOfDay());
+        std::sort(cur.begin(), cur.end());
+    }
+    return res;
+}
+
+
+/**
+ * 点p到线段ab的距离
+ */
+double pointSegmentDistance(const QPointF& p, const QPointF& a, const QPointF& b)
+{
+    const QPointF ab = b - a, ap = p - a;
+    const double len2 = QPointF::dotProduct(ab, ab);
+    const double t = len2 > 0 ? std::clamp(QPointF::dotProduct(ap, ab) / len2, 0., 1.) : 0.;
+    const QPointF d = ap - t * ab;
+    return std::hypot(d.x(), d.y());
+}
+
+/**
+ * 路径的各子路径（顶点序列）
+ */
+QList<QList<QPointF>> pathPolylines(const QPainterPath& path)
+{
+    QList<QList<QPointF>> res;
+    for (int i = 0; i < path.elementCount(); i++) {
+        const auto& e = path.elementAt(i);
+        if (e.isMoveTo() || res.isEmpty())
+            res.append(QList<QPointF>());
+        res.last().append(QPointF(e.x, e.y));
+    }
+    return res;
+}
+
+/**
+ * 同QEMultiLinePath：每一线段为单独的子路径，首尾相接
+ */
+QPainterPath multiLinePath(const QList<QPointF>& points)
+{
+    QPainterPath path;
+    for (int i = 1; i < points.size(); i++) {
+        path.moveTo(points.at(i - 1));
+        path.lineTo(points.at(i));
+    }
+    return path;
+}
+}
 
 class RailTest : public QObject
 {
@@ -36,6 +328,59 @@ private slots:
      */
     void test_case7();
 
+    /*
+     * 同一车站连续重复绑定时，TrainLine::collectStationEvents()与逐站调用
+     * stationEventFromRail()的结果一致
+     */
+    void test_station_events_duplicate_binding();
+
+    /*
+     * StationEventAxis::conflictEvent()的查表版本与逐个事件检查的版本结果一致，
+     * 包括跨日和与待查事件同时刻的情况
+     */
+    void test_conflict_event_table();
+
+    /*
+     * 原地修改时刻（Adapter不变）并更新编辑版本后，StationTrainIndex的时空包络随之更新；
+     * 编辑版本不变时不重建，删除车次后其运行线移出索引
+     */
+    void test_station_index_time_edit();
+
+    /*
+     * 原地修改时刻后，StationTrainIndex缓存的运行线事件表失效并重算，
+     * 与不经索引直接计算的结果一致
+     */
+    void test_line_events_time_edit();
+
+    /*
+     * 车站事件表的指纹：无变化时不变；原地修改时刻后，途经车站的指纹改变，
+     * 不途经的车站不变（RailwayGapCache等据此判断是否重算）
+     */
+    void test_station_fingerprint_time_edit();
+
+    /*
+     * TrainDifference的检查点迭代DP与旧版递归完整表DP结果逐项一致；并比较两者用时
+     */
+    void test_train_diff_dp();
+
+    /*
+     * TrainLineGeometry::simplified()：原路径的每个顶点到简化路径的距离不超过容差
+     * （不只是相邻的顶点），站内停车的水平线段断开，近似共线的顶点被合并
+     */
+    void test_lod_simplify_tolerance();
+
+    /*
+     * TrainLineIndex::lineAt()与逐条运行线、逐个线段的暴力查找结果一致，
+     * 包括增删后（待索引线段、已移除的标记、重建）以及accept过滤的情况
+     */
+    void test_line_index_hit();
+
+    /*
+     * GreedyPainter::paintBatch()按优先级铺画：先铺画成功的车次进入事件表，
+     * 后铺画的同时刻请求须避让；返回结果按请求原顺序，结束后事件表恢复原状
+     */
+    void test_greedy_paint_batch();
+
 };
 
 RailTest::RailTest()
@@ -219,6 +564,541 @@ void RailTest::test_case7()
     adp.print();
 }
 
+void RailTest::test_station_events_duplicate_binding()
+{
+    auto railway = makeTestRailway({ "A", "B", "C", "D", "E" });
+    Config config;
+    for (bool down : {true, false}) {
+        // 在B站连续出现两次（例如分两行记录的停站）
+        auto train = down ?
+            makeTestTrain("T1", {
+                { "A", "08:00:00", "08:00:00" },
+                { "B", "08:10:00", "08:12:00" },
+                { "B", "08:12:00", "08:15:00" },
+                { "D", "08:35:00", "08:36:00" },
+                { "E", "08:45:00", "08:45:00" } }) :
+            makeTestTrain("T2", {
+                { "E", "09:00:00", "09:00:00" },
+                { "D", "09:10:00", "09:12:00" },
+                { "D", "09:12:00", "09:20:00" },
+                { "B", "09:40:00", "09:40:00" },
+                { "A", "09:50:00", "09:50:00" } });
+        TrainAdapter adp(train, railway, config);
+        QVERIFY(!adp.lines().isEmpty());
+
+        const auto& stations = railway->stations();
+        std::unordered_map<const RailStation*, int> index;
+        for (int i = 0; i < stations.size(); i++)
+            index.emplace(stations.at(i).get(), i);
+
+        for (const auto& line : adp.lines()) {
+            std::vector<RailStationEventList> buckets(stations.size());
+            line->collectStationEvents(stations, index, buckets);
+            for (int i = 0; i < stations.size(); i++) {
+                auto expected = line->stationEventFromRail(stations.at(i));
+                const auto& actual = buckets.at(i);
+                QCOMPARE(actual.size(), expected.size());
+                for (int k = 0; k < static_cast<int>(expected.size()); k++) {
+                    QCOMPARE(actual.at(k)->type, expected.at(k)->type);
+                    QCOMPARE(actual.at(k)->time, expected.at(k)->time);
+                    QCOMPARE(actual.at(k)->pos, expected.at(k)->pos);
+                }
+            }
+        }
+    }
+}
+
+void RailTest::test_conflict_event_table()
+{
+    auto railway = makeTestRailway({ "A", "B", "C" });
+    Config config;
+    TrainAdapter down(makeTestTrain("T1", {
+        { "A", "08:00:00", "08:00:00" }, { "C", "08:30:00", "08:30:00" } }), railway, config);
+    TrainAdapter up(makeTestTrain("T2", {
+        { "C", "09:00:00", "09:00:00" }, { "A", "09:30:00", "09:30:00" } }), railway, config);
+    QVERIFY(!down.lines().isEmpty() && !up.lines().isEmpty());
+    const std::shared_ptr<const TrainLine> lines[] = { down.lines().front(), up.lines().front() };
+    const auto station = railway->stations().at(1);
+
+    // 部分类型间隔为0，使左右两侧的检查结果不同
+    GapConstraints plain;
+    const auto types = TrainGap::allPossibleGaps(true);
+    for (int i = 0; i < static_cast<int>(types.size()); i++) {
+        plain[types.at(i)] = (i % 4) * 120;
+    }
+    GapConstraints compiled(plain);
+    compiled.compile();
+    QVERIFY(compiled.compiled() != nullptr);
+
+    const TrainEventType evTypes[] = { TrainEventType::Arrive, TrainEventType::Depart,
+        TrainEventType::SettledPass, TrainEventType::CalculatedPass };
+    const RailStationEventBase::Positions positions[] = { RailStationEventBase::Pre,
+        RailStationEventBase::Post, RailStationEventBase::Both };
+    constexpr int day_secs = 24 * 3600;
+    QRandomGenerator gen(20240608);
+    auto randomTime = [&](int center) {
+        int secs = center + 30 * gen.bounded(-20, 21);
+        return QTime(0, 0).addSecs((secs + day_secs) % day_secs);
+    };
+
+    for (int n : { 1, 2, 3, 5, 12, 40 }) {
+        for (int center : { 0, 12 * 3600 }) {
+            for (int round = 0; round < 20; round++) {
+                StationEventAxis axis;
+                for (int i = 0; i < n; i++) {
+                    axis.push_back(std::make_shared<RailStationEvent>(evTypes[gen.bounded(4)],
+                        randomTime(center), station, lines[gen.bounded(2)], positions[gen.bounded(3)]));
+                }
+                axis.buildAxis();
+
+                std::vector<QTime> probes;
+                for (const auto& ev : axis)
+                    probes.push_back(ev->time);
+                for (int i = 0; i < 5; i++)
+                    probes.push_back(randomTime(center));
+                for (const auto& tm : probes) {
+                    for (int dir = 0; dir < 2; dir++) {
+                        RailStationEventBase ev(evTypes[gen.bounded(4)], tm,
+                            positions[gen.bounded(3)], lines[dir]->dir());
+                        for (bool single : { true, false }) {
+                            auto expected = axis.conflictEvent(ev, plain, single);
+                            auto actual = axis.conflictEvent(ev, compiled, single);
+                            QCOMPARE(actual.get(), expected.get());
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+void RailTest::test_station_index_time_edit()
+{
+    auto railway = makeTestRailway({ "A", "B", "C", "D" });
+    Config config;
+    TrainCollection coll;
+    auto down = makeTestTrain("T1", {
+        { "A", "08:00:00", "08:00:00" }, { "B", "08:10:00", "08:10:00" },
+        { "C", "08:20:00", "08:20:00" }, { "D", "08:30:00", "08:30:00" } });
+    auto up = makeTestTrain("T2", {
+        { "D", "08:00:00", "08:00:00" }, { "C", "08:10:00", "08:10:00" },
+        { "B", "08:20:00", "08:20:00" }, { "A", "08:30:00", "08:30:00" } });
+    coll.appendTrain(down);
+    coll.appendTrain(up);
+    QVERIFY(down->bindToRailway(railway, config));
+    QVERIFY(up->bindToRailway(railway, config));
+    const auto& upLine = *up->adapters().front()->lines().front();
+
+    StationTrainIndex index;
+    index.refresh(railway, coll);
+    std::vector<const StationTrainIndex::LineEnvelope*> lst;
+    index.overlappingLines(upLine, lst);
+    QCOMPARE(lst.size(), std::size_t(1));
+
+    shiftTrainTimes(*down, 3 * 3600);
+    index.refresh(railway, coll);
+    index.overlappingLines(upLine, lst);
+    QVERIFY(lst.empty());
+
+    shiftTrainTimes(*down, -3 * 3600);
+    index.refresh(railway, coll);
+    index.overlappingLines(upLine, lst);
+    QCOMPARE(lst.size(), std::size_t(1));
+
+    // 查询不重新读取时刻表：编辑版本不变时，索引保持原样；更新版本后才重建该车次
+    for (auto& st : down->timetable()) {
+        st.arrive = st.arrive.addSecs(3 * 3600);
+        st.depart = st.depart.addSecs(3 * 3600);
+    }
+    index.refresh(railway, coll);
+    index.overlappingLines(upLine, lst);
+    QCOMPARE(lst.size(), std::size_t(1));
+    down->markEdited();
+    index.refresh(railway, coll);
+    index.overlappingLines(upLine, lst);
+    QVERIFY(lst.empty());
+
+    // 删除车次
+    coll.removeTrain(down);
+    shiftTrainTimes(*down, -3 * 3600);
+    index.refresh(railway, coll);
+    index.overlappingLines(upLine, lst);
+    QVERIFY(lst.empty());
+}
+
+void RailTest::test_line_events_time_edit()
+{
+    auto railway = makeTestRailway({ "A", "B", "C", "D" });
+    Config config;
+    TrainCollection coll;
+    auto down = makeTestTrain("T1", {
+        { "A", "08:00:00", "08:00:00" }, { "B", "08:10:00", "08:10:00" },
+        { "C", "08:20:00", "08:20:00" }, { "D", "08:30:00", "08:30:00" } });
+    auto up = makeTestTrain("T2", {
+        { "D", "08:00:00", "08:00:00" }, { "C", "08:10:00", "08:10:00" },
+        { "B", "08:20:00", "08:20:00" }, { "A", "08:30:00", "08:30:00" } });
+    coll.appendTrain(down);
+    coll.appendTrain(up);
+    QVERIFY(down->bindToRailway(railway, config));
+    QVERIFY(up->bindToRailway(railway, config));
+    const auto& upLine = *up->adapters().front()->lines().front();
+
+    StationTrainIndex index;
+    index.refresh(railway, coll);
+    const auto before = eventSummary(index.lineEvents(upLine, coll));
+    QCOMPARE(before, eventSummary(upLine.listLineEvents(coll)));
+
+    // 平移下行车次，会车移到另一区间
+    shiftTrainTimes(*down, 10 * 60);
+    index.refresh(railway, coll);
+    const auto after = eventSummary(index.lineEvents(upLine, coll));
+    QCOMPARE(after, eventSummary(upLine.listLineEvents(coll)));
+    QVERIFY(after != before);
+
+    // 平移到不相交的时段，只剩本车的到开事件
+    shiftTrainTimes(*down, 3 * 3600);
+    index.refresh(railway, coll);
+    QCOMPARE(eventSummary(index.lineEvents(upLine, coll)), eventSummary(upLine.listLineEvents(coll)));
+}
+
+void RailTest::test_station_fingerprint_time_edit()
+{
+    auto railway = makeTestRailway({ "A", "B", "C", "D", "E" });
+    Config config;
+    TrainCollection coll;
+    auto t1 = makeTestTrain("T1", {
+        { "A", "08:00:00", "08:00:00" }, { "B", "08:10:00", "08:12:00" },
+        { "C", "08:22:00", "08:22:00" } });
+    auto t2 = makeTestTrain("T2", {
+        { "C", "09:00:00", "09:00:00" }, { "D", "09:10:00", "09:10:00" },
+        { "E", "09:20:00", "09:20:00" } });
+    coll.appendTrain(t1);
+    coll.appendTrain(t2);
+    QVERIFY(t1->bindToRailway(railway, config));
+    QVERIFY(t2->bindToRailway(railway, config));
+    const auto& stations = railway->stations();
+
+    StationTrainIndex index;
+    auto fingerprints = [&]() {
+        index.refresh(railway, coll);
+        std::vector<quint64> res;
+        for (const auto& st : stations)
+            res.push_back(index.fingerprint(st.get(), nullptr));
+        return res;
+    };
+    const auto fp0 = fingerprints();
+    QCOMPARE(fingerprints(), fp0);
+
+    // 只修改T1在B站的停站时刻
+    std::next(t1->timetable().begin())->depart = QTime(8, 14, 0);
+    t1->markEdited();
+    const auto fp1 = fingerprints();
+    for (int i = 0; i < stations.size(); i++) {
+        // T1覆盖A-C；T2覆盖C-E
+        if (i <= 2)
+            QVERIFY(fp1.at(i) != fp0.at(i));
+        else
+            QCOMPARE(fp1.at(i), fp0.at(i));
+    }
+    QCOMPARE(fingerprints(), fp1);
+}
+
+void RailTest::test_train_diff_dp()
+{
+    QRandomGenerator gen(20240608);
+    auto check = [](std::shared_ptr<const Train> t1, std::shared_ptr<const Train> t2) {
+        TrainDifference diff(t1, t2);
+        ReferenceTrainDiff ref(*t1, *t2);
+        QCOMPARE(diff.similarity, ref.similarity);
+        QCOMPARE(diff.difference, ref.difference);
+        QCOMPARE(diffSummary(diff), ref.stations);
+    };
+
+    // 任意两车次，以及修改得到的相近车次；包括只有1、2站的情况
+    for (int round = 0; round < 300; round++) {
+        int n1 = 1 + gen.bounded(round < 100 ? 4 : 40);
+        int n2 = 1 + gen.bounded(round < 100 ? 4 : 40);
+        int names = 2 + gen.bounded(8);
+        auto t1 = makeRandomTrain(gen, n1, names);
+        check(t1, makeRandomTrain(gen, n2, names));
+        check(t1, mutateTrain(gen, *t1, gen.bounded(6), names));
+        if (QTest::currentTestFailed())
+            return;
+    }
+
+    // 用时比较：长车次的少量修改，即运行图对比中的常见情况
+    auto t1 = makeRandomTrain(gen, 400, 300);
+    auto t2 = mutateTrain(gen, *t1, 20, 300);
+    constexpr int repeat = 20;
+    QElapsedTimer timer;
+    timer.start();
+    for (int k = 0; k < repeat; k++) {
+        TrainDifference diff(t1, t2);
+    }
+    const qint64 iterative = timer.nsecsElapsed();
+    timer.restart();
+    for (int k = 0; k < repeat; k++) {
+        ReferenceTrainDiff ref(*t1, *t2);
+    }
+    const qint64 reference = timer.nsecsElapsed();
+    qInfo().noquote() << QString("TrainDifference %1x%2, %3 runs: checkpointed %4 ms, full table %5 ms")
+        .arg(t1->stationCount()).arg(t2->stationCount()).arg(repeat)
+        .arg(iterative / 1e6, 0, 'f', 2).arg(reference / 1e6, 0, 'f', 2);
+    check(t1, t2);
+}
+
+void RailTest::test_lod_simplify_tolerance()
+{
+    // 缓慢弯曲的折线：相邻三点都近似共线，但累计偏差远超容差
+    {
+        QList<QPointF> points;
+        for (int i = 0; i <= 100; i++) {
+            points.append(QPointF(i * 10.0, i * 10.0 + 0.004 * i * i * 10.0));
+        }
+        const double tol = 1.0;
+        auto res = pathPolylines(TrainLineGeometry::simplified(multiLinePath(points), tol));
+        QCOMPARE(res.size(), 1);
+        QVERIFY(res.first().size() > 2);
+        QVERIFY(res.first().size() < points.size());
+        for (const auto& p : points) {
+            double d = std::numeric_limits<double>::max();
+            for (int k = 1; k < res.first().size(); k++)
+                d = std::min(d, pointSegmentDistance(p, res.first().at(k - 1), res.first().at(k)));
+            QVERIFY2(d <= tol + 1e-9, qPrintable(QString("deviation %1 > %2").arg(d).arg(tol)));
+        }
+    }
+
+    // 随机运行线：区间运行为斜线，站内停车为水平线段
+    QRandomGenerator gen(20240611);
+    for (int round = 0; round < 200; round++) {
+        const double tol = 0.25 * (1 + gen.bounded(20));
+        QList<QPointF> points{ QPointF(0, 0) };
+        QList<QList<QPointF>> runs{ { points.first() } };
+        const int n = 2 + gen.bounded(60);
+        for (int i = 0; i < n; i++) {
+            const QPointF& last = points.last();
+            if (i > 0 && i < n - 1 && runs.last().size() > 1 && gen.bounded(5) == 0) {
+                // 停车
+                QPointF p(last.x() + 1 + gen.bounded(20), last.y());
+                points.append(p);
+                runs.append({ p });
+            }
+            else {
+                double dy = (1 + gen.bounded(30)) * (gen.bounded(4) ? 1 : -0.2);
+                QPointF p(last.x() + 1 + gen.bounded(20), last.y() + dy + gen.generateDouble() * tol);
+                points.append(p);
+                runs.last().append(p);
+            }
+        }
+        if (runs.last().size() < 2)
+            runs.removeLast();
+
+        auto res = pathPolylines(TrainLineGeometry::simplified(multiLinePath(points), tol));
+
+        // 每段区间运行对应一条子路径，首末点保留，顶点都取自原路径
+        QCOMPARE(res.size(), runs.size());
+        for (int r = 0; r < runs.size(); r++) {
+            const auto& run = runs.at(r);
+            const auto& poly = res.at(r);
+            QVERIFY(poly.size() >= 2);
+            QCOMPARE(poly.first(), run.first());
+            QCOMPARE(poly.last(), run.last());
+            for (const auto& p : poly)
+                QVERIFY(run.contains(p));
+            for (const auto& p : run) {
+                double d = std::numeric_limits<double>::max();
+                for (int k = 1; k < poly.size(); k++)
+                    d = std::min(d, pointSegmentDistance(p, poly.at(k - 1), poly.at(k)));
+                QVERIFY2(d <= tol + 1e-9, qPrintable(QString("round %1: deviation %2 > %3")
+                    .arg(round).arg(d).arg(tol)));
+            }
+        }
+        if (QTest::currentTestFailed())
+            return;
+    }
+
+    // 共线且抖动小于容差的顶点合并为一条线段
+    QList<QPointF> points;
+    for (int i = 0; i <= 50; i++) {
+        points.append(QPointF(i * 5.0, i * 3.0 + (i % 2 ? 0.3 : -0.3)));
+    }
+    auto res = pathPolylines(TrainLineGeometry::simplified(multiLinePath(points), 1.0));
+    QCOMPARE(res.size(), 1);
+    QCOMPARE(res.first().size(), 2);
+}
+
+void RailTest::test_line_index_hit()
+{
+    // 索引不解引用TrainLine*，用互不相同的地址代替；accept中由地址换回编号
+    constexpr int total = 3000;
+    std::vector<int> keys(total);
+    auto lineOf = [&keys](int i) { return reinterpret_cast<TrainLine*>(&keys[i]); };
+    auto idOf = [&keys](TrainLine* t) { return static_cast<int>(reinterpret_cast<int*>(t) - keys.data()); };
+
+    struct Shape {
+        QList<QPointF> points;
+        double radius;
+    };
+    std::vector<Shape> shapes(total);
+    std::vector<bool> alive(total, false);
+
+    QRandomGenerator gen(20240612);
+    auto randomShape = [&gen]() {
+        Shape s;
+        s.radius = 0.5 + gen.generateDouble() * 2;
+        QPointF p(gen.generateDouble() * 2000, gen.generateDouble() * 1000);
+        s.points.append(p);
+        const int n = 1 + gen.bounded(25);
+        for (int i = 0; i < n; i++) {
+            p += QPointF(gen.generateDouble() * 40, (gen.generateDouble() - 0.5) * 80);
+            s.points.append(p);
+        }
+        return s;
+    };
+
+    TrainLineIndex index;
+    auto insert = [&](int i) {
+        shapes[i] = randomShape();
+        index.insert(lineOf(i), multiLinePath(shapes[i].points), shapes[i].radius);
+        alive[i] = true;
+    };
+
+    auto check = [&](const char* stage) {
+        int count = 0;
+        for (int i = 0; i < total; i++) {
+            QCOMPARE(index.contains(lineOf(i)), bool(alive[i]));
+            count += alive[i];
+        }
+        QCOMPARE(index.size(), count);
+
+        for (int q = 0; q < 1500; q++) {
+            const QPointF pos(gen.generateDouble() * 2100 - 50, gen.generateDouble() * 1100 - 50);
+            const double tol = gen.generateDouble() * 5;
+            const bool filtered = q % 2;
+            auto accept = [&](TrainLine* t) { return !filtered || idOf(t) % 3 != 0; };
+
+            // 暴力查找：各运行线到pos的距离
+            std::vector<double> dist(total, std::numeric_limits<double>::max());
+            double best = std::numeric_limits<double>::max();
+            for (int i = 0; i < total; i++) {
+                if (!alive[i])
+                    continue;
+                const auto& pts = shapes[i].points;
+                for (int k = 1; k < pts.size(); k++)
+                    dist[i] = std::min(dist[i], pointSegmentDistance(pos, pts.at(k - 1), pts.at(k)));
+                if (dist[i] <= shapes[i].radius + tol && accept(lineOf(i)))
+                    best = std::min(best, dist[i]);
+            }
+
+            double d = -1;
+            TrainLine* hit = index.lineAt(pos, tol, accept, &d);
+            if (best == std::numeric_limits<double>::max()) {
+                QVERIFY2(!hit, stage);
+                continue;
+            }
+            QVERIFY2(hit, stage);
+            const int id = idOf(hit);
+            QVERIFY2(id >= 0 && id < total && alive[id], stage);
+            QVERIFY2(accept(hit), stage);
+            // 距离相同的多条运行线可能取其中任一条
+            QVERIFY2(std::abs(dist[id] - best) < 1e-9, stage);
+            QVERIFY2(std::abs(d - best) < 1e-9, stage);
+        }
+    };
+
+    // 批量加入：超过MIN_PENDING，查询时建树
+    for (int i = 0; i < 2000; i++)
+        insert(i);
+    check("bulk");
+    if (QTest::currentTestFailed())
+        return;
+
+    // 少量增删、同一运行线重新加入：待索引线段与已移除的标记
+    for (int i = 2000; i < 2100; i++)
+        insert(i);
+    for (int i = 0; i < 300; i += 3) {
+        index.remove(lineOf(i));
+        alive[i] = false;
+    }
+    for (int i = 1; i < 200; i += 7)
+        insert(i);
+    index.remove(lineOf(total - 1));    // 不存在的运行线
+    check("incremental");
+    if (QTest::currentTestFailed())
+        return;
+
+    // 大量移除后重建
+    for (int i = 0; i < 2100; i++) {
+        if (i % 4 != 0) {
+            index.remove(lineOf(i));
+            alive[i] = false;
+        }
+    }
+    for (int i = 2100; i < total; i++)
+        insert(i);
+    check("rebuild");
+    if (QTest::currentTestFailed())
+        return;
+
+    index.clear();
+    std::fill(alive.begin(), alive.end(), false);
+    check("clear");
+}
+
+void RailTest::test_greedy_paint_batch()
+{
+    auto railway = makeTestRailway({ "A", "B", "C" });
+    auto ruler = railway->addEmptyRuler(QObject::tr("测试标尺"), false);
+    for (auto it = railway->firstDownInterval(); it; it = it->nextInterval()) {
+        it->getRulerNode(ruler)->interval = 600;
+    }
+    Diagram diagram;
+    diagram.addRailway(railway);
+
+    TrainFilterCore core;
+    TrainFilterSelectorCore filter(&core);
+    GreedyPainter painter(diagram, filter);
+    painter.setRailway(railway);
+    painter.setMaxBackoffTimes(10);
+    constexpr int gap = 240;
+    for (auto type : TrainGap::allPossibleGaps(true)) {
+        painter.constraints()[type] = gap;
+    }
+
+    auto makeRequest = [&](const QString& name, int priority) {
+        GreedyPaintRequest req;
+        req.trainName = TrainName(name);
+        req.anchor = railway->stations().front();
+        req.start = railway->stations().front();
+        req.end = railway->stations().back();
+        req.anchorTime = QTime(8, 0, 0);
+        req.ruler = ruler;
+        req.dir = Direction::Down;
+        req.priority = priority;
+        return req;
+    };
+
+    // 后给出的请求优先级高，先铺画
+    const std::vector<GreedyPaintRequest> requests{ makeRequest("G2", 0), makeRequest("G1", 1) };
+    const auto results = painter.paintBatch(requests);
+    QCOMPARE(results.size(), requests.size());
+    QVERIFY(results[0].success && results[1].success);
+    QCOMPARE(results[0].train->trainName().full(), QString("G2"));
+    QCOMPARE(results[1].train->trainName().full(), QString("G1"));
+
+    // 高优先级的按锚点时刻铺画；低优先级的被其阻挡，至少推迟一个间隔
+    QCOMPARE(results[1].backoffCount, 0);
+    QCOMPARE(results[1].train->timetable().front().depart, QTime(8, 0, 0));
+    QVERIFY(results[0].train->timetable().front().depart >= QTime(8, 0, 0).addSecs(gap));
+    QVERIFY(results[0].elapsedMs >= 0 && results[1].elapsedMs >= 0);
+
+    // 批量铺画的车次不加入运行图，事件表恢复：单独铺画时不再被阻挡
+    const auto again = painter.paintBatch({ makeRequest("G2", 0) });
+    QCOMPARE(again.size(), std::size_t(1));
+    QVERIFY(again[0].success);
+    QCOMPARE(again[0].train->timetable().front().depart, QTime(8, 0, 0));
+}
+
 QTEST_APPLESS_MAIN(RailTest)
 
 #include "tst_railtest.moc"